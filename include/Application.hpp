@@ -1,11 +1,32 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "FrameConstants.hpp"
+#include "FrameSnapshot.hpp"
+#include "Frustum.hpp"
+#include "GLStateCache.hpp"
+#include "InstanceAttributes.hpp"
+#include "JobSystem.hpp"
+#include "MaterialTable.hpp"
+#include "MeshPool.hpp"
+#include "RenderQueue.hpp"
+#include "ShaderRegistry.hpp"
+#include "StreamBuffer.hpp"
+#include "AssetPack.hpp"
+#include "DynamicBVH.hpp"
+#include "Components.hpp"
+#include "TextureCache.hpp"
+#include "TextureLoader.hpp"
+#include "TransformHierarchy.hpp"
+#include "World.hpp"
 
 // Forward-declare GLFWwindow to avoid pulling in GLFW everywhere
 struct GLFWwindow;
@@ -21,15 +42,58 @@ public:
     // The main loop: keep running until the user closes the window
     void run();
 
+    // Scene setup; call before run(), after which the simulation thread owns the scene
     void addItem();
     void addLight();
 
+    // Draw the cube field with one instanced draw call instead of one shader/VAO/draw per item.
+    // Must be called before init().
+    void setInstanced(bool instanced);
+
+    // Submit scene draws as multi-draw indirect commands with per-draw matrices in a buffer,
+    // one GL call per run of draws sharing state. Must be called before init().
+    void setIndirect(bool indirect);
+
+    // Instanced benchmark: ramps the cube count from the cubePositions[] scene up to 1M,
+    // logs the average frame time at each step, then closes the window. Implies setInstanced(true).
+    void enableBenchmark();
+
 private:
+    // Input gathered on the main thread and consumed by the next simulation step
+    struct SimulationInput {
+        glm::vec2 look{0.0f};                   // mouse movement since the last step
+        float zoom = 0.0f;
+        bool forward = false;
+        bool backward = false;
+        bool left = false;
+        bool right = false;
+    };
+
     // Private methods
     void processEvents();
-    void update();
     void render();
 
+    // Fixed-timestep simulation on its own thread, handing state to render() through snapshots
+    void startSimulation();
+    void stopSimulation();
+    void simulationMain(double startTime);
+    // one step of stepSeconds: input, camera and spin, then world matrices
+    void update(float stepSeconds);
+    void publishSnapshot(double time);
+    // moves the sceneTree leaves to the snapshot's world bounds
+    void syncSceneTree(const FrameSnapshot& snapshot);
+    void reportFrameStats(float currentFrame);
+
+    // Gives a scene entity with Transform and Bounds a leaf in sceneTree
+    void addSpatialProxy(Entity entity);
+    // Logs the nearest scene entity under the crosshair
+    void pick();
+
+    void setupInstancing();
+    void setInstanceCount(size_t count);
+    void renderInstanced(const Frustum& frustum, const FrameSnapshot& previous, const FrameSnapshot& current, float alpha);
+    void advanceBenchmark(float msPerFrame);
+
     GLFWwindow* m_window = nullptr;
 
     // Window dimensions
@@ -37,12 +101,38 @@ private:
     int m_windowHeight = 600;
 
     unsigned int shaderProgram;
-    std::vector<GLuint> VAOs;
-    std::vector<GLuint> VBOs;
-    std::vector<GLuint> EBOs;
 
-    std::vector<Shader*> shaders;
-    std::vector<std::vector<Texture*>> textures;
+    // Worker threads for frame work (transform levels, culling, instance data); the main and
+    // simulation threads join in while they wait
+    JobSystem jobs{ 0, 2 };
+
+    // Scene entities: transforms, spin and what to draw (components in Components.hpp).
+    // While the simulation runs it writes Spin and transforms; the main thread reads the
+    // other components and takes simulationMutex to change the scene's structure. Both
+    // threads iterate through World queries, which startSimulation() registers up front;
+    // a query over a new component set must be added there too (see World::query).
+    World scene;
+    // Local/world transforms of every scene entity; simulation thread only while it runs
+    TransformHierarchy transforms;
+    // World bounds of the scene entities, for culling and picking; main thread, refreshed
+    // from each snapshot
+    DynamicBVH sceneTree;
+    bool m_pickHeld = false;
+
+    std::thread simulationThread;
+    std::atomic<bool> m_simulationRunning{false};
+    std::mutex simulationMutex;                 // held by the simulation thread for each step
+    std::mutex inputMutex;
+    SimulationInput m_input;                    // guarded by inputMutex
+    SnapshotExchange snapshots;
+    Camera m_view;                              // camera as last drawn, for picking
+    std::atomic<uint32_t> m_simulationSteps{0};
+    std::atomic<uint32_t> m_simulationMicros{0};
+
+    // Programs are shared through the registry; each item holds a handle.
+    // Linked binaries persist across launches in the program cache.
+    ProgramBinaryCache programCache{"shader_cache"};
+    ShaderRegistry shaderRegistry;
 
 
     // std::vector<unsigned int> LIGHT_VAOs;
@@ -50,10 +140,70 @@ private:
     // std::vector<unsigned int> LIGHT_EBOs;
 
     // std::vector<Shader*> light_shaders;
-    Shader* lightingShader;
-    Shader* lightCubeShader;
-    GLuint VBO, containerVAO, lightVAO;
 
-    GLuint diffuseMap;
-    GLuint specularMap;
+    // Every mesh lives in the pool's shared per-format buffers; these are ranges within them
+    MeshPool* meshPool = nullptr;
+    MeshRange cubeMesh;
+    MeshRange lampMesh;
+
+    // Cooked textures and meshes, mapped read-only; empty when the cook target has not run
+    AssetPack* assetPack = nullptr;
+
+    // Streams textures in on worker threads; handles resolve to a placeholder until uploaded
+    TextureLoader* textureLoader = nullptr;
+    // All texture requests go through here: deduped, refcounted, LRU-evicted over budget
+    TextureCache* textureCache = nullptr;
+    bool m_textureReportPending = true;
+    AsyncTextureHandle diffuseTexture;
+    AsyncTextureHandle specularTexture;
+    // Texture-array layers and parameters of every material, indexed per instance by
+    // INSTANCED programs
+    MaterialTable* materials = nullptr;
+    MaterialId cubeMaterial = NO_MATERIAL;
+
+    // Per-frame data written straight into fenced, mapped memory: frame constants and instances
+    StreamBuffer* frameStream = nullptr;
+    // View/projection/light state shared by all programs, uploaded once per frame
+    FrameConstantsBuffer* frameConstants = nullptr;
+
+    // Instanced cube field: one shared mesh + program, per-instance transforms in frameStream
+    bool m_instanced = false;
+    bool m_indirect = false;
+    ShaderHandle instancedShader;
+    GLuint instanceVAO = 0;
+    std::vector<Entity> instanceEntities;
+    std::vector<TransformId> instanceTransforms;
+    BoxBounds instanceBounds;
+    std::vector<uint32_t> visibleInstances;
+
+    // Benchmark ramp state
+    bool m_benchmark = false;
+    size_t m_benchmarkStep = 0;
+    uint32_t m_benchmarkReports = 0;
+
+    // Draws are recorded into the queue, sorted, and submitted through the state cache
+    GLStateCache glState;
+    RenderQueue renderQueue{ jobs.getThreadCount() };   // one recording buffer per job thread
+
+    // Frustum culling ahead of the queue: scene entities through sceneTree, the instanced
+    // field through the linear culler
+    FrustumCuller culler;
+    std::vector<Entity> visibleEntities;
+
+    // Frame statistics, accumulated between reports
+    float m_statsStart = 0.0f;
+    uint32_t m_statsFrames = 0;
+    uint32_t m_statsUniformLookups = 0;
+    uint32_t m_statsStateChanges = 0;
+    uint32_t m_statsStateChangesAvoided = 0;
+    uint32_t m_statsCullTested = 0;
+    uint32_t m_statsCullVisible = 0;
+    uint32_t m_statsJobs = 0;
+    uint32_t m_statsJobsStolen = 0;
+    uint32_t m_statsSimulationSteps = 0;
+    uint32_t m_statsSimulationMicros = 0;
+    uint32_t m_statsDraws = 0;
+    uint32_t m_statsDrawCalls = 0;
+    uint64_t m_statsStreamBytes = 0;
+    uint32_t m_statsStreamWaits = 0;
 };
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "utils/hash.h"
+
+// On-disk layout of a cooked asset pack (written by the `assetcooker` tool, see tools/cook).
+//
+//   PackHeader
+//   PackEntry[entryCount]        table of contents, sorted by name
+//   name strings                 NUL-terminated, referenced by PackEntry::nameOffset
+//   records + payload            each entry's record starts on a page boundary; a texture
+//                                record is followed by its mip levels (largest first), a
+//                                mesh record by its vertex and index data
+//
+// Every offset is from the start of the file, and every payload is stored exactly as GL
+// consumes it, so the runtime maps the file and hands pointers into it to glTexImage2D /
+// glBufferData. Nothing is decoded and only the pages of assets actually used are touched.
+const uint32_t PACK_MAGIC = 0x4b415045; // "EPAK"
+const uint32_t PACK_VERSION = 2;
+const uint64_t PACK_RECORD_ALIGNMENT = 4096;
+const uint64_t PACK_DATA_ALIGNMENT = 16;
+const uint32_t PACK_MAX_MIPS = 16;
+
+enum PackEntryType : uint32_t {
+    PACK_TEXTURE = 1,
+    PACK_MESH = 2,
+};
+
+// PackTexture::flags
+const uint32_t PACK_TEXTURE_FLIPPED = 1u << 0;
+
+// PackTexture::format. RAW levels are 8-bit UNORM texels; the rest are rows of 4x4 blocks in
+// the GL_COMPRESSED_* UNORM layout of the same name, uploaded with glCompressedTexImage2D.
+enum PackTextureFormat : uint32_t {
+    PACK_FORMAT_RAW = 0,
+    PACK_FORMAT_BC1 = 1,            // opaque colour, 8 bytes per block
+    PACK_FORMAT_BC3 = 2,            // colour and alpha, 16
+    PACK_FORMAT_BC4 = 3,            // one channel (specular, masks), 8; sampled as grey
+    PACK_FORMAT_BC5 = 4,            // two channels (normal xy only; no shader samples them yet), 16
+    PACK_FORMAT_BC7 = 5,            // colour with or without alpha, 16
+    PACK_FORMAT_ETC2_RGB8 = 6,      // 8
+    PACK_FORMAT_ETC2_RGBA8 = 7,     // colour and EAC alpha, 16
+};
+
+struct PackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t tocOffset;
+    uint64_t stringsOffset;
+    uint64_t fileSize;
+};
+
+struct PackEntry {
+    uint32_t type;
+    uint32_t nameOffset;        // from PackHeader::stringsOffset
+    uint64_t offset;            // record
+    uint64_t size;              // record + payload
+};
+
+struct PackMip {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// RAW: 8-bit UNORM, tightly packed rows (upload with GL_UNPACK_ALIGNMENT 1); otherwise
+// block-compressed levels, down to 1x1 like the raw ones
+struct PackTexture {
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;          // of the source image
+    uint32_t mipCount;
+    uint32_t flags;
+    uint32_t format;            // PackTextureFormat
+    uint64_t contentHash;       // hashImagePixels() of the top level, for dedupe against loose files
+    PackMip mips[PACK_MAX_MIPS];
+};
+
+// Interleaved float vertices, optional uint32 indices
+struct PackMesh {
+    uint32_t floatsPerVertex;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t reserved;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+};
+
+static_assert(sizeof(PackHeader) == 40, "PackHeader layout is part of the file format");
+static_assert(sizeof(PackEntry) == 24, "PackEntry layout is part of the file format");
+static_assert(sizeof(PackTexture) == 32 + PACK_MAX_MIPS * sizeof(PackMip), "PackTexture layout is part of the file format");
+static_assert(sizeof(PackMesh) == 32, "PackMesh layout is part of the file format");
+
+// bytes per 4x4 block of a block-compressed format; 0 for PACK_FORMAT_RAW and unknown formats
+inline uint64_t packBlockBytes(uint32_t format) {
+    switch (format) {
+    case PACK_FORMAT_BC1:
+    case PACK_FORMAT_BC4:
+    case PACK_FORMAT_ETC2_RGB8:
+        return 8;
+    case PACK_FORMAT_BC3:
+    case PACK_FORMAT_BC5:
+    case PACK_FORMAT_BC7:
+    case PACK_FORMAT_ETC2_RGBA8:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+// bytes of one width x height level as the cooker stores it: whole 4x4 blocks, or tightly
+// packed texels for RAW
+inline uint64_t packMipBytes(uint32_t format, uint32_t width, uint32_t height, uint32_t channels) {
+    if (format == PACK_FORMAT_RAW) {
+        return (uint64_t)width * height * channels;
+    }
+    return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * packBlockBytes(format);
+}
+
+// 64-bit FNV-1a over the image size and pixels. Shared by the cooker and the texture loader
+// so cooked and loose copies of the same image dedupe to one GL texture.
+inline uint64_t hashImagePixels(int width, int height, int channels, const unsigned char* pixels, size_t size) {
+    const int header[3] = { width, height, channels };
+    return fnv1a64(pixels, size, fnv1a64(header, sizeof(header)));
+}
+
+// Read-only view of a pack mmap'd into memory. Lookups take the same paths the loose files
+// are opened with; they are resolved against `sourceRoot`, the directory the pack was cooked
+// from, so "../assets/container2.png" finds the entry cooked as "assets/container2.png".
+class AssetPack {
+public:
+    AssetPack(const std::string& path, const std::string& sourceRoot);
+    ~AssetPack();
+
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // False if the file is missing, truncated, corrupt or from another version. Every record
+    // and payload is checked when the pack is opened, so a pack that opens is safe to hand to GL.
+    bool isOpen() const;
+
+    const PackTexture* findTexture(const std::string& path) const;
+    const PackMesh* findMesh(const std::string& name) const;
+
+    // pointer to `offset` bytes into the mapping
+    const unsigned char* data(uint64_t offset) const;
+
+    size_t getEntryCount() const;
+    size_t getMappedBytes() const;
+
+private:
+    const PackEntry* find(const std::string& name, uint32_t type) const;
+    // the record and its payload stay inside the entry, and the payload is what it claims
+    bool isValidTexture(const PackEntry& entry) const;
+    bool isValidMesh(const PackEntry& entry) const;
+    std::string relativeName(const std::string& path) const;
+    void unmap();
+
+    std::string root;
+    const unsigned char* base = nullptr;
+    size_t mappedBytes = 0;
+
+    // entry name -> index into the TOC
+    std::unordered_map<std::string, uint32_t> names;
+};
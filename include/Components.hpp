@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "DynamicBVH.hpp"
+#include "GLStateCache.hpp"
+#include "MaterialTable.hpp"
+#include "ShaderRegistry.hpp"
+#include "TextureLoader.hpp"
+#include "TransformHierarchy.hpp"
+
+// Scene components stored in the World (see World.hpp)
+
+// the entity's node in the scene's TransformHierarchy (local TRS, parent and world matrix);
+// whoever destroys the entity destroys the node
+struct Transform {
+    TransformId id = NULL_TRANSFORM;
+};
+
+// turns the transform about a unit axis, setting its rotation every frame
+struct Spin {
+    glm::vec3 axis{0.0f, 1.0f, 0.0f};
+    float radiansPerSecond = 0.0f;
+    float angle = 0.0f;
+};
+
+// local-space bounding sphere; MeshRenderer entities are drawn only while it touches the view
+struct Bounds {
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+};
+
+// the entity's leaf in the scene's DynamicBVH, kept around its world-space Bounds
+struct SpatialProxy {
+    ProxyId id = NULL_PROXY;
+};
+
+// what to draw: program, a mesh in the MeshPool (its format's vertex array and index range)
+// and either the textures bound to units 0..textureCount-1 or, for INSTANCED programs, an
+// entry in the MaterialTable
+struct MeshRenderer {
+    ShaderHandle shader;
+    GLuint vao = 0;
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    AsyncTextureHandle textures[MAX_TEXTURE_UNITS];
+    GLuint textureCount = 0;
+    MaterialId material = NO_MATERIAL;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.hpp"
+
+struct AABB {
+    glm::vec3 lower{0.0f};
+    glm::vec3 upper{0.0f};
+
+    bool contains(const AABB& other) const {
+        return glm::all(glm::lessThanEqual(lower, other.lower)) && glm::all(glm::greaterThanEqual(upper, other.upper));
+    }
+    bool overlaps(const AABB& other) const {
+        return glm::all(glm::lessThanEqual(lower, other.upper)) && glm::all(glm::greaterThanEqual(upper, other.lower));
+    }
+    float surfaceArea() const {
+        glm::vec3 d = upper - lower;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+    glm::vec3 center() const { return (lower + upper) * 0.5f; }
+    glm::vec3 extent() const { return (upper - lower) * 0.5f; }
+
+    static AABB merge(const AABB& a, const AABB& b) { return { glm::min(a.lower, b.lower), glm::max(a.upper, b.upper) }; }
+    static AABB fromSphere(const glm::vec3& center, float radius) { return { center - glm::vec3(radius), center + glm::vec3(radius) }; }
+};
+
+using ProxyId = int32_t;
+const ProxyId NULL_PROXY = -1;
+
+// Dynamic AABB tree for spatial queries over moving objects.
+//
+// Each object (proxy) is a leaf holding its bounds grown by a margin ("fat" bounds), so small
+// movements leave the tree untouched: moveProxy only reinserts once the object leaves its fat
+// box. Insertion walks down picking the child whose surface area grows least, then walks back
+// up refitting the ancestors' bounds and rotating any node whose subtrees' heights differ by
+// more than one, which keeps the tree balanced under arbitrary insert/remove order.
+//
+// Queries run a depth-first walk on a fixed stack and call a visitor for each leaf that
+// passes; they never allocate. Visitors get (ProxyId, userData) and return false to stop
+// (rays: see raycast). Queries test the fat bounds, so they may report objects just outside
+// the query volume; exact tests belong in the visitor.
+class DynamicBVH {
+public:
+    explicit DynamicBVH(float margin = 0.1f) : margin(margin) {}
+
+    ProxyId createProxy(const AABB& bounds, uint64_t userData);
+    void destroyProxy(ProxyId proxy);
+    // `displacement` is the expected movement this step, used to stretch the fat bounds
+    // ahead of the object. Returns true if the proxy had to be reinserted.
+    bool moveProxy(ProxyId proxy, const AABB& bounds, const glm::vec3& displacement = glm::vec3(0.0f));
+    void clear();
+
+    uint64_t getUserData(ProxyId proxy) const { return nodes[proxy].userData; }
+    const AABB& getFatBounds(ProxyId proxy) const { return nodes[proxy].bounds; }
+
+    size_t getProxyCount() const { return proxyCount; }
+    int32_t getHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+
+    // leaves whose fat bounds overlap `box`
+    template <typename Visitor>
+    void query(const AABB& box, Visitor&& visitor) const;
+
+    // leaves whose fat bounds come within `radius` of `center`
+    template <typename Visitor>
+    void querySphere(const glm::vec3& center, float radius, Visitor&& visitor) const;
+
+    // leaves whose fat bounds are not entirely outside one of the planes; subtrees entirely
+    // inside the frustum are reported without further plane tests
+    template <typename Visitor>
+    void queryFrustum(const Frustum& frustum, Visitor&& visitor) const;
+
+    // Leaves whose fat bounds the ray enters within maxDistance, roughly nearest subtree
+    // first. visitor(ProxyId, userData, entryDistance) returns the new maximum distance:
+    // the exact hit distance to search for the closest hit only, the value it was given
+    // to keep going, or 0 to stop.
+    template <typename Visitor>
+    void raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Visitor&& visitor) const;
+
+private:
+    static constexpr int32_t NULL_NODE = -1;
+    static constexpr int STACK_CAPACITY = 128;     // far above the height of any balanced tree
+
+    struct Node {
+        AABB bounds;
+        uint64_t userData = 0;
+        int32_t parent = NULL_NODE;             // next free node while on the free list
+        int32_t child1 = NULL_NODE;
+        int32_t child2 = NULL_NODE;
+        int32_t height = 0;                     // leaf 0, free -1
+
+        bool isLeaf() const { return child1 == NULL_NODE; }
+    };
+
+    int32_t allocateNode();
+    void freeNode(int32_t node);
+    void insertLeaf(int32_t leaf);
+    void removeLeaf(int32_t leaf);
+    // refits and rebalances from `node` to the root
+    void refitUpwards(int32_t node);
+    // rotates `node`'s taller grandchild up if its children are unbalanced; returns the
+    // subtree's new root
+    int32_t balance(int32_t node);
+
+    // entry distance of the ray into the box, or a negative value if it misses within maxDistance
+    static float rayEntry(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance);
+
+    std::vector<Node> nodes;
+    int32_t root = NULL_NODE;
+    int32_t freeList = NULL_NODE;
+    size_t proxyCount = 0;
+    float margin;
+};
+
+template <typename Visitor>
+void DynamicBVH::query(const AABB& box, Visitor&& visitor) const {
+    int32_t stack[STACK_CAPACITY];
+    int count = 0;
+    if (root != NULL_NODE) {
+        stack[count++] = root;
+    }
+    while (count > 0) {
+        const Node& node = nodes[stack[--count]];
+        if (!node.bounds.overlaps(box)) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            if (!visitor((ProxyId)(&node - nodes.data()), node.userData)) {
+                return;
+            }
+        } else {
+            assert(count + 2 <= STACK_CAPACITY);
+            stack[count++] = node.child1;
+            stack[count++] = node.child2;
+        }
+    }
+}
+
+template <typename Visitor>
+void DynamicBVH::querySphere(const glm::vec3& center, float radius, Visitor&& visitor) const {
+    int32_t stack[STACK_CAPACITY];
+    int count = 0;
+    if (root != NULL_NODE) {
+        stack[count++] = root;
+    }
+    const float radius2 = radius * radius;
+    while (count > 0) {
+        const Node& node = nodes[stack[--count]];
+        glm::vec3 closest = glm::clamp(center, node.bounds.lower, node.bounds.upper);
+        glm::vec3 d = closest - center;
+        if (glm::dot(d, d) > radius2) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            if (!visitor((ProxyId)(&node - nodes.data()), node.userData)) {
+                return;
+            }
+        } else {
+            assert(count + 2 <= STACK_CAPACITY);
+            stack[count++] = node.child1;
+            stack[count++] = node.child2;
+        }
+    }
+}
+
+template <typename Visitor>
+void DynamicBVH::queryFrustum(const Frustum& frustum, Visitor&& visitor) const {
+    // the high bit marks subtrees already known to be inside every plane
+    const uint32_t INSIDE = 0x80000000u;
+    uint32_t stack[STACK_CAPACITY];
+    int count = 0;
+    if (root != NULL_NODE) {
+        stack[count++] = (uint32_t)root;
+    }
+    while (count > 0) {
+        uint32_t entry = stack[--count];
+        const Node& node = nodes[entry & ~INSIDE];
+        bool inside = (entry & INSIDE) != 0;
+        if (!inside) {
+            glm::vec3 center = node.bounds.center();
+            glm::vec3 extent = node.bounds.extent();
+            bool outside = false;
+            inside = true;
+            for (const glm::vec4& plane : frustum.planes) {
+                glm::vec3 normal(plane);
+                float distance = glm::dot(normal, center) + plane.w;
+                float reach = glm::dot(glm::abs(normal), extent);
+                if (distance + reach < 0.0f) {
+                    outside = true;
+                    break;
+                }
+                inside &= distance - reach >= 0.0f;
+            }
+            if (outside) {
+                continue;
+            }
+        }
+        if (node.isLeaf()) {
+            if (!visitor((ProxyId)(&node - nodes.data()), node.userData)) {
+                return;
+            }
+        } else {
+            assert(count + 2 <= STACK_CAPACITY);
+            stack[count++] = (uint32_t)node.child1 | (inside ? INSIDE : 0);
+            stack[count++] = (uint32_t)node.child2 | (inside ? INSIDE : 0);
+        }
+    }
+}
+
+template <typename Visitor>
+void DynamicBVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, Visitor&& visitor) const {
+    glm::vec3 inverseDirection = 1.0f / direction; // +-inf on axis-parallel rays is handled by the slab test
+    // (node, entry distance); entries are rechecked on pop since maxDistance only shrinks
+    struct Pending {
+        int32_t node;
+        float entry;
+    };
+    Pending stack[STACK_CAPACITY];
+    int count = 0;
+    if (root != NULL_NODE) {
+        float entry = rayEntry(nodes[root].bounds, origin, inverseDirection, maxDistance);
+        if (entry >= 0.0f) {
+            stack[count++] = { root, entry };
+        }
+    }
+    while (count > 0) {
+        Pending pending = stack[--count];
+        if (pending.entry > maxDistance) {
+            continue;
+        }
+        const Node& node = nodes[pending.node];
+        if (node.isLeaf()) {
+            maxDistance = visitor((ProxyId)pending.node, node.userData, pending.entry);
+            if (maxDistance <= 0.0f) {
+                return;
+            }
+            continue;
+        }
+        // push the farther child first so the nearer one is visited first
+        Pending first = { node.child1, rayEntry(nodes[node.child1].bounds, origin, inverseDirection, maxDistance) };
+        Pending second = { node.child2, rayEntry(nodes[node.child2].bounds, origin, inverseDirection, maxDistance) };
+        if (second.entry >= 0.0f && (first.entry < 0.0f || second.entry < first.entry)) {
+            std::swap(first, second);
+        }
+        assert(count + 2 <= STACK_CAPACITY);
+        if (second.entry >= 0.0f) {
+            stack[count++] = second;
+        }
+        if (first.entry >= 0.0f) {
+            stack[count++] = first;
+        }
+    }
+}
@@ -1,8 +1,18 @@
 #pragma once
 
-#include <glm/glm.hpp>
+#include <cstdint>
 
+// Handle to an entity in a World. The generation is bumped every time the index is
+// recycled, so a handle to a destroyed entity never aliases its successor.
 struct Entity {
-    glm::vec3 position;
-    float size;
-};
\ No newline at end of file
+    uint32_t index = 0;
+    uint32_t generation = 0;    // 0 is never issued: a default Entity is null
+
+    bool isNull() const { return generation == 0; }
+    bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const Entity& other) const { return !(*this == other); }
+
+    // packed into one integer, e.g. as spatial index user data
+    uint64_t toBits() const { return (uint64_t)generation << 32 | index; }
+    static Entity fromBits(uint64_t bits) { return Entity{ (uint32_t)bits, (uint32_t)(bits >> 32) }; }
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "StreamBuffer.hpp"
+
+// Uniform buffer binding point shared by every program that declares the FrameConstants block.
+// GLSL 330 has no layout(binding = N), so Shader assigns it with glUniformBlockBinding after linking.
+const GLuint FRAME_CONSTANTS_BINDING = 0;
+
+// Per-frame camera and light state, laid out to match the std140 FrameConstants block
+// in the shaders. vec3 values are padded to vec4 as std140 requires.
+struct FrameConstants {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPos;
+    glm::vec4 lightPosition;
+    glm::vec4 lightAmbient;
+    glm::vec4 lightDiffuse;
+    glm::vec4 lightSpecular;
+};
+
+static_assert(sizeof(FrameConstants) == 208, "FrameConstants must match the std140 block layout");
+
+// Feeds the block behind FRAME_CONSTANTS_BINDING. Write it once per frame with update(); each
+// call takes a fresh slice of the frame's stream buffer and binds that range, so the GPU can
+// still be reading last frame's values while this frame's are written.
+class FrameConstantsBuffer {
+public:
+    explicit FrameConstantsBuffer(StreamBuffer& stream);
+
+    // between the stream's beginFrame() and endFrame()
+    void update(const FrameConstants& constants);
+
+    FrameConstantsBuffer(const FrameConstantsBuffer&) = delete;
+    FrameConstantsBuffer& operator=(const FrameConstantsBuffer&) = delete;
+
+private:
+    StreamBuffer& stream;
+    GLint offsetAlignment = 256;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Camera.hpp"
+#include "TransformHierarchy.hpp"
+
+// Everything the renderer takes from one simulation step. Filled by the simulation thread,
+// read-only once published.
+struct FrameSnapshot {
+    double time = 0.0;                      // simulation clock (glfwGetTime) this state is for
+    Camera camera;
+    glm::vec3 lightPosition{0.0f};
+    std::vector<glm::mat4> worlds;          // by TransformId; nodes created since are past the end
+    std::vector<TransformId> instances;     // transforms of the instanced field, in draw order
+
+    bool hasWorld(TransformId id) const { return id < worlds.size(); }
+};
+
+// Hands snapshots from the simulation thread to the render thread without either side waiting.
+//
+// A triple-buffered handoff (one being written, one waiting in the exchange, one being read)
+// plus a fourth buffer so the reader can keep the previous snapshot to interpolate from.
+// publish() swaps the written buffer into the exchange; acquire() takes it if it is newer,
+// giving back the reader's oldest. A slow reader skips steps; a slow writer leaves the reader
+// on the same pair. Buffers are reused, so their vectors stop allocating once warm.
+class SnapshotExchange {
+public:
+    // writer: the buffer to fill next (contents are from several steps ago)
+    FrameSnapshot& beginWrite() { return buffers[writeIndex]; }
+    void publish();
+
+    // reader: returns true if a newer snapshot became current
+    bool acquire();
+    const FrameSnapshot& previous() const { return buffers[previousIndex]; }
+    const FrameSnapshot& current() const { return buffers[currentIndex]; }
+
+private:
+    static constexpr uint32_t INDEX_MASK = 3;
+    static constexpr uint32_t FRESH = 4;    // set while the exchange holds an unread snapshot
+
+    FrameSnapshot buffers[4];
+    uint32_t writeIndex = 0;                // writer only
+    std::atomic<uint32_t> exchange{1};
+    uint32_t previousIndex = 2;             // reader only
+    uint32_t currentIndex = 3;              // reader only
+};
+
+// Render-side blend between two snapshots: world matrices and camera at `alpha` of the way
+// from `from` to `to`. Matrices are blended per element, close enough for the small rotation
+// of one step and far cheaper than decomposing.
+glm::mat4 interpolateWorld(const FrameSnapshot& from, const FrameSnapshot& to, TransformId id, float alpha);
+Camera interpolateCamera(const Camera& from, const Camera& to, float alpha);
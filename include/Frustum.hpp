@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+class JobSystem;
+
+// The six clip planes of a view-projection matrix, as (normal, d) with unit normals pointing
+// inwards: a point p is inside when dot(normal, p) + d >= 0 for every plane.
+struct Frustum {
+    enum Plane {
+        PLANE_LEFT = 0,
+        PLANE_RIGHT,
+        PLANE_BOTTOM,
+        PLANE_TOP,
+        PLANE_NEAR,
+        PLANE_FAR,
+        PLANE_COUNT
+    };
+    glm::vec4 planes[PLANE_COUNT];
+
+    // Gribb/Hartmann extraction from projection * view (GL clip space, -w <= z <= w)
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    // false only when the sphere lies entirely behind one of the planes
+    bool intersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+// World-space bounding spheres, one array per component so the culler can test several
+// spheres per instruction.
+struct SphereBounds {
+    std::vector<float> centerX, centerY, centerZ, radius;
+
+    void clear();
+    void reserve(size_t count);
+    void push(const glm::vec3& center, float sphereRadius);
+    // a local-space sphere moved into world space; the radius grows with the largest scale
+    void pushTransformed(const glm::mat4& world, const glm::vec3& center, float sphereRadius);
+    size_t size() const { return radius.size(); }
+};
+
+// World-space axis-aligned boxes as center and half extents, one array per component.
+struct BoxBounds {
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+
+    void clear();
+    void reserve(size_t count);
+    void resize(size_t count);
+    void push(const glm::vec3& center, const glm::vec3& halfExtent);
+    // the world-space box enclosing a transformed local-space box
+    void pushTransformed(const glm::mat4& world, const glm::vec3& center, const glm::vec3& halfExtent);
+    // same, overwriting box `index`; lets threads fill disjoint ranges after a resize()
+    void setTransformed(size_t index, const glm::mat4& world, const glm::vec3& center, const glm::vec3& halfExtent);
+    size_t size() const { return extentX.size(); }
+};
+
+// Tests bounding volumes against a frustum, four at a time with SSE, and writes the indices
+// of the ones that may be visible to a compacted list, in their original order. Conservative:
+// a volume that straddles a plane, or lies outside near a frustum corner, counts as visible.
+// Given a job system, large sets are culled in blocks across its threads.
+class FrustumCuller {
+public:
+    // counted since the last resetStats()
+    struct Stats {
+        uint32_t tested = 0;
+        uint32_t visible = 0;
+    };
+
+    // `visible` is overwritten with the indices of the volumes that pass
+    void cull(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint32_t>& visible, JobSystem* jobs = nullptr);
+    void cull(const Frustum& frustum, const BoxBounds& bounds, std::vector<uint32_t>& visible, JobSystem* jobs = nullptr);
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    Stats stats;
+    std::vector<uint32_t> blockVisible;     // per-block counts of a parallel cull
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <glad/glad.h>
+
+// Number of texture units tracked by the cache (and usable by a DrawItem)
+const GLuint MAX_TEXTURE_UNITS = 4;
+
+// Shadows the GL bindings the renderer touches and skips calls that would not change anything.
+// Anything that binds programs, textures or VAOs behind the cache's back must call invalidate().
+class GLStateCache {
+public:
+    struct Stats {
+        uint32_t programBinds = 0;
+        uint32_t textureBinds = 0;
+        uint32_t vertexArrayBinds = 0;
+        // calls that were skipped because the state was already current
+        uint32_t avoided = 0;
+    };
+
+    GLStateCache();
+
+    void useProgram(GLuint program);
+    // a texture counts as bound only on the target it was last bound to
+    void bindTexture(GLuint unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+    void bindVertexArray(GLuint vao);
+    // deletes the texture and drops it from the shadowed units, since GL unbinds it there and
+    // may hand its name to the next texture created
+    void deleteTexture(GLuint texture);
+
+    // forget the shadowed state so the next call of each kind always reaches GL
+    void invalidate();
+
+    const Stats& getStats() const;
+    void resetStats();
+
+private:
+    // sentinel that never matches a real GL name, used after invalidate()
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    GLuint program;
+    GLuint activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS];
+    GLenum targets[MAX_TEXTURE_UNITS];
+    GLuint vao;
+
+    Stats stats;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// First vertex attribute location of the per-instance data; shaders compiled with INSTANCED
+// read the model matrix at 3-6, the normal matrix at 7-9 and the material id at 10
+const GLuint INSTANCE_ATTRIBUTE_LOCATION = 3;
+
+// Per-instance (or, with base instance, per-draw) vertex attributes, advanced once per instance
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+    uint32_t material;          // MaterialTable entry
+};
+
+InstanceData makeInstanceData(const glm::mat4& model, uint32_t material = 0);
+
+// Sets the divisors on the bound VAO; once per VAO
+void enableInstanceAttributes();
+// Points the bound VAO's instance attributes at InstanceData records starting at `offset` in
+// `buffer`. Binds GL_ARRAY_BUFFER.
+void bindInstanceAttributes(GLuint buffer, GLintptr offset);
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// A unit of work: a small callable plus the counters that tie it to other jobs.
+// Jobs live in a ring owned by the thread that created them; a handle stays valid until that
+// thread has created JOB_POOL_SIZE more jobs, far more than one frame needs. Wrapping onto a
+// job that has not finished yet aborts.
+struct alignas(64) Job {
+    static constexpr size_t STORAGE_SIZE = 64;
+    static constexpr uint32_t MAX_SUCCESSORS = 8;
+    static constexpr uint32_t SUCCESSORS_CLOSED = ~0u;  // successorCount once the job is finishing
+
+    void (*invoke)(Job& job) = nullptr;         // calls and destroys the callable in storage
+    Job* parent = nullptr;
+    std::atomic<int32_t> unfinished{0};         // itself plus children still running; 0 = done,
+                                                // stored last: the slot may be reused after it
+    std::atomic<int32_t> blockers{0};           // 1 until run(), plus unfinished prerequisites
+    std::atomic_flag successorLock = ATOMIC_FLAG_INIT;
+    uint32_t successorCount = 0;
+    Job* successors[MAX_SUCCESSORS];            // released when this job finishes
+    alignas(16) unsigned char storage[STORAGE_SIZE];
+};
+
+using JobHandle = Job*;
+
+// Fixed pool of worker threads running jobs from per-thread work-stealing deques.
+//
+// Each thread pushes and pops jobs at the bottom of its own deque (Chase-Lev), so the common
+// path takes no lock; idle threads steal the oldest job from the top of someone else's. The
+// thread that constructs the system takes part as the first client thread, and up to
+// clientCount - 1 more can join with attach(): wait() and parallelFor() on a client run other
+// jobs instead of blocking. Workers with nothing to steal spin briefly, then sleep.
+//
+//   JobHandle a = jobs.create([&] { ... });
+//   JobHandle b = jobs.create([&] { ... });
+//   jobs.addDependency(b, a);                  // b starts once a has finished
+//   jobs.run(a); jobs.run(b);
+//   jobs.wait(b);
+//
+// create/run/wait may be called from client threads and from jobs, not from other threads.
+class JobSystem {
+public:
+    static constexpr uint32_t JOB_POOL_SIZE = 4096;     // per thread, power of two
+
+    // counted since the last resetStats()
+    struct Stats {
+        uint32_t executed = 0;
+        uint32_t stolen = 0;
+    };
+
+    // workerCount 0: one per core besides the calling thread
+    explicit JobSystem(unsigned workerCount = 0, unsigned clientCount = 1);
+    ~JobSystem();
+
+    // makes the calling thread the next client; once per thread, before it uses the system
+    void attach();
+
+    // A job that calls `function()` once run() and its prerequisites allow it. With a
+    // parent, the parent does not count as finished until this job has too.
+    template <typename F>
+    JobHandle create(F&& function, JobHandle parent = nullptr);
+    // `job` does not start before `prerequisite` has finished; call before run(job)
+    void addDependency(JobHandle job, JobHandle prerequisite);
+    // queues the job on the calling thread (it starts once its prerequisites have finished)
+    void run(JobHandle job);
+    // runs queued jobs until `job` and all its children have finished
+    void wait(JobHandle job);
+    bool isFinished(JobHandle job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+
+    // Calls f(begin, end) over [0, count) in ranges of at most `grain` and returns once all
+    // have run, the caller working too. Ranges are split in halves as they are run, so a
+    // thief takes the largest remaining piece.
+    template <typename F>
+    void parallelFor(uint32_t count, uint32_t grain, const F& f);
+
+    // workers plus client threads
+    unsigned getThreadCount() const { return (unsigned)threads.size(); }
+    // the calling client or worker thread, below getThreadCount(); for indexing per-thread data
+    unsigned getThreadIndex() const;
+
+    Stats getStats() const;
+    void resetStats();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+private:
+    struct ThreadState;
+
+    Job* allocate(void (*invoke)(Job&), JobHandle parent);
+    void workerMain(unsigned index);
+    // own deque first, then steal
+    Job* findJob(ThreadState& thread);
+    void execute(ThreadState& thread, Job* job);
+    // marks one unit of `job` done; on the last one releases its successors and its parent
+    void finish(ThreadState& thread, Job* job);
+    void release(ThreadState& thread, Job* job);
+    ThreadState& current();
+
+    template <typename F>
+    void runRange(JobHandle root, uint32_t begin, uint32_t end, uint32_t grain, const F* f);
+
+    std::vector<std::unique_ptr<ThreadState>> threads;
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+    std::atomic<unsigned> attachedClients{1};
+    unsigned clientCount;
+
+    // sleeping workers wake when something is queued
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<int32_t> sleepers{0};
+    std::atomic<int64_t> queued{0};
+};
+
+template <typename F>
+JobHandle JobSystem::create(F&& function, JobHandle parent) {
+    using Callable = typename std::decay<F>::type;
+    static_assert(sizeof(Callable) <= Job::STORAGE_SIZE, "job callable too large; capture by reference");
+    static_assert(alignof(Callable) <= 16, "job callable over-aligned");
+
+    Job* job = allocate([](Job& self) {
+        Callable* callable = reinterpret_cast<Callable*>(self.storage);
+        (*callable)();
+        callable->~Callable();
+    }, parent);
+    new (job->storage) Callable(std::forward<F>(function));
+    return job;
+}
+
+template <typename F>
+void JobSystem::parallelFor(uint32_t count, uint32_t grain, const F& f) {
+    grain = std::max(grain, 1u);
+    if (count <= grain) {
+        if (count > 0) {
+            f(0u, count);
+        }
+        return;
+    }
+    JobHandle root = create([] {});
+    runRange(root, 0, count, grain, &f);
+    run(root);
+    wait(root);
+}
+
+template <typename F>
+void JobSystem::runRange(JobHandle root, uint32_t begin, uint32_t end, uint32_t grain, const F* f) {
+    // queue the upper half, keep the lower; children hang off the root so one wait covers all
+    while (end - begin > grain) {
+        uint32_t middle = begin + (end - begin) / 2;
+        run(create([this, root, middle, end, grain, f] { runRange(root, middle, end, grain, f); }, root));
+        end = middle;
+    }
+    (*f)(begin, end);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include "GLStateCache.hpp"
+#include "TextureLoader.hpp"
+
+// Uniform buffer binding point of the Materials block (see FRAME_CONSTANTS_BINDING)
+const GLuint MATERIALS_BINDING = 1;
+// Entries in the Materials block; 16 bytes each, well inside the 16 KB every GL 3.3 UBO allows
+const uint32_t MAX_MATERIALS = 256;
+
+using MaterialId = uint32_t;
+const MaterialId NO_MATERIAL = ~0u;
+
+// One entry of the std140 Materials block: texture layers in the material's array, plus the
+// scalar parameters the shaders used to take as uniforms
+struct MaterialConstants {
+    uint32_t diffuseLayer;
+    uint32_t specularLayer;
+    float shininess;
+    float padding;
+};
+
+static_assert(sizeof(MaterialConstants) == 16, "MaterialConstants must match the std140 Materials block");
+
+// Materials as layers of shared GL_TEXTURE_2D_ARRAYs, described by a uniform table that
+// shaders index with a per-instance material id. Draws whose materials share an array need no
+// texture binds between them, so different materials can go out in one instanced or indirect
+// draw.
+//
+// Arrays are grouped by size: a material's diffuse map picks (or starts) the array of its
+// size, and its specular map is scaled into the same array. Layers are RGBA8 and copied on the
+// GPU from the loader's textures with glBlitFramebuffer once those are resident (compressed
+// ones are read back decompressed first), level by level, so the mips the loader filtered on
+// its workers carry over; only a map whose chain runs out early has its array's mips
+// regenerated on the GPU. Until then a material points at a 1x1 white layer. Full arrays
+// double, copying their layers over, up to GL_MAX_ARRAY_TEXTURE_LAYERS; maps that find their
+// array at that limit stay white. Materials live as long as the table.
+//
+// GL thread only. Arrays are created, filled and regrown from update(), so array and source
+// textures are bound through the renderer's GLStateCache (unit 0); the two copy framebuffers
+// are the table's own and bound directly.
+class MaterialTable {
+public:
+    explicit MaterialTable(GLStateCache& state);
+    ~MaterialTable();
+
+    // MAX_MATERIALS at most; returns the id to pass per instance
+    MaterialId create(AsyncTextureHandle diffuse, AsyncTextureHandle specular, float shininess);
+
+    // Places materials whose textures have become resident and uploads changed entries. Once
+    // per frame, before drawing.
+    void update();
+
+    // the array texture holding the material's layers; changes once it has been placed
+    GLuint getArray(MaterialId material) const { return arrays[materials[material].array].texture; }
+    size_t size() const { return materials.size(); }
+    size_t getArrayCount() const { return arrays.size(); }
+
+    MaterialTable(const MaterialTable&) = delete;
+    MaterialTable& operator=(const MaterialTable&) = delete;
+
+private:
+    struct TextureArray {
+        GLuint texture = 0;
+        int width = 0;
+        int height = 0;
+        uint32_t layers = 0;
+        uint32_t capacity = 0;
+        bool mipsStale = false;             // a map's chain ran out; regenerate
+    };
+
+    struct Material {
+        AsyncTextureHandle diffuse;         // released once copied into the array
+        AsyncTextureHandle specular;
+        uint32_t array = 0;                 // index into arrays; 0 is the white placeholder
+        bool placed = false;
+    };
+
+    uint32_t findArray(int width, int height);
+    // copies every level of a resident texture into the next free layer, scaling it to the array's size
+    uint32_t addLayer(uint32_t array, const AsyncTexture& texture);
+    // doubles the capacity, clamped to GL_MAX_ARRAY_TEXTURE_LAYERS; nothing when already there
+    void grow(TextureArray& array);
+    void allocateLevels(GLuint texture, int width, int height, uint32_t layers);
+    // an RGBA8 copy of a block-compressed texture's first `levels` levels
+    GLuint decompressedCopy(GLuint texture, int levels);
+
+    std::vector<TextureArray> arrays;
+    std::vector<Material> materials;
+    std::vector<MaterialConstants> constants;
+    size_t dirtyBegin = 0;                  // constants[dirtyBegin, dirtyEnd) need uploading
+    size_t dirtyEnd = 0;
+
+    GLStateCache& state;
+    GLuint ubo = 0;
+    GLuint readFramebuffer = 0;
+    GLuint drawFramebuffer = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include "GLStateCache.hpp"
+
+// Interleaved float vertex layouts. Attributes sit at fixed locations: position 0, then
+// normal and/or texture coords in the order named.
+enum VertexFormat {
+    VERTEX_P3N3T2 = 0,      // position, normal, uv (lit, textured meshes)
+    VERTEX_P3N3 = 1,        // position, normal
+    VERTEX_P3T2 = 2,        // position, uv
+    VERTEX_FORMAT_COUNT
+};
+
+// Where a mesh lives in its format's arena; draw with
+// glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, firstIndex * 4, baseVertex)
+// on MeshPool::getVertexArray(format).
+struct MeshRange {
+    VertexFormat format = VERTEX_P3N3T2;
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    GLuint vertexCount = 0;
+
+    bool isNull() const { return indexCount == 0; }
+};
+
+// Shared vertex and index storage: one vertex buffer, one index buffer and one VAO per
+// vertex format, with every mesh of that format sub-allocated out of them. Draws of different
+// meshes then differ only in their offsets, so they need no VAO switch and can later be
+// merged into multi-draw calls.
+//
+// Each arena hands out ranges first-fit from an offset-sorted free list and merges freed
+// ranges with their neighbours. A full arena doubles: the contents move to a larger buffer
+// on the GPU (glCopyBufferSubData) and the VAO is re-pointed, so existing ranges and VAO
+// names stay valid.
+//
+// GL thread only. VAOs are bound through the renderer's GLStateCache, since an allocation may
+// regrow an arena and re-point its VAO in the middle of a frame; buffer bindings, which the
+// cache doesn't shadow, are made directly.
+class MeshPool {
+public:
+    // counted over all formats
+    struct Stats {
+        uint32_t meshes = 0;
+        uint32_t vertexBytes = 0;           // in use
+        uint32_t indexBytes = 0;
+        uint32_t capacityBytes = 0;         // allocated on the GPU, vertices and indices
+    };
+
+    explicit MeshPool(GLStateCache& state) : state(state) {}
+    ~MeshPool();
+
+    // Copies a mesh into the pool. Without indices the vertices are taken as a triangle list
+    // and identical vertices are welded. Returns a null range for an empty mesh.
+    MeshRange allocate(VertexFormat format, const float* vertices, uint32_t vertexCount,
+                       const uint32_t* indices = nullptr, uint32_t indexCount = 0);
+    void free(const MeshRange& range);
+
+    // 0 until the format's first allocation
+    GLuint getVertexArray(VertexFormat format) const { return arenas[format].vao; }
+    // points the bound VAO at the format's buffers, for VAOs that add their own (for example
+    // per-instance) attributes; repeat after allocations, which may move the buffers
+    void bindAttributes(VertexFormat format) const;
+
+    static uint32_t getFloatsPerVertex(VertexFormat format);
+
+    Stats getStats() const;
+
+    MeshPool(const MeshPool&) = delete;
+    MeshPool& operator=(const MeshPool&) = delete;
+
+private:
+    // free [offset, offset + size) ranges in units of vertices or indices, sorted by offset
+    struct FreeList {
+        struct Range {
+            uint32_t offset;
+            uint32_t size;
+        };
+        std::vector<Range> ranges;
+
+        // first fit; returns false if nothing is large enough
+        bool allocate(uint32_t size, uint32_t& offset);
+        void release(uint32_t offset, uint32_t size);
+    };
+
+    struct Arena {
+        GLuint vao = 0;
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        uint32_t vertexCapacity = 0;        // in vertices
+        uint32_t indexCapacity = 0;         // in indices
+        FreeList freeVertices;
+        FreeList freeIndices;
+        uint32_t meshes = 0;
+        uint32_t usedVertices = 0;
+        uint32_t usedIndices = 0;
+    };
+
+    // grows the arena until `vertices` more vertices and `indices` more indices fit
+    void reserve(VertexFormat format, uint32_t vertices, uint32_t indices);
+    void bindAttributes(VertexFormat format, GLuint vertexBuffer, GLuint indexBuffer) const;
+
+    GLStateCache& state;
+    Arena arenas[VERTEX_FORMAT_COUNT];
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum MipFilter {
+    MIP_FILTER_BOX,         // 2x2 average; cheap enough for loads at runtime
+    MIP_FILTER_KAISER,      // 6-tap Kaiser-windowed sinc; keeps more detail, for the cooker
+};
+
+// One level of a chain stored back to back in a single buffer
+struct MipLevel {
+    int width;
+    int height;
+    size_t offset;
+    size_t size;
+};
+
+// Lays out a full chain of tightly packed 8-bit texels, level 0 first and each level half the
+// one above (rounded down, at least 1) down to 1x1; returns the total bytes
+size_t mipChainLayout(int width, int height, int channels, std::vector<MipLevel>& levels, uint32_t maxLevels = 16);
+
+// Filters one level down into dst, max(width / 2, 1) x max(height / 2, 1). With `srgb` the
+// colour channels (all but alpha) are sRGB-encoded and averaged in linear light, so the mips
+// keep the image's brightness; alpha and non-colour data are filtered as stored. Edges clamp.
+void downsampleLevel(const unsigned char* src, int width, int height, int channels, bool srgb, MipFilter filter, unsigned char* dst);
+
+// Fills levels 1.. of `chain` from level 0, which must already be at offset 0. CPU only and
+// thread safe, so loaders and the cooker run it on their worker threads.
+void buildMipChain(unsigned char* chain, const std::vector<MipLevel>& levels, int channels, bool srgb, MipFilter filter);
+
+// The level of a width x height chain of `levels` levels to scale into a dstWidth x dstHeight
+// destination: the smallest still at least as large, so filtering is left to the chain's own
+// mips. -1 when the chain is too short, the best level being more than twice the destination:
+// a bilinear blit from it would skip texels, so the destination's mips are rebuilt instead.
+int mipCopySourceLevel(int width, int height, int levels, int dstWidth, int dstHeight);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GLStateCache.hpp"
+#include "MipChain.hpp"
+
+// GPU side of mipCopySourceLevel(), shared by the material table and the texture atlas.
+
+// Copies the first `dstLevels` levels of a destination from a width x height texture of
+// `levels` levels, each from the source level mipCopySourceLevel() picks, so the mips the
+// loader filtered on its workers carry over and only the remaining scale is left to a bilinear
+// blit. The caller binds its read and draw framebuffers first; `size(level)` gives the
+// destination rectangle's size at a level, and `blit(level, sourceSize, size, filter)` attaches
+// that level to the draw framebuffer and blits from the read one, which holds the source level
+// at GL_COLOR_ATTACHMENT0. Blits convert RGB and single-channel sources to the destination's
+// format. Returns false when the chain ran out before the last level (level 0 is always
+// copied): the destination's mips must then be regenerated, see regenerateMips().
+template <typename Size, typename Blit>
+bool copyMipChain(GLuint source, int width, int height, int levels, int dstLevels, Size size, Blit blit) {
+    for (int level = 0; level < dstLevels; ++level) {
+        const glm::ivec2 dstSize = size(level);
+        int sourceLevel = mipCopySourceLevel(width, height, levels, dstSize.x, dstSize.y);
+        if (sourceLevel < 0) {
+            if (level > 0) {
+                return false;
+            }
+            // level 0 is copied whatever texels the blit skips; an empty destination is worse.
+            // The chain ran out before reaching the destination, so its last level is the closest.
+            sourceLevel = levels - 1;
+        }
+        const glm::ivec2 sourceSize(std::max(width >> sourceLevel, 1), std::max(height >> sourceLevel, 1));
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, sourceLevel);
+        blit(level, sourceSize, dstSize, sourceSize != dstSize ? GL_LINEAR : GL_NEAREST);
+    }
+    return true;
+}
+
+// Rebuilds every level of a texture from its level 0, after a copyMipChain() that returned
+// false. Binds it through the cache on unit 0; the copy framebuffers must be released first.
+inline void regenerateMips(GLStateCache& state, GLuint texture, GLenum target = GL_TEXTURE_2D) {
+    state.bindTexture(0, texture, target);
+    glGenerateMipmap(target);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <glad/glad.h>
+
+// Persists linked program binaries (glGetProgramBinary) on disk so later launches can skip
+// compiling and linking. Entries are keyed by a hash of the shader sources, defines and the
+// driver's vendor/renderer/version strings; a driver update therefore misses instead of
+// loading an incompatible binary. Entries the driver rejects are deleted and recompiled.
+class ProgramBinaryCache {
+public:
+    explicit ProgramBinaryCache(const std::string& directory);
+
+    // false when the context has no program binary support (checked on first call, needs a context)
+    bool isSupported();
+
+    // hash of everything that affects the binary: final sources (defines included) and the driver
+    uint64_t makeKey(const std::string& vertexCode, const std::string& fragmentCode);
+
+    // loads the binary for key into program; true if the program is now linked
+    bool load(uint64_t key, GLuint program);
+
+    // writes the binary of a freshly linked program (which must have been linked with
+    // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set)
+    void store(uint64_t key, GLuint program);
+
+    uint32_t getHits() const;
+    uint32_t getMisses() const;
+    uint32_t getRejected() const;
+
+private:
+    std::string pathFor(uint64_t key) const;
+
+    std::string directory;
+    int supported = -1;     // -1 until queried
+    uint64_t driverHash = 0;
+
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t rejected = 0;
+};
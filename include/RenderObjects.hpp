@@ -5,21 +5,44 @@
 #include <glm/glm.hpp>
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "RenderQueue.hpp"
+#include "ShaderRegistry.hpp"
+#include "Components.hpp"
+#include "Frustum.hpp"
+#include "MeshPool.hpp"
+#include "TextureAtlas.hpp"
+#include "TransformHierarchy.hpp"
+#include "World.hpp"
 
+// Loose renderable objects. Each object is an entity in the given world with a Transform
+// node, Bounds and a MeshRenderer; this class owns only the pool ranges it allocated.
 class RenderObjects {
 public:
-    // Virtual destructor in case of inheritance
-    RenderObjects() = default;
-    ~RenderObjects() = default;
+    RenderObjects(World& world, TransformHierarchy& transforms, MeshPool& meshes);
+    ~RenderObjects();
 
-    // Pure virtual function for rendering (implementation in .cpp or derived class)
-    void render();
+    RenderObjects(const RenderObjects&) = delete;
+    RenderObjects& operator=(const RenderObjects&) = delete;
 
-    // Add a new object; returns the index of the new object
-    // (Implementation can be in .cpp, or inline here if you prefer)
-    void addObject(
+    // Records one draw per object in the frustum into the queue, at the world matrices of
+    // the last TransformHierarchy::update(); the caller flushes it
+    void render(RenderQueue& queue, FrustumCuller& culler, const Frustum& frustum);
+
+    // Packs the single texture of objects added from now on into `atlas` when their uvs stay
+    // inside [0, 1]. Until an entry is placed the object draws from its own texture; then its
+    // uvs are remapped into the page and the texture is let go. The atlas must outlive this
+    // and be update()d each frame, followed by update() here, before render().
+    void setAtlas(TextureAtlas* atlas) { this->atlas = atlas; }
+
+    // Moves objects whose atlas entries have settled onto their page or back to their own
+    // texture. Outside the render pass: the remapped meshes are re-allocated in the pool,
+    // which may regrow it.
+    void update();
+
+    // Add a new object from a triangle list of position + uv vertices; returns its entity
+    Entity addObject(
         std::vector<float>,
-        std::unique_ptr<Shader> shader,
+        ShaderHandle shader,
         std::vector<Texture> tex,
         const glm::vec3& pos,
         const glm::vec3& rot,
@@ -27,29 +50,30 @@ public:
     );
 
 protected:
-    // Parallel arrays:
-    // The element at index i in each vector corresponds to the same renderable object.
-
-    // Vertices
-    std::vector<std::vector<float>> vertices;
-
-    // If each object owns its shader, use unique_ptr<Shader>.
-    // (Or consider storing by value if Shader is a lightweight handle class.)
-    std::vector<std::unique_ptr<Shader>> shaders;
-
-    // Each object can have multiple textures.
-    // This vector-of-vectors allows variable numbers of textures per object.
-    std::vector<std::vector<Texture>> textures;
-
-    // Position, rotation, scale for each object (SoA).
-    // Indices match the corresponding shader/texture vector entries.
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> rotations;
-    std::vector<glm::vec3> scales;
-
-    // OpenGL Handles
-    std::vector<GLuint> vaos;
-    std::vector<GLuint> vbos;
-    std::vector<GLuint> ebos;
-};
+    World& world;
+    TransformHierarchy& transforms;
+    MeshPool& meshes;
+
+    // Entities created by addObject, in creation order
+    std::vector<Entity> objects;
 
+    // Pool ranges of the objects, freed with them
+    std::vector<MeshRange> ranges;
+
+    // Atlas entry each object draws from, NO_ATLAS_ENTRY for its own textures
+    TextureAtlas* atlas = nullptr;
+    std::vector<AtlasEntry> atlasEntries;
+
+    // Objects waiting for their atlas entry, with the vertices to remap once it is placed
+    struct PendingAtlasObject {
+        size_t object;
+        AtlasEntry entry;
+        std::vector<float> vertices;
+    };
+    std::vector<PendingAtlasObject> atlasPending;
+
+    // Per-frame culling scratch; drawable holds indices into objects
+    std::vector<uint32_t> drawable;
+    SphereBounds bounds;
+    std::vector<uint32_t> visible;
+};
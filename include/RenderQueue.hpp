@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GLStateCache.hpp"
+
+class Shader;
+class StreamBuffer;
+
+// Render passes, submitted in this order
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1,
+};
+
+// One draw as described by the caller. Everything needed to issue it later, in any order;
+// submit() stores it as a compact packet.
+struct DrawItem {
+    uint64_t key = 0;              // from RenderQueue::makeKey; decides submission order
+    Shader* shader = nullptr;
+    GLuint vao = 0;
+    GLuint textures[MAX_TEXTURE_UNITS] = {};  // bound to units 0..textureCount-1
+    GLuint textureCount = 0;
+    GLenum textureTarget = GL_TEXTURE_2D;     // of all of them
+    uint32_t material = 0;                    // MaterialTable entry, for instanced programs
+    GLint baseVertex = 0;           // indexed triangles from the vao's element buffer
+    GLuint firstIndex = 0;
+    GLsizei indexCount = 0;
+    glm::mat4 model = glm::mat4(1.0f);
+};
+
+// One record of glMultiDrawElementsIndirect's command buffer, in the layout GL reads
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Collects draws during a frame, sorts them by a 64-bit key so that draws sharing a
+// program/material/mesh end up adjacent, and submits them through a GLStateCache so
+// redundant binds between neighbours are skipped.
+//
+// Recording needs no GL context, so draws can be prepared on any number of threads: each
+// records into its own linear buffer of packets (program, mesh, textures and the model
+// matrix to upload, nothing more), with no locking and no shared cache lines. flush(), on
+// the GL thread, merges every buffer's keys into one sort and replays the packets.
+//
+// In indirect mode flush() writes every draw's model and normal matrix into a stream buffer,
+// read as per-instance attributes (InstanceAttributes.hpp) with the draw's index as its base
+// instance, plus one DrawElementsIndirectCommand per draw. Each run of sorted draws sharing a
+// program, textures and vertex array then goes out as a single glMultiDrawElementsIndirect.
+// Without multi-draw indirect (GL 4.3) the commands are issued in a CPU loop instead, each
+// draw re-pointing the attributes. Either way programs must be their INSTANCED variant.
+//
+// Key layout, most significant first:
+//   pass (4) | program (12) | material (16) | mesh (16) | depth (16)
+class RenderQueue {
+public:
+    // counted since the last resetStats()
+    struct Stats {
+        uint32_t draws = 0;
+        uint32_t drawCalls = 0;                 // GL draw calls issued for them
+    };
+
+    // threadCount recording buffers; submit() picks one by index
+    explicit RenderQueue(unsigned threadCount = 1);
+    ~RenderQueue();
+
+    static uint64_t makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t mesh, uint16_t depth);
+
+    // Maps a view-space distance in [nearPlane, farPlane] to the 16-bit key depth.
+    // Opaque draws sort front-to-back; transparent ones should pass the inverted value.
+    static uint16_t quantizeDepth(float distance, float nearPlane, float farPlane);
+
+    // Records a draw into buffer `thread`. Threads may submit concurrently as long as each
+    // uses its own index; none may while flush() runs.
+    void submit(const DrawItem& item, unsigned thread = 0);
+
+    // Sorts and issues every submitted draw, then empties the queue. GL thread.
+    void flush(GLStateCache& state);
+
+    size_t size() const;
+    // packet bytes recorded since the last flush
+    size_t getRecordedBytes() const;
+
+    // Switches indirect submission on or off, creating or releasing its stream buffer. GL
+    // thread, between frames; switch it off before the context is destroyed.
+    void setIndirect(bool indirect);
+    bool isIndirect() const { return stream != nullptr; }
+    // whether this context can draw a run with one glMultiDrawElementsIndirect
+    static bool hasMultiDrawIndirect();
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    // (key, packet) pairs, radix sorted; scratch is the ping-pong buffer
+    struct SortEntry {
+        uint64_t key;
+        uint32_t thread;
+        uint32_t offset;                        // of the packet in that thread's buffer
+    };
+
+    // One thread's recording: packets back to back, plus their sort entries. Buffers keep
+    // their capacity between frames so steady-state recording does not allocate.
+    struct alignas(64) Recorder {
+        std::unique_ptr<unsigned char[]> bytes;
+        size_t used = 0;
+        size_t capacity = 0;
+        std::vector<SortEntry> entries;
+    };
+
+    void sortKeys();
+    // replay of the sorted draws: one glDrawElementsBaseVertex and model uniform per draw
+    void flushDirect(GLStateCache& state);
+    void flushIndirect(GLStateCache& state);
+
+    std::vector<Recorder> recorders;
+    std::vector<SortEntry> order;
+    std::vector<SortEntry> scratch;
+
+    std::unique_ptr<StreamBuffer> stream;       // per-draw data and commands, indirect mode only
+    Stats stats;
+};
@@ -1,35 +1,98 @@
 #pragma once
+#include <memory>
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+class ProgramBinaryCache;
+class TextureCache;
+class AsyncTexture;
+
+// FNV-1a hash of a uniform name. constexpr so names known at compile time
+// (string literals, static constexpr UniformName) are hashed by the compiler.
+constexpr uint32_t hashUniformName(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= static_cast<uint8_t>(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// A uniform name together with its precomputed hash. Implicitly built from a
+// string literal or std::string so the setters below accept either.
+struct UniformName {
+    constexpr UniformName(const char* n) : name(n), hash(hashUniformName(n)) {}
+    UniformName(const std::string& n) : name(n.c_str()), hash(hashUniformName(n.c_str())) {}
+
+    const char* name;
+    uint32_t hash;
+};
 
 class Shader {
     public:
-        Shader(const char*, const char*);
+        // defines are injected as "#define <entry>" after #version, e.g. { "INSTANCED", "MAX_LIGHTS 4" }.
+        // with a binaryCache the linked program is loaded from / saved to disk instead of always compiling.
+        Shader(const char*, const char*, const std::vector<std::string>& defines = {}, ProgramBinaryCache* binaryCache = nullptr);
         ~Shader();
 
+        // owns a GL program; share it through ShaderHandle instead of copying
+        Shader(const Shader&) = delete;
+        Shader& operator=(const Shader&) = delete;
+
         void Use();
-        // utility uniform functions
-        void setBool(const std::string &name, bool value) const;  
-        void setInt(const std::string &name, int value) const;   
-        void setFloat(const std::string &name, float value) const;
-        void setMat4(const std::string &name, const glm::mat4 &mat) const;
-        void setVec3(const std::string &name, const glm::vec3 &vec) const;
-        void setVec3(const std::string &name, float x, float y, float z) const;        
-        void loadDiffuseTexture(const char* path);
-        void loadSpecularTexture(const char* path);
+
+        // returns the location of a uniform from the table built at link time (-1 if inactive).
+        // cache the result and pass it to the location-based setters in hot loops.
+        GLint getUniformLocation(UniformName name) const;
+
+        // utility uniform functions (by name)
+        void setBool(UniformName name, bool value) const;
+        void setInt(UniformName name, int value) const;
+        void setFloat(UniformName name, float value) const;
+        void setMat4(UniformName name, const glm::mat4 &mat) const;
+        void setVec3(UniformName name, const glm::vec3 &vec) const;
+        void setVec3(UniformName name, float x, float y, float z) const;
+
+        // utility uniform functions (by location from getUniformLocation)
+        void setBool(GLint location, bool value) const;
+        void setInt(GLint location, int value) const;
+        void setFloat(GLint location, float value) const;
+        void setMat4(GLint location, const glm::mat4 &mat) const;
+        void setVec3(GLint location, const glm::vec3 &vec) const;
+        void setVec3(GLint location, float x, float y, float z) const;
+
+        // requested through the cache; the maps read as the placeholder until loaded
+        void loadDiffuseTexture(TextureCache& cache, const char* path);
+        void loadSpecularTexture(TextureCache& cache, const char* path);
 
         uint32_t getID() const;
         GLuint getDiffuseMap() const;
         GLuint getSpecularMap() const;
 
+        // number of glGetUniformLocation calls made since the last reset (names missing from the link-time table)
+        static uint32_t getDriverLookups();
+        static void resetDriverLookups();
+
     private:
+        // fills `uniforms` from glGetActiveUniform after a successful link
+        void buildUniformTable();
+        // attaches known uniform blocks (FrameConstants, Materials) to their fixed binding points
+        void bindUniformBlocks();
+
         unsigned int vertexShader;
         unsigned int fragmentShader;
         unsigned int shaderProgram;
-        GLuint diffuseMap;
-        GLuint specularMap;
+        std::shared_ptr<AsyncTexture> diffuseMap;
+        std::shared_ptr<AsyncTexture> specularMap;
+
+        GLuint programID = 0;
+
+        // name hash -> location. Misses are resolved through the driver once and cached here too.
+        mutable std::unordered_map<uint32_t, GLint> uniforms;
 
-        GLuint programID;
-};
\ No newline at end of file
+        static uint32_t driverLookups;
+};
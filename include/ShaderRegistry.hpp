@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Shader.hpp"
+#include "ProgramBinaryCache.hpp"
+
+// Reference-counted handle to a shared program. The program is deleted when the last handle goes away.
+using ShaderHandle = std::shared_ptr<Shader>;
+
+// Compiles each distinct (vertex path, fragment path, defines) combination once and hands out
+// shared handles to it, so any number of objects using the same shaders share one GL program.
+class ShaderRegistry {
+public:
+    ShaderHandle get(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
+
+    // programs created after this are loaded from / saved to the cache (nullptr disables it)
+    void setBinaryCache(ProgramBinaryCache* cache);
+
+    // number of programs currently alive
+    size_t size() const;
+
+    // lookups served from the registry vs. programs created (compiled or loaded from the binary cache)
+    uint32_t getHits() const;
+    uint32_t getCompiles() const;
+
+    // wall time spent creating programs, in milliseconds
+    double getCreateMilliseconds() const;
+
+private:
+    static std::string makeKey(const char* vertexPath, const char* fragmentPath, std::vector<std::string> defines);
+
+    // weak so the registry never keeps a program alive on its own
+    std::unordered_map<std::string, std::weak_ptr<Shader>> programs;
+
+    ProgramBinaryCache* binaryCache = nullptr;
+
+    uint32_t hits = 0;
+    uint32_t compiles = 0;
+    double createMilliseconds = 0.0;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+// A span of a StreamBuffer, valid for the frame it was allocated in
+struct StreamAllocation {
+    void* data = nullptr;       // write-only; null (and nothing to commit) if the frame's
+                                // region is full or the range couldn't be mapped
+    GLintptr offset = 0;        // into the buffer named by StreamBuffer::getID()
+    GLsizeiptr size = 0;
+};
+
+// Ring buffer for data rewritten every frame: instance attributes, uniform blocks, dynamic
+// vertices. One GL buffer is split into FRAME_COUNT regions; each frame allocates linearly
+// from its own region and endFrame() fences it. beginFrame() waits on the fence of the region
+// it is about to reuse, which the GPU has normally passed long before, so writes never touch
+// data still in flight and the driver never has to orphan or shadow-copy anything.
+//
+// With ARB_buffer_storage (core in 4.4) the buffer is mapped once, persistent and coherent:
+// an allocation is a plain pointer into it, safe to fill from job threads, and writing it is
+// the upload. On plain 3.3 each allocation is mapped unsynchronized (the fences already do
+// the synchronizing) and commit() unmaps it, so only one allocation may be open at a time
+// there; call commit() before drawing on either path.
+//
+//   stream.beginFrame();
+//   StreamAllocation a = stream.allocate(bytes);
+//   ... fill a.data, commit(a), draw from getID() at a.offset ...
+//   stream.endFrame();
+class StreamBuffer {
+public:
+    static constexpr unsigned FRAME_COUNT = 3;
+
+    // counted since the last resetStats()
+    struct Stats {
+        uint64_t allocatedBytes = 0;
+        uint32_t fenceWaits = 0;        // frames that found their region still in use by the GPU
+        float fenceWaitMilliseconds = 0.0f;
+    };
+
+    explicit StreamBuffer(size_t bytesPerFrame);
+    ~StreamBuffer();
+
+    // grows every region to at least bytesPerFrame; recreates the buffer, so call it between
+    // frames and re-specify anything pointing at getID()
+    void reserve(size_t bytesPerFrame);
+
+    void beginFrame();
+    // `alignment` must be a power of two, e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for a block
+    StreamAllocation allocate(size_t size, size_t alignment = 16);
+    void commit(const StreamAllocation& allocation);
+    void endFrame();
+
+    GLuint getID() const { return buffer; }
+    bool isPersistent() const { return persistent != nullptr; }
+    size_t getBytesPerFrame() const { return regionSize; }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+private:
+    void create(size_t bytesPerFrame);
+    void destroy();
+
+    GLuint buffer = 0;
+    unsigned char* persistent = nullptr;    // whole buffer, when mapped persistently
+    size_t regionSize = 0;
+    unsigned region = 0;                    // the region this frame allocates from
+    size_t used = 0;                        // bytes taken from it so far
+    bool mapped = false;                    // an allocation is mapped (non-persistent path)
+    GLsync fences[FRAME_COUNT] = {};
+
+    Stats stats;
+};
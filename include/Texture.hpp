@@ -2,31 +2,34 @@
 #define TEXTURE_HPP
 
 #include <glad/glad.h>
+#include "TextureLoader.hpp"
+
+class TextureCache;
 
 class Texture {
 public:
-    // Constructor
-    Texture(const char* path);
-
-    // Destructor
-    ~Texture();
+    // Constructor: requests the image from the cache (loaded asynchronously, flipped vertically)
+    Texture(TextureCache& cache, const char* path);
 
     // Use the texture
     void Use(const unsigned int) const;
 
-    // Get the texture ID
+    // Get the texture ID (the loader's placeholder until the image is resident)
     unsigned int getID() const;
 
+    // The shared cache handle, for components that keep the texture alive
+    const AsyncTextureHandle& getHandle() const { return texture; }
+
     // Delete copy constructor and copy assignment to prevent accidental copies
     Texture(const Texture&) = delete;
     Texture& operator=(const Texture&) = delete;
 
-    // Implement move constructor and move assignment if needed
-    Texture(Texture&& other) noexcept;
-    Texture& operator=(Texture&& other) noexcept;
+    // Moving hands over the cache reference
+    Texture(Texture&& other) noexcept = default;
+    Texture& operator=(Texture&& other) noexcept = default;
 
 private:
-    unsigned int textureID = 0; // Member variable with default initialization
+    AsyncTextureHandle texture;
 };
 
 #endif
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "imstb_rectpack.h"
+#include "GLStateCache.hpp"
+#include "TextureLoader.hpp"
+
+using AtlasEntry = uint32_t;
+const AtlasEntry NO_ATLAS_ENTRY = ~0u;
+
+// Small textures packed into shared RGBA8 pages, so sprites and decals that would each be a
+// texture object (and a bind) become rectangles of a few large ones.
+//
+// Entries are inserted at any time and placed by update() once their texture is resident: the
+// page's stb_rectpack skyline takes one more rectangle, or a new page is started when none has
+// room. Rectangles are packed in cells of MIP_ALIGNMENT texels and carry a GUTTER of edge
+// texels on every side, so levels up to MAX_MIP_LEVEL never blend neighbouring entries.
+// Pixels are copied on the GPU from the loader's texture with glBlitFramebuffer, gutters
+// included, level by level from the chain the loader filtered on its workers.
+//
+// A placed entry is sampled from getPage() at remap(uv); uvs must stay inside [0, 1] since
+// nothing repeats across the gutter. Users remap their meshes right after update(), outside
+// the render pass. Pages are MAX_PAGE_SIZE square where GL_MAX_TEXTURE_SIZE allows, and an
+// entry takes at most half a page on a side; larger textures are scaled down to that when
+// copied. Block-compressed textures and those with fewer than three channels (a blit would
+// turn grey into red) are rejected, as are any the copy fails for, and should be drawn on
+// their own. Entries live as long as the atlas.
+//
+// GL thread only. Pages are bound through the renderer's GLStateCache (unit 0) when they are
+// created and when update() rebuilds their mips; the atlas's read and draw framebuffers are
+// bound directly and released before update() returns.
+class TextureAtlas {
+public:
+    static constexpr int MAX_PAGE_SIZE = 2048;      // GL 3.3 only guarantees 1024
+    static constexpr int MAX_MIP_LEVEL = 2;
+    static constexpr int MIP_ALIGNMENT = 1 << MAX_MIP_LEVEL;
+    static constexpr int GUTTER = MIP_ALIGNMENT;
+
+    enum EntryState {
+        ENTRY_PENDING,      // texture still loading
+        ENTRY_PLACED,
+        ENTRY_REJECTED,     // failed to load or copy, or not RGB(A)
+    };
+
+    struct Stats {
+        uint32_t entries = 0;
+        uint32_t pages = 0;
+        uint64_t usedTexels = 0;                    // packed rectangles, gutters included
+    };
+
+    explicit TextureAtlas(GLStateCache& state);
+    ~TextureAtlas();
+
+    AtlasEntry insert(AsyncTextureHandle texture);
+
+    // Places entries whose textures have become resident. Once per frame, before drawing.
+    void update();
+
+    EntryState getState(AtlasEntry entry) const { return entries[entry].state; }
+    // 0 until placed
+    GLuint getPage(AtlasEntry entry) const { return entries[entry].state == ENTRY_PLACED ? pages[entries[entry].page]->texture : 0; }
+    // xy scale and zw offset taking the entry's [0, 1] uvs into its page
+    glm::vec4 getUVTransform(AtlasEntry entry) const { return entries[entry].uvTransform; }
+    glm::vec2 remap(AtlasEntry entry, const glm::vec2& uv) const {
+        const glm::vec4& transform = entries[entry].uvTransform;
+        return uv * glm::vec2(transform.x, transform.y) + glm::vec2(transform.z, transform.w);
+    }
+
+    Stats getStats() const;
+    int getPageSize() const { return pageSize; }
+
+    TextureAtlas(const TextureAtlas&) = delete;
+    TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+private:
+    // stbrp_context points into its own node array, so pages stay where they were created
+    struct Page {
+        GLuint texture = 0;
+        stbrp_context packer;
+        std::vector<stbrp_node> nodes;
+        uint64_t usedTexels = 0;
+        bool mipsStale = false;                     // an entry's chain ran out; regenerate
+    };
+
+    struct Entry {
+        AsyncTextureHandle texture;                 // released once copied into a page
+        EntryState state = ENTRY_PENDING;
+        uint32_t page = 0;
+        glm::vec4 uvTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    };
+
+    bool place(Entry& entry);
+    // packs a rectangle of `width` x `height` cells into an existing page or a new one
+    bool allocate(int width, int height, uint32_t& page, int& x, int& y);
+    void addPage();
+    // scales a sourceWidth x sourceHeight texture into the width x height rectangle at x, y;
+    // false when the source can't be read back, the rectangle then staying empty
+    bool copy(GLuint source, int sourceWidth, int sourceHeight, int levels, Page& page, int x, int y, int width, int height);
+
+    std::vector<std::unique_ptr<Page>> pages;
+    std::vector<Entry> entries;
+    size_t firstPending = 0;                        // entries before it are all settled
+    int pageSize = MAX_PAGE_SIZE;
+    int maxEntrySize = MAX_PAGE_SIZE / 2;
+
+    GLStateCache& state;
+    GLuint readFramebuffer = 0;
+    GLuint drawFramebuffer = 0;
+};
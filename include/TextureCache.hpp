@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "TextureLoader.hpp"
+
+// Single front door for textures. Requests for the same file (after path canonicalisation)
+// share one handle; different files with identical decoded pixels share one GL texture
+// (see TextureLoader). The cache keeps every texture alive until it is both the least
+// recently requested and held by nobody else, and trim() evicts such textures while the
+// bytes resident exceed the VRAM budget. Render thread only.
+class TextureCache {
+public:
+    TextureCache(TextureLoader& loader, size_t vramBudget);
+
+    AsyncTextureHandle get(const std::string& path, bool flipVertically = false);
+
+    // Evicts least recently used, otherwise unreferenced textures until under budget. Call
+    // after uploads, when the resident bytes grow.
+    void trim();
+    void setBudget(size_t bytes);
+    size_t getBudget() const;
+
+    // each GL texture counted once, however many paths alias it
+    size_t getResidentBytes() const;
+    size_t size() const;
+    size_t getHits() const;
+    size_t getEvictions() const;
+
+    // logs bytes resident per texture, most recently used first
+    void report() const;
+
+private:
+    struct Entry {
+        AsyncTextureHandle texture;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::string makeKey(const std::string& path, bool flipVertically);
+
+    TextureLoader& loader;
+    size_t budget;
+
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru; // front = most recently requested
+
+    size_t hits = 0;
+    size_t evictions = 0;
+};
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+#include "AssetPack.hpp"
+#include "MipChain.hpp"
+
+// A GL texture object plus what it costs. Shared by every AsyncTexture whose decoded
+// pixels were identical, and deleted with the last of them.
+struct TextureStorage {
+    GLuint id = 0;
+    int width = 0;
+    int height = 0;
+    size_t bytes = 0;           // all mip levels
+    int levels = 1;             // mip levels uploaded, level 0 included
+    int channels = 0;           // of the source image; single-channel ones are stored as GL_RED
+    uint64_t contentHash = 0;
+    bool compressed = false;    // block-compressed from the pack; can't be a framebuffer attachment
+
+    ~TextureStorage();
+};
+
+// A texture that may still be loading. Until the upload has happened getID() returns the
+// loader's placeholder, so callers can bind it unconditionally. Render thread only; the loader
+// always hands its references back to the render thread, so the GL texture is deleted there.
+class AsyncTexture {
+public:
+    GLuint getID() const { return storage ? storage->id : placeholder; }
+    bool isResident() const { return storage != nullptr; }
+    bool hasFailed() const { return failed; }
+
+    int getWidth() const { return storage ? storage->width : 0; }
+    int getHeight() const { return storage ? storage->height : 0; }
+    size_t getBytes() const { return storage ? storage->bytes : 0; }
+    int getLevels() const { return storage ? storage->levels : 0; }
+    int getChannels() const { return storage ? storage->channels : 0; }
+    bool isCompressed() const { return storage && storage->compressed; }
+    const TextureStorage* getStorage() const { return storage.get(); }
+    const std::string& getPath() const { return path; }
+
+private:
+    friend class TextureLoader;
+
+    std::string path;
+    std::shared_ptr<TextureStorage> storage;
+    GLuint placeholder = 0;
+    bool failed = false;
+};
+
+using AsyncTextureHandle = std::shared_ptr<AsyncTexture>;
+
+// Recycles mip-chain buffers between loads so steady streaming does not hit the allocator.
+// Keeps at most `capacity` bytes of idle buffers. Thread safe.
+class StagingPool {
+public:
+    explicit StagingPool(size_t capacity);
+
+    std::vector<unsigned char> acquire(size_t size);
+    void release(std::vector<unsigned char>&& buffer);
+
+private:
+    std::mutex mutex;
+    std::vector<std::vector<unsigned char>> free;
+    size_t freeBytes = 0;
+    size_t capacity;
+};
+
+// Decodes images on worker threads and uploads them from the render thread.
+//
+//   load()            any thread; returns a handle immediately
+//   worker threads    read + stb_image decode, build the mip chain below the decoded image
+//                     into pooled staging memory (box filter, colour in linear light), then
+//                     push to a bounded upload queue (blocking while it is full)
+//   processUploads()  render thread, once per frame; uploads levels until the byte budget
+//                     is spent, so the driver never generates mips mid-frame
+//
+// Decoded images are hashed on the worker; an upload whose pixels match a texture that is
+// already resident reuses that GL texture instead of creating a second copy.
+//
+// With an asset pack set, images cooked into it skip the workers entirely: load() queues the
+// mapped mip chain and processUploads() hands those pages straight to GL, block-compressed
+// ones through glCompressedTexImage2D. Images cooked in a format the context can't sample
+// are decoded from the loose file instead.
+class TextureLoader {
+public:
+    // needs a current GL context (creates the placeholder texture)
+    explicit TextureLoader(unsigned workerCount = 0, size_t uploadQueueCapacity = 16);
+    ~TextureLoader();
+
+    AsyncTextureHandle load(const std::string& path, bool flipVertically = false);
+
+    // must outlive the loader; nullptr decodes everything from the loose files
+    void setPack(const AssetPack* pack);
+
+    // uploads queued images until about byteBudget bytes have been sent (always at least one);
+    // returns the bytes sent
+    size_t processUploads(size_t byteBudget);
+
+    // forgets the content hashes of textures that have since been deleted
+    void pruneContentIndex();
+
+    // loads not yet resident (queued, decoding or waiting for upload)
+    size_t getPending() const;
+    size_t getUploadedBytes() const;
+    // uploads skipped because identical pixels were already resident
+    size_t getDedupedUploads() const;
+    // loads served from the asset pack instead of decoded
+    size_t getPackedLoads() const;
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+private:
+    struct Request {
+        AsyncTextureHandle texture;
+        std::string path;
+        bool flip;
+    };
+
+    // frees stb_image's buffers
+    struct DecodedDeleter {
+        void operator()(unsigned char* data) const;
+    };
+
+    struct Upload {
+        AsyncTextureHandle texture;
+        std::unique_ptr<unsigned char, DecodedDeleter> decoded;    // level 0, as stb_image returned it
+        std::vector<unsigned char> pixels;     // levels 1.., laid out as in `levels` less level 0
+        std::vector<MipLevel> levels;
+        const PackTexture* packed = nullptr;   // pixels live in the mapped pack instead
+        size_t bytes = 0;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        uint64_t contentHash = 0;
+    };
+
+    void workerMain();
+    void upload(Upload& item);
+    void uploadPacked(AsyncTexture& texture, const PackTexture& packed);
+
+    GLuint placeholder = 0;
+
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    std::mutex requestMutex;
+    std::condition_variable requestReady;
+    std::deque<Request> requests;
+
+    mutable std::mutex uploadMutex;
+    std::condition_variable uploadSpace;
+    std::deque<Upload> uploads;
+    size_t uploadQueueCapacity;
+
+    StagingPool staging;
+
+    std::atomic<size_t> pending{0};
+    size_t uploadedBytes = 0;  // render thread only
+    size_t dedupedUploads = 0; // render thread only
+    const AssetPack* pack = nullptr;
+    std::atomic<size_t> packedLoads{0};
+
+    // decoded-content hash -> resident storage (render thread only)
+    std::unordered_map<uint64_t, std::weak_ptr<TextureStorage>> contentIndex;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+
+// What an image holds, judged from its file name. The cooker picks block formats by it and
+// both the cooker and the loader filter mips of colour images in linear light.
+enum TextureUsage {
+    TEXTURE_USAGE_COLOR,        // albedo: sRGB-encoded
+    TEXTURE_USAGE_MASK,         // one meaningful channel (*_specular, *_mask, greyscale)
+    TEXTURE_USAGE_NORMAL,       // *_normal
+};
+
+inline TextureUsage classifyTexture(const std::string& path, int channels) {
+    size_t slash = path.find_last_of("/\\");
+    std::string stem = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    stem = stem.substr(0, stem.find_last_of('.'));
+    std::transform(stem.begin(), stem.end(), stem.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    auto endsWith = [&stem](const char* suffix) {
+        size_t length = strlen(suffix);
+        return stem.size() >= length && stem.compare(stem.size() - length, length, suffix) == 0;
+    };
+    if (endsWith("_normal") || endsWith("_nrm")) {
+        return TEXTURE_USAGE_NORMAL;
+    }
+    if (channels == 1 || endsWith("_specular") || endsWith("_spec") || endsWith("_mask") || endsWith("_roughness")) {
+        return TEXTURE_USAGE_MASK;
+    }
+    return TEXTURE_USAGE_COLOR;
+}
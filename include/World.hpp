@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Entity.hpp"
+
+// Archetype ECS.
+//
+// Every distinct set of component types is an archetype. An archetype stores its entities in
+// fixed-size chunks, each laid out as one contiguous array per component (SoA) plus the entity
+// handles, so a system touches only the arrays it asks for, front to back. Rows are kept
+// dense: destroying an entity or moving it to another archetype fills its slot with the
+// archetype's last row (swap-and-pop), so every chunk but the last is full.
+//
+// Queries are cached per component set and remember how many archetypes they have examined,
+// so a query only looks at archetypes created since it last ran.
+//
+// Not thread-safe. Structural changes (create, destroy, add, remove) must not happen while
+// iterating; collect the entities and apply the changes afterwards.
+
+using ComponentMask = uint64_t;
+const uint32_t MAX_COMPONENT_TYPES = 64;
+const size_t CHUNK_BYTES = 16 * 1024;
+const size_t CHUNK_ARRAY_ALIGNMENT = 32;   // component arrays are AVX-aligned
+
+struct ComponentInfo {
+    size_t size;
+    size_t alignment;
+    void (*moveConstruct)(void* destination, void* source);
+    void (*destroy)(void* component);
+};
+
+// process-wide; ids are dense and stable for the life of the program
+uint32_t registerComponent(const ComponentInfo& info);
+const ComponentInfo& getComponentInfo(uint32_t id);
+
+template <typename C>
+uint32_t componentId() {
+    static_assert(std::is_move_constructible<C>::value, "components must be move constructible");
+    static const uint32_t id = registerComponent({
+        sizeof(C), alignof(C),
+        [](void* destination, void* source) { new (destination) C(std::move(*static_cast<C*>(source))); },
+        [](void* component) { static_cast<C*>(component)->~C(); },
+    });
+    return id;
+}
+
+template <typename... C>
+ComponentMask componentMask() {
+    return (ComponentMask(0) | ... | (ComponentMask(1) << componentId<C>()));
+}
+
+struct alignas(64) Chunk {
+    unsigned char data[CHUNK_BYTES];
+};
+
+class Archetype {
+public:
+    explicit Archetype(ComponentMask mask);
+    ~Archetype();
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    ComponentMask getMask() const { return mask; }
+    size_t size() const { return count; }
+    size_t getChunkCount() const { return chunks.size(); }
+    uint32_t getChunkCapacity() const { return capacity; }
+    size_t getChunkSize(size_t chunk) const;
+
+    Entity* entities(size_t chunk) { return reinterpret_cast<Entity*>(chunks[chunk]->data); }
+
+    // start of component `id`'s array in `chunk`; the archetype must contain it
+    void* array(size_t chunk, uint32_t id) { return chunks[chunk]->data + offsets[columns[id]]; }
+    template <typename C>
+    C* array(size_t chunk) { return static_cast<C*>(array(chunk, componentId<C>())); }
+
+    void* component(uint32_t row, uint32_t id);
+    template <typename C>
+    C* component(uint32_t row) { return static_cast<C*>(component(row, componentId<C>())); }
+
+private:
+    friend class World;
+
+    // adds a row with uninitialised components; returns its index
+    uint32_t appendRow(Entity entity);
+    // fills `row` with the last row (swap-and-pop). `destroyRow` is false when the row's
+    // components were already moved out. Returns the entity that now occupies `row`, or a
+    // null entity when `row` was the last one.
+    Entity removeRow(uint32_t row, bool destroyRow);
+
+    ComponentMask mask;
+    std::vector<uint32_t> types;                // component ids, ascending
+    std::vector<size_t> offsets;                // per entry in `types`: array offset in a chunk
+    uint8_t columns[MAX_COMPONENT_TYPES];       // component id -> index into types/offsets
+    uint32_t capacity = 0;                      // rows per chunk
+    size_t count = 0;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+};
+
+// Matching archetypes for one component set, maintained by World
+struct Query {
+    ComponentMask mask = 0;
+    std::vector<Archetype*> archetypes;
+    size_t examined = 0;                        // World::archetypeList entries already checked
+};
+
+class World {
+public:
+    World();
+    ~World();
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    Entity create();
+    template <typename... C>
+    Entity create(C&&... components);
+    void destroy(Entity entity);
+    bool isAlive(Entity entity) const;
+    // destroys every entity; outstanding handles become stale
+    void clear();
+
+    // Adds (or replaces) a component, moving the entity to the matching archetype. A dead or
+    // stale handle changes nothing: add returns nullptr, remove does nothing.
+    template <typename C>
+    C* add(Entity entity, C component);
+    template <typename C>
+    void remove(Entity entity);
+
+    // nullptr if the entity is dead or lacks the component
+    template <typename C>
+    C* get(Entity entity);
+    template <typename C>
+    bool has(Entity entity) const;
+
+    // f(Entity, C&...) for every entity that has all of C
+    template <typename... C, typename F>
+    void each(F&& f);
+
+    // f(count, const Entity*, C*...) once per chunk, for batch/SIMD systems
+    template <typename... C, typename F>
+    void eachChunk(F&& f);
+
+    // Matching archetypes for C..., brought up to date. The first call for a component set
+    // adds it to the query table; later calls only read the table and update that one query.
+    // So two threads may each iterate their own component sets at once if every set was
+    // queried once beforehand and structural changes are kept from overlapping either.
+    template <typename... C>
+    Query& query();
+
+    size_t size() const { return alive; }
+    size_t getArchetypeCount() const { return archetypeList.size(); }
+
+private:
+    struct Record {
+        Archetype* archetype = nullptr;
+        uint32_t row = 0;
+        uint32_t generation = 1;
+    };
+
+    Entity allocate();
+    Archetype& getArchetype(ComponentMask mask);
+    Query& getQuery(ComponentMask mask);
+    const Record* find(Entity entity) const;
+    // moves the entity's row into the archetype for `mask`, leaving new components unconstructed
+    void migrate(Entity entity, ComponentMask mask);
+    void removeRow(Archetype& archetype, uint32_t row, bool destroyRow);
+
+    std::vector<Record> records;                // indexed by Entity::index
+    std::vector<uint32_t> freeIndices;
+    size_t alive = 0;
+
+    std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> archetypes;
+    std::vector<Archetype*> archetypeList;      // creation order, for incremental query updates
+    std::unordered_map<ComponentMask, Query> queries;
+};
+
+template <typename... C>
+Entity World::create(C&&... components) {
+    Entity entity = allocate();
+    Archetype& archetype = getArchetype(componentMask<std::decay_t<C>...>());
+    uint32_t row = archetype.appendRow(entity);
+    (new (archetype.component(row, componentId<std::decay_t<C>>())) std::decay_t<C>(std::forward<C>(components)), ...);
+    records[entity.index].archetype = &archetype;
+    records[entity.index].row = row;
+    return entity;
+}
+
+template <typename C>
+C* World::add(Entity entity, C component) {
+    const Record* found = find(entity);
+    if (!found) {
+        return nullptr;
+    }
+    if (found->archetype->getMask() & componentMask<C>()) {
+        C* existing = found->archetype->template component<C>(found->row);
+        *existing = std::move(component);
+        return existing;
+    }
+    Record& record = records[entity.index];
+    migrate(entity, record.archetype->getMask() | componentMask<C>());
+    return new (record.archetype->component(record.row, componentId<C>())) C(std::move(component));
+}
+
+template <typename C>
+void World::remove(Entity entity) {
+    const Record* found = find(entity);
+    if (!found || !(found->archetype->getMask() & componentMask<C>())) {
+        return;
+    }
+    Record& record = records[entity.index];
+    record.archetype->template component<C>(record.row)->~C();
+    migrate(entity, record.archetype->getMask() & ~componentMask<C>());
+}
+
+template <typename C>
+C* World::get(Entity entity) {
+    const Record* record = find(entity);
+    if (!record || !(record->archetype->getMask() & componentMask<C>())) {
+        return nullptr;
+    }
+    return record->archetype->template component<C>(record->row);
+}
+
+template <typename C>
+bool World::has(Entity entity) const {
+    const Record* record = find(entity);
+    return record && (record->archetype->getMask() & componentMask<C>()) != 0;
+}
+
+template <typename... C>
+Query& World::query() {
+    return getQuery(componentMask<C...>());
+}
+
+template <typename... C, typename F>
+void World::eachChunk(F&& f) {
+    Query& matches = query<C...>();
+    for (Archetype* archetype : matches.archetypes) {
+        for (size_t chunk = 0; chunk < archetype->getChunkCount(); ++chunk) {
+            f(archetype->getChunkSize(chunk), archetype->entities(chunk), archetype->template array<C>(chunk)...);
+        }
+    }
+}
+
+template <typename... C, typename F>
+void World::each(F&& f) {
+    eachChunk<C...>([&f](size_t count, const Entity* entities, C*... arrays) {
+        for (size_t i = 0; i < count; ++i) {
+            f(entities[i], arrays[i]...);
+        }
+    });
+}
@@ -0,0 +1,19 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+const uint64_t FNV1A64_SEED = 14695981039346656037ull;
+
+// 64-bit FNV-1a over `size` bytes, continued from `seed` so several ranges hash as one
+inline uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = FNV1A64_SEED) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif
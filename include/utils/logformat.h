@@ -0,0 +1,217 @@
+#ifndef LOGFORMAT_H
+#define LOGFORMAT_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include "utils/logger.h"
+
+// Turning captured records back into text. Used by the logger's writer thread and by the
+// offline decoder (tools/logdecode), so both produce byte-identical lines.
+namespace logging {
+
+// Binary log stream (LOG_BINARY): a header, then tagged entries in write order.
+//   'F' format definition, once per call site before its first record:
+//       varint id, u8 tag, varint line, varint length + file, varint length + format
+//   'R' record: varint id, zigzag varint ns since the previous record, varint length + args
+//   'D' dropped: varint count of records lost to full rings
+const uint32_t BINARY_LOG_MAGIC = 0x474f4c45; // "ELOG"
+const uint32_t BINARY_LOG_VERSION = 1;
+
+struct BinaryLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t startWallNanoseconds;   // unix time of startSteadyNanoseconds
+    uint64_t startSteadyNanoseconds;
+};
+
+struct ArgReader {
+    const uint8_t* data;
+    size_t size;
+    size_t offset = 0;
+
+    bool byte(uint8_t& value) {
+        if (offset >= size) {
+            return false;
+        }
+        value = data[offset++];
+        return true;
+    }
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t b;
+            if (!byte(b)) {
+                return false;
+            }
+            value |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool raw(void* out, size_t count) {
+        if (size - offset < count) {
+            return false;
+        }
+        memcpy(out, data + offset, count);
+        offset += count;
+        return true;
+    }
+};
+
+struct Arg {
+    uint8_t type = 0;
+    uint64_t bits = 0;      // int (already un-zigzagged), uint or pointer
+    double real = 0.0;
+    std::string text;
+};
+
+inline bool readArg(ArgReader& in, Arg& arg) {
+    if (!in.byte(arg.type)) {
+        return false;
+    }
+    switch (arg.type) {
+    case ARG_INT: {
+        uint64_t zigzag;
+        if (!in.varint(zigzag)) {
+            return false;
+        }
+        arg.bits = (zigzag >> 1) ^ (0 - (zigzag & 1));
+        return true;
+    }
+    case ARG_UINT:
+    case ARG_POINTER:
+        return in.varint(arg.bits);
+    case ARG_DOUBLE:
+        return in.raw(&arg.real, sizeof(arg.real));
+    case ARG_STRING: {
+        uint64_t length;
+        if (!in.varint(length) || in.size - in.offset < length) {
+            return false;
+        }
+        arg.text.assign(reinterpret_cast<const char*>(in.data + in.offset), (size_t)length);
+        in.offset += (size_t)length;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// printf over captured arguments. Each conversion is handed to snprintf on its own with the
+// length modifier rewritten for the widened captured type; missing or truncated arguments
+// print as "<?>".
+inline void formatMessage(const char* format, const uint8_t* args, size_t argBytes, std::string& out) {
+    ArgReader in{ args, argBytes };
+    char spec[32];
+    char buffer[512];
+
+    for (const char* p = format; *p;) {
+        if (*p != '%') {
+            const char* next = strchr(p, '%');
+            size_t count = next ? (size_t)(next - p) : strlen(p);
+            out.append(p, count);
+            p += count;
+            continue;
+        }
+        if (p[1] == '%') {
+            out += '%';
+            p += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion; * widths are not supported
+        const char* start = p++;
+        while (*p && strchr("-+ #0", *p)) ++p;
+        while (*p >= '0' && *p <= '9') ++p;
+        if (*p == '.') {
+            ++p;
+            while (*p >= '0' && *p <= '9') ++p;
+        }
+        size_t prefix = (size_t)(p - start);
+        while (*p && strchr("hljztL", *p)) ++p;
+        char conversion = *p ? *p++ : 's';
+        if (prefix > sizeof(spec) - 4) {
+            prefix = sizeof(spec) - 4;
+        }
+        memcpy(spec, start, prefix);
+
+        Arg arg;
+        if (!readArg(in, arg)) {
+            out += "<?>";
+            continue;
+        }
+        int n = 0;
+        switch (conversion) {
+        case 'd': case 'i':
+            memcpy(spec + prefix, "lld", 4);
+            n = snprintf(buffer, sizeof(buffer), spec,
+                arg.type == ARG_DOUBLE ? (long long)arg.real : (long long)arg.bits);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            spec[prefix] = 'l';
+            spec[prefix + 1] = 'l';
+            spec[prefix + 2] = conversion;
+            spec[prefix + 3] = '\0';
+            n = snprintf(buffer, sizeof(buffer), spec,
+                arg.type == ARG_DOUBLE ? (unsigned long long)arg.real : (unsigned long long)arg.bits);
+            break;
+        case 'c':
+            memcpy(spec + prefix, "c", 2);
+            n = snprintf(buffer, sizeof(buffer), spec, (int)arg.bits);
+            break;
+        case 's':
+            memcpy(spec + prefix, "s", 2);
+            n = snprintf(buffer, sizeof(buffer), spec, arg.type == ARG_STRING ? arg.text.c_str() : "<?>");
+            break;
+        case 'p':
+            memcpy(spec + prefix, "p", 2);
+            n = snprintf(buffer, sizeof(buffer), spec, (void*)(uintptr_t)arg.bits);
+            break;
+        default: // floating point conversions
+            spec[prefix] = conversion;
+            spec[prefix + 1] = '\0';
+            n = snprintf(buffer, sizeof(buffer), spec,
+                arg.type == ARG_DOUBLE ? arg.real : arg.type == ARG_INT ? (double)(int64_t)arg.bits : (double)arg.bits);
+            break;
+        }
+        if (n > 0) {
+            out.append(buffer, std::min<size_t>((size_t)n, sizeof(buffer) - 1));
+        }
+    }
+}
+
+// TIME_FORMAT text for a unix time in nanoseconds
+inline void formatTime(int64_t unixNanoseconds, char* out, size_t size) {
+    time_t seconds = (time_t)(unixNanoseconds / 1000000000);
+    struct tm info;
+    localtime_r(&seconds, &info);
+    strftime(out, size, TIME_FORMAT, &info);
+}
+
+// one log line: "<time> [<LEVEL>]: <file>:<line> <message>\n"
+inline void formatLine(const char* timeText, unsigned tag, const char* file, unsigned line, const std::string& message, std::string& out) {
+    char prefix[512];
+    int n = snprintf(prefix, sizeof(prefix), "%s [%s]: %s:%u ", timeText, logLevelName(tag), file, line);
+    out.append(prefix, std::min<size_t>(n > 0 ? (size_t)n : 0, sizeof(prefix) - 1));
+    out += message;
+    out += '\n';
+}
+
+// The line for records lost to full rings. They have no call site of their own, so the writer
+// thread and the decoder both attribute them to this one.
+const char* const DROPPED_LOG_FILE = "logger";
+const unsigned DROPPED_LOG_LINE = 0;
+
+inline void formatDroppedLine(const char* timeText, uint64_t dropped, std::string& out) {
+    formatLine(timeText, 2, DROPPED_LOG_FILE, DROPPED_LOG_LINE,
+        "logger dropped " + std::to_string(dropped) + " messages (ring full)", out);
+}
+
+} // namespace logging
+
+#endif
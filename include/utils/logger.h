@@ -1,49 +1,19 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-// #define INFO 0
-// #define DEBUG 1
-// #define WARNING 2
-// #define ERROR 3
-// #define FATAL 4
-
-#define DISABLE_HANDLER(tag) \
-({ \
-    int out = 0; \
-    if (tag == 0) { out = 1; } \
-    if (tag == 1) { out = 1; } \
-    if (tag == 2) { out = 1; } \
-    if (tag == 3) { out = 1; } \
-    if (tag == 4) { out = 1; } \
-    out; \
-})
-
-#define CONVERT_INT_TO_NAME(name_int) \
-({ \
-    char* name; \
-    if (name_int == 0) { name = "INFO"; } \
-    else if (name_int == 1) { name = "DEBUG"; } \
-    else if (name_int == 2) { name = "WARNING"; } \
-    else if (name_int == 3) { name = "ERROR"; } \
-    else if (name_int == 4) { name = "FATAL"; } \
-    name; \
-})
-
-// #define LOGG(TYPE, FORMAT, ...) printf(FORMAT, CONVERTTONAME(TYPE), __VA_ARGS__)
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
 
+// Levels. Each expands to "tag, __FILE__, __LINE__" so LOG(INFO, ...) carries its call site.
 #define INFO 0, __FILE__, __LINE__
 #define DEBUG 1, __FILE__, __LINE__
 #define WARNING 2, __FILE__, __LINE__
 #define ERROR 3, __FILE__, __LINE__
 #define FATAL 4, __FILE__, __LINE__
 
-#define DISABLE_INFO 0
-#define DISABLE_DEBUG 0
-#define DISABLE_WARNING 0
-#define DISABLE_ERROR 0
-#define DISABLE_FATAL 0
-
 #define FILENAME "sample.log"
+#define BINARY_FILENAME "sample.blog"
 #define TIME_FORMAT "%Y-%m-%d %H:%M:%S"
 
 #define Q(x) #x
@@ -54,36 +24,203 @@
     #define FILENAME QUOTE(LOG_FILENAME)
 #endif
 
+#ifdef LOG_BINARY_FILENAME
+    #undef BINARY_FILENAME
+    #define BINARY_FILENAME QUOTE(LOG_BINARY_FILENAME)
+#endif
+
 #ifdef LOG_TIME_FORMAT
     #undef TIME_FORMAT
     #define TIME_FORMAT QUOTE(LOG_TIME_FORMAT)
 #endif
 
+// Build-time filtering. Statements for a level that is filtered out compile to nothing and
+// their arguments are never evaluated:
+//   LOG_MIN_SEVERITY    drop everything less severe (DEBUG 0, INFO 1, WARNING 2, ERROR 3, FATAL 4)
+//   LOG_DISABLE_<LEVEL> drop one level
+//   LOG_BINARY          write BINARY_FILENAME in the compact binary format (decode with
+//                       logdecode) instead of text to stdout and FILENAME
+#ifndef LOG_MIN_SEVERITY
+    #define LOG_MIN_SEVERITY 0
+#endif
+
 #ifdef LOG_DISABLE_INFO
-    #undef DISABLE_INFO
-    #define DISABLE_INFO 1, __FILE__, __LINE__
+    #define DISABLE_INFO 1
+#else
+    #define DISABLE_INFO 0
 #endif
 
 #ifdef LOG_DISABLE_DEBUG
-    #undef DISABLE_DEBUG
-    #define DISABLE_DEBUG 1, __FILE__, __LINE__
+    #define DISABLE_DEBUG 1
+#else
+    #define DISABLE_DEBUG 0
 #endif
 
 #ifdef LOG_DISABLE_WARNING
-    #undef LOSABLE_WARNING
-    #define SABLE_WARNING 1, __FILE__, __LINE__
+    #define DISABLE_WARNING 1
+#else
+    #define DISABLE_WARNING 0
 #endif
 
 #ifdef LOG_DISABLE_ERROR
-    #undef DISABLE_ERROR
-    #define DISABLE_ERROR 1, __FILE__, __LINE__
+    #define DISABLE_ERROR 1
+#else
+    #define DISABLE_ERROR 0
 #endif
 
 #ifdef LOG_DISABLE_FATAL
-    #undef DISABLE_FATAL
-    #define DISABLE_FATAL 1, __FILE__, __LINE__
+    #define DISABLE_FATAL 1
+#else
+    #define DISABLE_FATAL 0
 #endif
 
-void LOG(unsigned tag, const char* file, unsigned line, const char* message);
+constexpr const char* logLevelName(unsigned tag) {
+    return tag == 0 ? "INFO" : tag == 1 ? "DEBUG" : tag == 2 ? "WARNING" : tag == 3 ? "ERROR" : "FATAL";
+}
+
+// tags predate severity ordering (INFO is 0, DEBUG 1)
+constexpr int logSeverity(unsigned tag) {
+    return tag == 1 ? 0 : tag == 0 ? 1 : (int)tag;
+}
+
+constexpr bool logEnabled(unsigned tag) {
+    return logSeverity(tag) >= LOG_MIN_SEVERITY
+        && !(tag == 0 && DISABLE_INFO) && !(tag == 1 && DISABLE_DEBUG) && !(tag == 2 && DISABLE_WARNING)
+        && !(tag == 3 && DISABLE_ERROR) && !(tag == 4 && DISABLE_FATAL);
+}
+
+// Backend (src/utils/logger.cpp). Producers never lock or do I/O: a record holding the call
+// site's format id and the raw arguments goes into the calling thread's ring, and a background
+// thread formats (or binary-encodes) and writes it.
+namespace logging {
+
+enum ArgType : uint8_t {
+    ARG_INT = 1,
+    ARG_UINT = 2,
+    ARG_DOUBLE = 3,
+    ARG_STRING = 4,
+    ARG_POINTER = 5,
+};
+
+// Argument encoding shared by the ring records and the binary file: a type byte, then a
+// zigzag/LEB128 varint, 8 raw bytes for doubles, or a varint length and the bytes of a string.
+struct ArgWriter {
+    uint8_t* data;
+    size_t capacity;
+    size_t size = 0;
+
+    void byte(uint8_t value) {
+        if (size < capacity) {
+            data[size] = value;
+        }
+        ++size;
+    }
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            byte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        byte((uint8_t)value);
+    }
+    void raw(const void* bytes, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            byte(static_cast<const uint8_t*>(bytes)[i]);
+        }
+    }
+    bool overflowed() const { return size > capacity; }
+};
+
+// Strings are cut to what is left of the record after the type byte and length prefix, so a
+// long one still decodes (arguments after it are lost instead).
+inline void put(ArgWriter& out, const char* value) {
+    const char* text = value ? value : "(null)";
+    out.byte(ARG_STRING);
+    const size_t room = out.capacity > out.size ? out.capacity - out.size : 0;
+    // a one-byte prefix up to 127 bytes, two beyond
+    const size_t limit = room > 129 ? room - 2 : room > 0 ? (room - 1 < 127 ? room - 1 : 127) : 0;
+    size_t length = 0;
+    while (text[length] && length < limit) {
+        ++length;
+    }
+    out.varint(length);
+    out.raw(text, length);
+}
+inline void put(ArgWriter& out, char* value) { put(out, (const char*)value); }
+
+template <typename T>
+inline void put(ArgWriter& out, T value) {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+        "log arguments must be numbers, enums, pointers or C strings (use .c_str())");
+    if constexpr (std::is_floating_point<T>::value) {
+        double v = (double)value;
+        out.byte(ARG_DOUBLE);
+        out.raw(&v, sizeof(v));
+    } else if constexpr (std::is_pointer<T>::value) {
+        out.byte(ARG_POINTER);
+        out.varint((uint64_t)(uintptr_t)value);
+    } else if constexpr (std::is_enum<T>::value) {
+        put(out, (typename std::underlying_type<T>::type)value);
+    } else if constexpr (std::is_signed<T>::value) {
+        int64_t v = (int64_t)value;
+        out.byte(ARG_INT);
+        out.varint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+    } else {
+        out.byte(ARG_UINT);
+        out.varint((uint64_t)value);
+    }
+}
+
+// once per call site: returns the id the call site's records refer to
+uint32_t registerFormat(unsigned tag, const char* file, unsigned line, const char* format);
+
+// space for encoded arguments in the calling thread's next record, or nullptr (ring full)
+uint8_t* reserve(size_t& capacity);
+void commit(uint32_t formatId, unsigned tag, size_t argBytes);
+
+// the format itself was registered with the call site and is not stored per record
+template <typename... Args>
+inline void write(uint32_t formatId, unsigned tag, const char* /*format*/, const Args&... args) {
+    size_t capacity = 0;
+    uint8_t* data = reserve(capacity);
+    if (!data) {
+        return;
+    }
+    ArgWriter out{ data, capacity };
+    (put(out, args), ...);
+    commit(formatId, tag, out.overflowed() ? capacity : out.size);
+}
+
+// compile-time printf checking of LOGF formats; never called
+inline void checkFormat(const char*, ...) __attribute__((format(printf, 1, 2)));
+inline void checkFormat(const char*, ...) {}
+
+} // namespace logging
+
+#define LOG_FIRST_(first, ...) first
+#define LOG_FIRST(...) LOG_FIRST_(__VA_ARGS__, 0)
+
+#define LOG_EMIT(tag, file, line, ...)                                                              \
+    do {                                                                                            \
+        if constexpr (logEnabled(tag)) {                                                            \
+            if (false) {                                                                            \
+                logging::checkFormat(__VA_ARGS__);                                                  \
+            }                                                                                       \
+            static const uint32_t logFormatId = logging::registerFormat(tag, file, line, LOG_FIRST(__VA_ARGS__)); \
+            logging::write(logFormatId, tag, __VA_ARGS__);                                          \
+        }                                                                                           \
+    } while (0)
+
+#define LOG_EMIT_MESSAGE(tag, file, line, message) LOG_EMIT(tag, file, line, "%s", message)
+
+// LOG(INFO, "text")                  message is copied, up to 237 bytes (a record's 240
+//                                    LOG_ARG_BYTES less the string's type and length bytes);
+//                                    LOGF strings share that with the other arguments
+// LOGF(INFO, "x = %d", x)            format must be a string literal; arguments are captured
+//                                    raw and formatted on the writer thread
+#define LOG(...) LOG_EMIT_MESSAGE(__VA_ARGS__)
+#define LOGF(...) LOG_EMIT(__VA_ARGS__)
+
+// blocks until everything logged so far has been written
+void LOG_FLUSH();
 
-#endif
\ No newline at end of file
+#endif
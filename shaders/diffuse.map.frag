@@ -1,44 +1,73 @@
 #version 330 core
 out vec4 FragColor;
 
+in vec3 FragPos;  
+in vec3 Normal;  
+in vec2 TexCoords;
+
+#ifdef INSTANCED
+// every material's maps are layers of one array; the table says which (see MaterialTable.hpp)
+struct MaterialEntry {
+    uint diffuseLayer;
+    uint specularLayer;
+    float shininess;
+    float padding;
+};
+
+layout (std140) uniform Materials {
+    MaterialEntry materials[256];   // MAX_MATERIALS
+};
+
+uniform sampler2DArray materialMaps;
+flat in uint MaterialId;
+#else
 struct Material {
     sampler2D diffuse;
     sampler2D specular;    
     float shininess;
 }; 
-
-struct Light {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-in vec3 FragPos;  
-in vec3 Normal;  
-in vec2 TexCoords;
   
-uniform vec3 viewPos;
 uniform Material material;
-uniform Light light;
+#endif
+
+// per-frame camera/light state, written once per frame (see FrameConstants.hpp)
+layout (std140) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    MaterialEntry entry = materials[MaterialId];
+    vec3 diffuseColor = texture(materialMaps, vec3(TexCoords, float(entry.diffuseLayer))).rgb;
+    vec3 specularColor = texture(materialMaps, vec3(TexCoords, float(entry.specularLayer))).rgb;
+    float shininess = entry.shininess;
+#else
+    vec3 diffuseColor = texture(material.diffuse, TexCoords).rgb;
+    vec3 specularColor = texture(material.specular, TexCoords).rgb;
+    float shininess = material.shininess;
+#endif
+
     // ambient
-    vec3 ambient = light.ambient * texture(material.diffuse, TexCoords).rgb;
+    vec3 ambient = lightAmbient.rgb * diffuseColor;
   	
     // diffuse 
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(light.position - FragPos);
+    vec3 lightDir = normalize(lightPosition.xyz - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = light.diffuse * diff * texture(material.diffuse, TexCoords).rgb;  
+    vec3 diffuse = lightDiffuse.rgb * diff * diffuseColor;  
     
     // specular
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPos.xyz - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);  
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * texture(material.specular, TexCoords).rgb;  
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = lightSpecular.rgb * spec * specularColor;  
         
     vec3 result = ambient + diffuse + specular;
     FragColor = vec4(result, 1.0);
@@ -3,19 +3,46 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+#ifdef INSTANCED
+// per-instance attributes (divisor 1)
+layout (location = 3) in mat4 aModel;        // locations 3-6
+layout (location = 7) in mat3 aNormalMatrix; // locations 7-9
+layout (location = 10) in uint aMaterial;    // entry in the Materials block
+#endif
+
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+#ifdef INSTANCED
+flat out uint MaterialId;
+#endif
 
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+// per-frame camera/light state, written once per frame (see FrameConstants.hpp)
+layout (std140) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    Normal = aNormalMatrix * aNormal;
+    MaterialId = aMaterial;
+#else
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;  
+#endif
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
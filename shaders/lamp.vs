@@ -1,11 +1,29 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#ifdef INSTANCED
+// per-instance (or per-draw, with a base instance) model matrix, divisor 1
+layout (location = 3) in mat4 aModel;        // locations 3-6
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+
+// per-frame camera/light state, written once per frame (see FrameConstants.hpp)
+layout (std140) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPos;
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+#else
     gl_Position = projection * view * model * vec4(aPos, 1.0);
+#endif
 }
\ No newline at end of file
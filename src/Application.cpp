@@ -7,12 +7,16 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstdio>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
 
 // GLM for transforms
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <stb_image/stb_image.h>
 #include "Shader.hpp"
 #include "Texture.hpp"
 #include "Camera.hpp"
@@ -34,43 +38,109 @@ glm::vec3 cubePositions[] = {
     glm::vec3(-1.3f,  1.0f, -1.5f)
 };
 
+#include "BuiltinMeshes.hpp"
+
+// uniform names used every frame; hashed at compile time
+// (camera and light state lives in the FrameConstants uniform block)
+static constexpr UniformName U_MODEL("model");
+static constexpr UniformName U_MATERIAL_SHININESS("material.shininess");
+
+// bounding sphere of the built-in cube meshes (corners at +-0.5)
+const float CUBE_BOUNDS_RADIUS = 0.8660254f;
+const glm::vec3 CUBE_HALF_EXTENT(0.5f);
+
+// instances per job when the instanced field's bounds and per-instance data are built
+const uint32_t INSTANCE_JOB_GRAIN = 4096;
+// scene entities per draw-preparation job
+const uint32_t DRAW_JOB_GRAIN = 256;
+
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// bytes of texture data uploaded per frame at most (one oversized image still goes through)
+const size_t TEXTURE_UPLOAD_BUDGET = 8u << 20;
+// texture memory the cache may keep resident before evicting unused textures
+const size_t TEXTURE_VRAM_BUDGET = 256u << 20;
+// per-frame stream space besides the instance data: frame constants and future dynamic data
+const size_t FRAME_STREAM_BASE_BYTES = 64u << 10;
+
+// cooked by the `cook` target into the build directory, from the repository root
+const char* const ASSET_PACK_PATH = "assets.pack";
+const char* const ASSET_PACK_SOURCE_ROOT = "..";
+
+// simulation: fixed steps of this many seconds, drawn interpolated one step behind; when it
+// falls further behind the clock than MAX_SIMULATION_LAG it drops the time instead of catching up
+const float SIMULATION_STEP = 1.0f / 60.0f;
+const double MAX_SIMULATION_LAG = 0.25;
 
 // lighting
 // glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 glm::vec3 lightPos(0.7f, 0.1f, 2.2f);
 
-// camera
+// camera, moved by the simulation thread; render() draws the snapshots' copies
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 float fov   =  45.0f;
+// mouse movement and scroll since the last processEvents(), from the GLFW callbacks
+glm::vec2 mouseLook(0.0f);
+float mouseScroll = 0.0f;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+
+// Copies a built-in mesh into the pool: from the mapped pack pages when it was cooked,
+// otherwise from the compiled-in copy
+static MeshRange loadMesh(MeshPool& pool, const AssetPack* pack, const char* name, VertexFormat format,
+                          const float* builtin, size_t builtinBytes) {
+    const uint32_t floats = MeshPool::getFloatsPerVertex(format);
+    const PackMesh* mesh = pack ? pack->findMesh(name) : nullptr;
+    if (mesh && mesh->floatsPerVertex == floats) {
+        const uint32_t* indices = mesh->indexCount ? reinterpret_cast<const uint32_t*>(pack->data(mesh->indexOffset)) : nullptr;
+        return pool.allocate(format, reinterpret_cast<const float*>(pack->data(mesh->vertexOffset)), mesh->vertexCount,
+            indices, mesh->indexCount);
+    }
+    return pool.allocate(format, builtin, (uint32_t)(builtinBytes / (floats * sizeof(float))));
+}
+
+// An entity's local bounding sphere in world space, as (center, radius); the radius grows with
+// the largest scale
+static glm::vec4 worldSphere(const glm::mat4& world, const Bounds& bounds) {
+    float scale2 = std::max({ glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+                              glm::dot(glm::vec3(world[1]), glm::vec3(world[1])),
+                              glm::dot(glm::vec3(world[2]), glm::vec3(world[2])) });
+    return glm::vec4(glm::vec3(world * glm::vec4(bounds.center, 1.0f)), bounds.radius * std::sqrt(scale2));
+}
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-unsigned int loadTexture(char const * path);
 
 Application::Application() {}
 
 Application::~Application() {
+    stopSimulation();
+
+    // release GL objects while the context still exists; run() leaves it alive so this is
+    // the one shutdown path
+    scene.clear();
+    transforms.clear();
+    instancedShader.reset();
+    renderQueue.setIndirect(false);
+    diffuseTexture.reset();
+    specularTexture.reset();
+    delete materials;
+    delete textureCache;
+    delete textureLoader;
+    delete assetPack;
+    delete frameConstants;
+    delete frameStream;
+    delete meshPool;
+
     if (m_window) {
         glfwDestroyWindow(m_window);
         m_window = nullptr;
     }
 
-    for (Shader* shader : shaders) {
-        delete shader;
-    }
-    shaders.clear();
-
     glfwTerminate();
 }
 
@@ -121,14 +191,37 @@ bool Application::init() {
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
-    // Diffuse map
-    diffuseMap = loadTexture("../assets/container2.png");
-    std::cout << "Diffuse map: " << diffuseMap << std::endl;
-    specularMap = loadTexture("../assets/container2_specular.png");
-    std::cout << "Specular map: " << specularMap << std::endl;
+    frameStream = new StreamBuffer(FRAME_STREAM_BASE_BYTES);
+    LOGF(INFO, "Frame stream buffer: %s", frameStream->isPersistent() ? "persistently mapped" : "mapped per allocation");
+    frameConstants = new FrameConstantsBuffer(*frameStream);
+    meshPool = new MeshPool(glState);
+    if (m_indirect) {
+        renderQueue.setIndirect(true);
+        LOGF(INFO, "Indirect submission: %s", RenderQueue::hasMultiDrawIndirect()
+            ? "glMultiDrawElementsIndirect" : "no multi-draw indirect, one draw per command");
+    }
+    shaderRegistry.setBinaryCache(&programCache);
 
-    for (int i = 0; i < 8; ++i) {
-        addItem();
+    // Diffuse map
+    // decoded on worker threads; a placeholder is bound until they are resident
+    assetPack = new AssetPack(ASSET_PACK_PATH, ASSET_PACK_SOURCE_ROOT);
+    textureLoader = new TextureLoader();
+    textureLoader->setPack(assetPack);
+    textureCache = new TextureCache(*textureLoader, TEXTURE_VRAM_BUDGET);
+    diffuseTexture = textureCache->get("../assets/container2.png");
+    specularTexture = textureCache->get("../assets/container2_specular.png");
+    materials = new MaterialTable(glState);
+    cubeMaterial = materials->create(diffuseTexture, specularTexture, 64.0f);
+
+    // one copy of the cube in the pool, shared by every item and the instanced field
+    cubeMesh = loadMesh(*meshPool, assetPack, CUBE_MESH_NAME, VERTEX_P3N3T2, cubeVertices, sizeof(cubeVertices));
+
+    if (m_instanced) {
+        setupInstancing();
+    } else {
+        for (int i = 0; i < 8; ++i) {
+            addItem();
+        }
     }
 
 
@@ -136,189 +229,241 @@ bool Application::init() {
     // ------------------------------------
     addLight();
 
-    // Optional: set swap interval (VSync)
-    glfwSwapInterval(1);
+    LOGF(INFO,
+        "Shader programs: %u created in %.1f ms (%u binary cache hits, %u compiled, %u rejected), %u shared lookups",
+        shaderRegistry.getCompiles(), shaderRegistry.getCreateMilliseconds(),
+        programCache.getHits(), shaderRegistry.getCompiles() - programCache.getHits(), programCache.getRejected(),
+        shaderRegistry.getHits());
 
-    LOG(INFO, (std::string("OpenGL Renderer: ") + reinterpret_cast<const char*>(glGetString(GL_RENDERER))).c_str());
-    LOG(INFO, (std::string("OpenGL Version: ") + reinterpret_cast<const char*>(glGetString(GL_VERSION))).c_str());
+    // Optional: set swap interval (VSync). Off while benchmarking so frame times are real.
+    glfwSwapInterval(m_benchmark ? 0 : 1);
+
+    LOGF(INFO, "OpenGL Renderer: %s", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    LOGF(INFO, "OpenGL Version: %s", reinterpret_cast<const char*>(glGetString(GL_VERSION)));
 
 
     return true;
 }
 
 void Application::addLight() {
-    lightCubeShader = new Shader("../shaders/lamp.vs", "../shaders/lamp.frag");
-
-    float vertices[] = {
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,
-        
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,
-        
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,
-        
-        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,
-        0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,
-        
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,
-        
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-        0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-        0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f
-    };
+    // indirect draws take their model matrix from the per-draw attributes
+    ShaderHandle lightCubeShader = m_indirect
+        ? shaderRegistry.get("../shaders/lamp.vs", "../shaders/lamp.frag", { "INSTANCED" })
+        : shaderRegistry.get("../shaders/lamp.vs", "../shaders/lamp.frag");
+
+    // the lamp cube only reads positions; its normals ride along in the shared layout
+    if (lampMesh.isNull()) {
+        lampMesh = loadMesh(*meshPool, assetPack, LAMP_MESH_NAME, VERTEX_P3N3, lampVertices, sizeof(lampVertices));
+    }
+
+    MeshRenderer mesh;
+    mesh.shader = lightCubeShader;
+    mesh.vao = meshPool->getVertexArray(lampMesh.format);
+    mesh.baseVertex = lampMesh.baseVertex;
+    mesh.firstIndex = lampMesh.firstIndex;
+    mesh.indexCount = lampMesh.indexCount;
+    TransformId transform = transforms.create(NULL_TRANSFORM, lightPos, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.2f)); // a smaller cube
+    addSpatialProxy(scene.create(Transform{ transform }, Bounds{ glm::vec3(0.0f), CUBE_BOUNDS_RADIUS }, std::move(mesh)));
+}
+
+void Application::addItem() {
+    // get the shared program (compiled on first use only)
+    // ------------------------------------
+    ShaderHandle lightingShader = m_indirect
+        ? shaderRegistry.get("../shaders/diffuse.map.vs", "../shaders/diffuse.map.frag", { "INSTANCED" })
+        : shaderRegistry.get("../shaders/diffuse.map.vs", "../shaders/diffuse.map.frag");
+
+    // shader configuration
+    // --------------------
+    lightingShader->Use();
+    if (m_indirect) {
+        lightingShader->setInt("materialMaps", 0);
+    } else {
+        lightingShader->setInt("material.diffuse", 0);
+        lightingShader->setInt("material.specular", 1);
+        lightingShader->setFloat(U_MATERIAL_SHININESS, 64.0f);
+    }
 
-    // first, configure the cube's VAO (and VBO)
-    glGenVertexArrays(1, &containerVAO);
-    glGenBuffers(1, &VBO);
+    // the nth item sits at cubePositions[n] and spins n+1 times as fast as the first
+    size_t n = 0;
+    scene.eachChunk<Spin, MeshRenderer>([&n](size_t count, const Entity*, Spin*, MeshRenderer*) { n += count; });
+    MeshRenderer mesh;
+    mesh.shader = lightingShader;
+    mesh.vao = meshPool->getVertexArray(cubeMesh.format);
+    mesh.baseVertex = cubeMesh.baseVertex;
+    mesh.firstIndex = cubeMesh.firstIndex;
+    mesh.indexCount = cubeMesh.indexCount;
+    if (m_indirect) {
+        mesh.material = cubeMaterial;
+    } else {
+        mesh.textures[0] = diffuseTexture;
+        mesh.textures[1] = specularTexture;
+        mesh.textureCount = 2;
+    }
+    addSpatialProxy(scene.create(Transform{ transforms.create(NULL_TRANSFORM, cubePositions[n % 10]) },
+        Spin{ glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f)), glm::radians(50.0f) * (n + 1) },
+        Bounds{ glm::vec3(0.0f), CUBE_BOUNDS_RADIUS }, std::move(mesh)));
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+// The leaf starts empty at the origin; the next update() moves it around the entity's world bounds
+void Application::addSpatialProxy(Entity entity) {
+    scene.add(entity, SpatialProxy{ sceneTree.createProxy(AABB(), entity.toBits()) });
+}
 
-    glBindVertexArray(containerVAO);
+void Application::setInstanced(bool instanced) {
+    m_instanced = instanced;
+}
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)0);
-    glEnableVertexAttribArray(0);
+void Application::setIndirect(bool indirect) {
+    m_indirect = indirect;
+}
 
-    // normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-    glEnableVertexAttribArray(1);
-    glBindVertexArray(0);
+void Application::enableBenchmark() {
+    m_benchmark = true;
+    m_instanced = true;
+}
 
-    // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
-    glGenVertexArrays(1, &lightVAO);
-    glBindVertexArray(lightVAO);
+void Application::setupInstancing() {
+    instancedShader = shaderRegistry.get("../shaders/diffuse.map.vs", "../shaders/diffuse.map.frag", { "INSTANCED" });
+    instancedShader->Use();
+    instancedShader->setInt("materialMaps", 0);
 
-    // we only need to bind to the VBO (to link it with glVertexAttribPointer), no need to fill it; the VBO's data already contains all we need (it's already bound, but we do it again for educational purposes)
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    // the pooled cube's attributes (locations 0-2) are bound per frame with the instance ones
+    glGenVertexArrays(1, &instanceVAO);
+    glBindVertexArray(instanceVAO);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // per-instance model and normal matrices; their source moves every frame
+    enableInstanceAttributes();
     glBindVertexArray(0);
+
+    setInstanceCount(sizeof(cubePositions) / sizeof(cubePositions[0]));
 }
 
-void Application::addItem() {
-    // build and compile our shader zprogram
-    // ------------------------------------
-    Shader* lightingShader = new Shader("../shaders/diffuse.map.vs", "../shaders/diffuse.map.frag");
-
-    // set up vertex data (and buffer(s)) and configure vertex attributes
-    // ------------------------------------------------------------------
-    float vertices[] = {
-        // positions          // normals           // texture coords
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f,  0.0f, -1.0f,  0.0f,  0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  1.0f,  1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f,  0.0f,  1.0f,  0.0f,  0.0f,
-
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f, -0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-        -0.5f, -0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f, -1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  0.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  1.0f,  0.0f,  0.0f,  1.0f,  0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, -1.0f,  0.0f,  0.0f,  1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f,
-         0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  1.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-         0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  1.0f,  0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f,  1.0f,  0.0f,  0.0f,  1.0f
+// Resizes the cube field. The first instances are the hand-placed cubePositions[];
+// the rest are scattered deterministically through a volume that grows with the count
+// so density stays roughly constant.
+void Application::setInstanceCount(size_t count) {
+    const size_t handPlaced = sizeof(cubePositions) / sizeof(cubePositions[0]);
+    const float extent = 1.5f * std::cbrt((float)count);
+
+    // structural change: keep the simulation thread out until the field is rebuilt
+    std::lock_guard<std::mutex> lock(simulationMutex);
+
+    // each cube is an entity spinning like the hand-placed items; only the transforms differ
+    while (instanceEntities.size() > count) {
+        transforms.destroy(instanceTransforms.back());
+        scene.destroy(instanceEntities.back());
+        instanceTransforms.pop_back();
+        instanceEntities.pop_back();
+    }
+    const glm::vec3 axis = glm::normalize(glm::vec3(1.0f, 0.3f, 0.5f));
+    while (instanceEntities.size() < count) {
+        size_t i = instanceEntities.size();
+        TransformId transform = transforms.create();
+        instanceTransforms.push_back(transform);
+        instanceEntities.push_back(scene.create(Transform{ transform }, Spin{ axis, glm::radians(50.0f) * (i % 10 + 1) }));
+    }
+
+    uint32_t seed = 0x9E3779B9u;
+    auto next = [&seed]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) * (1.0f / 16777216.0f);
     };
-    // first, configure the cube's VAO (and VBO)
-    GLuint VBO, cubeVAO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &VBO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-    glBindVertexArray(cubeVAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    // shader configuration
-    // --------------------
-    lightingShader->Use();
-    lightingShader->setInt("material.diffuse", 0);
-    lightingShader->setInt("material.specular", 1);
+    for (size_t i = 0; i < count; ++i) {
+        if (i < handPlaced) {
+            transforms.setPosition(instanceTransforms[i], cubePositions[i]);
+            continue;
+        }
+        transforms.setPosition(instanceTransforms[i], glm::vec3(
+            (next() - 0.5f) * extent,
+            (next() - 0.5f) * extent,
+            -next() * extent));
+    }
+
+    // room for every cube being visible; renderInstanced() writes the visible ones each frame
+    frameStream->reserve(FRAME_STREAM_BASE_BYTES + count * sizeof(InstanceData));
+}
 
-    shaders.push_back(lightingShader);
-    VAOs.push_back(cubeVAO);
-    VBOs.push_back(VBO);
+void Application::renderInstanced(const Frustum& frustum, const FrameSnapshot& previous, const FrameSnapshot& current, float alpha) {
+    // culled at the newest state; only cubes in view are blended and uploaded
+    const std::vector<TransformId>& instances = current.instances;
+    instanceBounds.resize(instances.size());
+    jobs.parallelFor((uint32_t)instances.size(), INSTANCE_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            instanceBounds.setTransformed(i, current.worlds[instances[i]], glm::vec3(0.0f), CUBE_HALF_EXTENT);
+        }
+    });
+    culler.cull(frustum, instanceBounds, visibleInstances, &jobs);
+
+    if (visibleInstances.empty()) {
+        return;
+    }
 
+    // the jobs write straight into the mapped stream; no staging copy, no driver-side upload
+    StreamAllocation allocation = frameStream->allocate(visibleInstances.size() * sizeof(InstanceData), alignof(glm::vec4));
+    if (!allocation.data) {
+        LOGF(WARNING, "no stream buffer space for %zu instances", visibleInstances.size());
+        return;
+    }
+    InstanceData* instanceData = static_cast<InstanceData*>(allocation.data);
+    jobs.parallelFor((uint32_t)visibleInstances.size(), INSTANCE_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            instanceData[i] = makeInstanceData(interpolateWorld(previous, current, instances[visibleInstances[i]], alpha), cubeMaterial);
+        }
+    });
+    frameStream->commit(allocation);
+
+    glState.useProgram(instancedShader->getID());
+    glState.bindTexture(0, materials->getArray(cubeMaterial), GL_TEXTURE_2D_ARRAY);
+    glState.bindVertexArray(instanceVAO);
+    // the pool may have moved the cube to a larger buffer since last frame; GL 3.3 has no base
+    // instance, so the attribute offsets carry the slice's start
+    meshPool->bindAttributes(cubeMesh.format);
+    bindInstanceAttributes(frameStream->getID(), allocation.offset);
+    glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cubeMesh.indexCount, GL_UNSIGNED_INT,
+        (void*)(cubeMesh.firstIndex * sizeof(uint32_t)), (GLsizei)visibleInstances.size(), cubeMesh.baseVertex);
+}
+
+// Called once per stats report while benchmarking. The first report at each
+// step is a warm-up; the second is logged as the result for that instance count.
+void Application::advanceBenchmark(float msPerFrame) {
+    static const size_t steps[] = { 10, 100, 1000, 10000, 50000, 100000, 250000, 500000, 1000000 };
+    const size_t stepCount = sizeof(steps) / sizeof(steps[0]);
+
+    if (++m_benchmarkReports < 2) {
+        return;
+    }
+    m_benchmarkReports = 0;
+
+    LOGF(INFO, "benchmark: %zu instances, %.2f ms/frame",
+        instanceTransforms.size(), msPerFrame);
+
+    if (++m_benchmarkStep >= stepCount) {
+        glfwSetWindowShouldClose(m_window, true);
+        return;
+    }
+    setInstanceCount(steps[m_benchmarkStep]);
 }
 
 void Application::run() {
-    // Main loop
+    startSimulation();
+
+    // Main loop: input and drawing only; the scene moves on the simulation thread
     while (!glfwWindowShouldClose(m_window)) {
-        // per-frame time logic
-        // --------------------
         float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
         processEvents();
-        // update();
+        if (textureLoader->processUploads(TEXTURE_UPLOAD_BUDGET) > 0) {
+            textureCache->trim(); // back under budget before the new textures are drawn
+        }
         render();
+        reportFrameStats(currentFrame);
 
         // Swap buffers
         glfwSwapBuffers(m_window);
     }
 
+    stopSimulation();
+
     // for (int i = 0; i < VBOs.size(); ++i) {
     //     glDeleteVertexArrays(1, &VAOs[i]);
     //     glDeleteBuffers(1, &VBOs[i]);
@@ -329,7 +474,96 @@ void Application::run() {
     // glDeleteVertexArrays(1, &lightVAO);
     // glDeleteBuffers(1, &VBO);
 
-    glfwTerminate();
+    // the context stays current: ~Application releases the GL objects and then terminates GLFW
+}
+
+// Logs averaged per-frame counters roughly once a second
+void Application::reportFrameStats(float currentFrame) {
+    ++m_statsFrames;
+    m_statsUniformLookups += Shader::getDriverLookups();
+    Shader::resetDriverLookups();
+    const GLStateCache::Stats& state = glState.getStats();
+    m_statsStateChanges += state.programBinds + state.textureBinds + state.vertexArrayBinds;
+    m_statsStateChangesAvoided += state.avoided;
+    glState.resetStats();
+    const FrustumCuller::Stats& culling = culler.getStats();
+    m_statsCullTested += culling.tested;
+    m_statsCullVisible += culling.visible;
+    culler.resetStats();
+    const JobSystem::Stats jobStats = jobs.getStats();
+    m_statsJobs += jobStats.executed;
+    m_statsJobsStolen += jobStats.stolen;
+    jobs.resetStats();
+    m_statsSimulationSteps += m_simulationSteps.exchange(0);
+    m_statsSimulationMicros += m_simulationMicros.exchange(0);
+    const RenderQueue::Stats& queue = renderQueue.getStats();
+    m_statsDraws += queue.draws;
+    m_statsDrawCalls += queue.drawCalls;
+    renderQueue.resetStats();
+    const StreamBuffer::Stats& stream = frameStream->getStats();
+    m_statsStreamBytes += stream.allocatedBytes;
+    m_statsStreamWaits += stream.fenceWaits;
+    frameStream->resetStats();
+
+    float elapsed = currentFrame - m_statsStart;
+    if (elapsed < 1.0f) {
+        return;
+    }
+
+    float msPerFrame = 1000.0f * elapsed / m_statsFrames;
+
+    // also catches textures whose last user let go since the last upload
+    textureCache->trim();
+    if (m_textureReportPending && textureLoader->getPending() == 0) {
+        textureCache->report();
+        m_textureReportPending = false;
+    }
+
+    const MeshPool::Stats meshStats = meshPool->getStats();
+    LOGF(DEBUG,
+        "%.1f fps, %.2f ms/frame, %.1f uniform driver lookups/frame, %.1f state changes/frame (%.1f avoided), "
+        "%.1f visible/%.1f culled objects/frame, %.1f draws/frame in %.1f calls, %.1f jobs/frame (%.1f stolen), "
+        "%.1f simulation steps/s (%.2f ms/step), %.1f KB streamed/frame (%u fence waits), %.1f MB textures, "
+        "%u meshes in %.1f MB of %.1f MB pooled",
+        m_statsFrames / elapsed,
+        msPerFrame,
+        (float)m_statsUniformLookups / m_statsFrames,
+        (float)m_statsStateChanges / m_statsFrames,
+        (float)m_statsStateChangesAvoided / m_statsFrames,
+        (float)m_statsCullVisible / m_statsFrames,
+        (float)(m_statsCullTested - m_statsCullVisible) / m_statsFrames,
+        (float)m_statsDraws / m_statsFrames,
+        (float)m_statsDrawCalls / m_statsFrames,
+        (float)m_statsJobs / m_statsFrames,
+        (float)m_statsJobsStolen / m_statsFrames,
+        m_statsSimulationSteps / elapsed,
+        m_statsSimulationSteps ? m_statsSimulationMicros / (1000.0f * m_statsSimulationSteps) : 0.0f,
+        m_statsStreamBytes / (1024.0f * m_statsFrames),
+        m_statsStreamWaits,
+        textureCache->getResidentBytes() / (1024.0f * 1024.0f),
+        meshStats.meshes,
+        (meshStats.vertexBytes + meshStats.indexBytes) / (1024.0f * 1024.0f),
+        meshStats.capacityBytes / (1024.0f * 1024.0f));
+
+    if (m_benchmark) {
+        advanceBenchmark(msPerFrame);
+    }
+
+    m_statsStart = currentFrame;
+    m_statsFrames = 0;
+    m_statsUniformLookups = 0;
+    m_statsStateChanges = 0;
+    m_statsStateChangesAvoided = 0;
+    m_statsCullTested = 0;
+    m_statsCullVisible = 0;
+    m_statsJobs = 0;
+    m_statsJobsStolen = 0;
+    m_statsSimulationSteps = 0;
+    m_statsSimulationMicros = 0;
+    m_statsDraws = 0;
+    m_statsDrawCalls = 0;
+    m_statsStreamBytes = 0;
+    m_statsStreamWaits = 0;
 }
 
 void Application::processEvents() {
@@ -339,59 +573,166 @@ void Application::processEvents() {
         glfwSetWindowShouldClose(m_window, true);
     }
 
-    float cameraSpeed = static_cast<float>(2.5 * deltaTime);
-    if (glfwGetKey(m_window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(m_window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(m_window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(m_window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+    // pick on press only, not every frame the button is held
+    bool pickDown = glfwGetMouseButton(m_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pickDown && !m_pickHeld) {
+        pick();
+    }
+    m_pickHeld = pickDown;
+
+    // the next simulation step picks these up
+    std::lock_guard<std::mutex> lock(inputMutex);
+    m_input.look += mouseLook;
+    m_input.zoom += mouseScroll;
+    mouseLook = glm::vec2(0.0f);
+    mouseScroll = 0.0f;
+    m_input.forward = glfwGetKey(m_window, GLFW_KEY_W) == GLFW_PRESS;
+    m_input.backward = glfwGetKey(m_window, GLFW_KEY_S) == GLFW_PRESS;
+    m_input.left = glfwGetKey(m_window, GLFW_KEY_A) == GLFW_PRESS;
+    m_input.right = glfwGetKey(m_window, GLFW_KEY_D) == GLFW_PRESS;
+}
+
+// The first snapshot is taken here, so the first frame already has something to draw
+void Application::startSimulation() {
+    // every query either thread runs goes into the world's table now, while nothing else
+    // looks at it; from here on both threads only look their own queries up
+    scene.query<Spin, Transform>();
+    scene.query<Spin, MeshRenderer>();
+    scene.query<Transform, Bounds, SpatialProxy>();
+
+    double now = glfwGetTime();
+    transforms.update(&jobs);
+    publishSnapshot(now);
+    snapshots.acquire();
+    m_simulationRunning = true;
+    simulationThread = std::thread(&Application::simulationMain, this, now);
+}
+
+void Application::stopSimulation() {
+    m_simulationRunning = false;
+    if (simulationThread.joinable()) {
+        simulationThread.join();
+    }
 }
 
-void Application::update() {
-    // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    
-    for (size_t s = 0; s < shaders.size(); ++s) {
-        // std::cout << "Rendering shader " << s << std::endl;
-       // be sure to activate shader when setting uniforms/drawing objects
-        shaders[s]->Use();
-
-        shaders[s]->setVec3("light.position", lightPos);
-        shaders[s]->setVec3("viewPos", camera.Position);
-
-        // light properties
-        shaders[s]->setVec3("light.ambient", 0.2f, 0.2f, 0.2f);
-        shaders[s]->setVec3("light.diffuse", 0.5f, 0.5f, 0.5f);
-        shaders[s]->setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-        // material properties
-        shaders[s]->setFloat("material.shininess", 64.0f);
-
-        // view/projection transformations
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        // glm::mat4 view = camera.GetViewMatrix();
-        shaders[s]->setMat4("projection", projection);
-        shaders[s]->setMat4("view", view);
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        shaders[s]->setMat4("model", model);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        // render the cube
-        glBindVertexArray(VAOs[s]);
-        glDrawArrays(GL_TRIANGLES, 0, 36);  
+// Steps the scene in fixed increments of the glfwGetTime() clock, whatever the frame rate,
+// publishing a snapshot after each; sleeps while ahead of the clock
+void Application::simulationMain(double startTime) {
+    jobs.attach();
+    double simulationTime = startTime;
+    while (m_simulationRunning.load()) {
+        double now = glfwGetTime();
+        if (now - simulationTime > MAX_SIMULATION_LAG) {
+            simulationTime = now - SIMULATION_STEP;
+        }
+        if (simulationTime + SIMULATION_STEP > now) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(simulationTime + SIMULATION_STEP - now));
+            continue;
+        }
+        simulationTime += SIMULATION_STEP;
+
+        auto stepStart = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(simulationMutex);
+            update(SIMULATION_STEP);
+            publishSnapshot(simulationTime);
+        }
+        auto stepTime = std::chrono::steady_clock::now() - stepStart;
+        m_simulationMicros += (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(stepTime).count();
+        ++m_simulationSteps;
+    }
+}
+
+// Scene systems, once per simulation step
+void Application::update(float stepSeconds) {
+    SimulationInput input;
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input = m_input;
+        m_input.look = glm::vec2(0.0f);
+        m_input.zoom = 0.0f;
+    }
+    camera.ProcessMouseMovement(input.look.x, input.look.y);
+    if (input.zoom != 0.0f)
+        camera.ProcessMouseScroll(input.zoom);
+    if (input.forward)
+        camera.ProcessKeyboard(FORWARD, stepSeconds);
+    if (input.backward)
+        camera.ProcessKeyboard(BACKWARD, stepSeconds);
+    if (input.left)
+        camera.ProcessKeyboard(LEFT, stepSeconds);
+    if (input.right)
+        camera.ProcessKeyboard(RIGHT, stepSeconds);
+
+    scene.eachChunk<Spin, Transform>([this, stepSeconds](size_t count, const Entity*, Spin* spin, Transform* transform) {
+        for (size_t i = 0; i < count; ++i) {
+            spin[i].angle += spin[i].radiansPerSecond * stepSeconds;
+            transforms.setRotation(transform[i].id, glm::angleAxis(spin[i].angle, spin[i].axis));
+        }
+    });
+
+    // world matrices for whatever moved; static nodes are not touched
+    transforms.update(&jobs);
+}
+
+// Copies out what render() reads; the simulation thread holds simulationMutex (or is not running)
+void Application::publishSnapshot(double time) {
+    FrameSnapshot& snapshot = snapshots.beginWrite();
+    snapshot.time = time;
+    snapshot.camera = camera;
+    snapshot.lightPosition = lightPos;
+    transforms.copyWorlds(snapshot.worlds, &jobs);
+    snapshot.instances = instanceTransforms;
+    snapshots.publish();
+}
+
+// Keeps the tree around the world bounds; an entity still inside its fat box costs one test
+void Application::syncSceneTree(const FrameSnapshot& snapshot) {
+    scene.eachChunk<Transform, Bounds, SpatialProxy>([this, &snapshot](size_t count, const Entity*,
+            Transform* transform, Bounds* bounds, SpatialProxy* proxy) {
+        for (size_t i = 0; i < count; ++i) {
+            if (snapshot.hasWorld(transform[i].id)) {
+                glm::vec4 sphere = worldSphere(snapshot.worlds[transform[i].id], bounds[i]);
+                sceneTree.moveProxy(proxy[i].id, AABB::fromSphere(glm::vec3(sphere), sphere.w));
+            }
+        }
+    });
+}
+
+// Nearest entity whose bounding sphere the view ray through the crosshair hits
+void Application::pick() {
+    const float PICK_DISTANCE = 100.0f;
+    Entity picked;
+    float pickedDistance = PICK_DISTANCE;
+    const FrameSnapshot& snapshot = snapshots.current();
+    sceneTree.raycast(m_view.Position, m_view.Front, PICK_DISTANCE, [&](ProxyId, uint64_t userData, float) {
+        Entity entity = Entity::fromBits(userData);
+        TransformId transform = scene.get<Transform>(entity)->id;
+        if (!snapshot.hasWorld(transform)) {
+            return pickedDistance;
+        }
+        glm::vec4 sphere = worldSphere(snapshot.worlds[transform], *scene.get<Bounds>(entity));
+        float radius = sphere.w;
+
+        // ray/sphere, with the ray direction of unit length
+        glm::vec3 toCenter = glm::vec3(sphere) - m_view.Position;
+        float along = glm::dot(toCenter, m_view.Front);
+        float miss2 = glm::dot(toCenter, toCenter) - along * along;
+        if (miss2 > radius * radius) {
+            return pickedDistance;
+        }
+        float distance = std::max(along - std::sqrt(radius * radius - miss2), 0.0f);
+        if (distance < pickedDistance) {
+            picked = entity;
+            pickedDistance = distance;
+        }
+        return pickedDistance;
+    });
+
+    if (picked.isNull()) {
+        LOGF(INFO, "picked nothing");
+    } else {
+        LOGF(INFO, "picked entity %u at %.2f", picked.index, pickedDistance);
     }
 }
 
@@ -400,68 +741,111 @@ void Application::render() {
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // view/projection transformations
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    
-    for (size_t s = 0; s < shaders.size(); ++s) {
-        // std::cout << "Rendering shader " << s << std::endl;
-       // be sure to activate shader when setting uniforms/drawing objects
-        shaders[s]->Use();
-
-        shaders[s]->setVec3("light.position", lightPos);
-        shaders[s]->setVec3("viewPos", camera.Position);
-
-        // light properties
-        shaders[s]->setVec3("light.ambient", 0.2f, 0.2f, 0.2f);
-        shaders[s]->setVec3("light.diffuse", 0.5f, 0.5f, 0.5f);
-        shaders[s]->setVec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-        // material properties
-        shaders[s]->setFloat("material.shininess", 64.0f);
-
-        // view/projection transformations
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        // glm::mat4 view = camera.GetViewMatrix();
-        shaders[s]->setMat4("projection", projection);
-        shaders[s]->setMat4("view", view);
-
-        // world transformation
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, cubePositions[s]);
-        model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f) * (s + 1), glm::vec3(1.0f, 0.3f, 0.5f));
-        shaders[s]->setMat4("model", model);
-
-        // bind diffuse map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-
-        // bind specular map
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-
-        // render the cube
-        glBindVertexArray(VAOs[s]);
-        glDrawArrays(GL_TRIANGLES, 0, 36);  
+    // waits, rarely, for the GPU to let go of the stream region written three frames ago
+    frameStream->beginFrame();
+    // materials whose maps finished loading move into their arrays
+    materials->update();
+
+    // the two newest simulation states, drawn one step behind the clock so there is always a
+    // pair to blend between
+    snapshots.acquire();
+    const FrameSnapshot& previous = snapshots.previous();
+    const FrameSnapshot& current = snapshots.current();
+    double renderTime = glfwGetTime() - SIMULATION_STEP;
+    float alpha = current.time > previous.time
+        ? glm::clamp((float)((renderTime - previous.time) / (current.time - previous.time)), 0.0f, 1.0f)
+        : 1.0f;
+    m_view = interpolateCamera(previous.camera, current.camera, alpha);
+    syncSceneTree(current);
+
+    // view/projection transformations and light properties, shared by every program
+    FrameConstants constants;
+    constants.projection = glm::perspective(glm::radians(m_view.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    constants.view = m_view.GetViewMatrix();
+    constants.viewPos = glm::vec4(m_view.Position, 1.0f);
+    constants.lightPosition = glm::vec4(current.lightPosition, 1.0f);
+    constants.lightAmbient = glm::vec4(0.2f, 0.2f, 0.2f, 0.0f);
+    constants.lightDiffuse = glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+    constants.lightSpecular = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+    frameConstants->update(constants);
+
+    // anything entirely outside these planes is not submitted
+    const Frustum frustum = m_view.GetFrustum(constants.projection);
+
+    // setup code binds programs/textures directly, so start each frame from unknown state
+    glState.invalidate();
+
+    if (m_instanced) {
+        renderInstanced(frustum, previous, current, alpha);
     }
 
-
-    // LAMP
-    lightCubeShader->Use();
-    lightCubeShader->setMat4("projection", projection);
-    lightCubeShader->setMat4("view", view);
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, lightPos);
-    model = glm::scale(model, glm::vec3(0.2f)); // a smaller cube
-    lightCubeShader->setMat4("model", model);
-
-    glBindVertexArray(lightVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    // END LIGHTING
-
+    // entities whose fat bounds touch the view; whole subtrees outside it are skipped at once
+    visibleEntities.clear();
+    sceneTree.queryFrustum(frustum, [this](ProxyId, uint64_t userData) {
+        Entity entity = Entity::fromBits(userData);
+        // the instanced path already drew the spinning cubes
+        if (scene.has<MeshRenderer>(entity) && !(m_instanced && scene.has<Spin>(entity))) {
+            visibleEntities.push_back(entity);
+        }
+        return true;
+    });
+
+    // draw preparation on the job threads: exact sphere test at the blended matrix, then a
+    // packet into the thread's own recording buffer
+    std::atomic<uint32_t> recorded{0};
+    jobs.parallelFor((uint32_t)visibleEntities.size(), DRAW_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        const unsigned thread = jobs.getThreadIndex();
+        uint32_t count = 0;
+        for (uint32_t i = begin; i < end; ++i) {
+            Entity entity = visibleEntities[i];
+            TransformId transform = scene.get<Transform>(entity)->id;
+            if (!current.hasWorld(transform)) {
+                continue; // created since the last step
+            }
+            DrawItem item;
+            item.model = interpolateWorld(previous, current, transform, alpha);
+            glm::vec4 sphere = worldSphere(item.model, *scene.get<Bounds>(entity));
+            if (!frustum.intersectsSphere(glm::vec3(sphere), sphere.w)) {
+                continue;
+            }
+
+            const MeshRenderer& mesh = *scene.get<MeshRenderer>(entity);
+            item.shader = mesh.shader.get();
+            item.vao = mesh.vao;
+            item.baseVertex = mesh.baseVertex;
+            item.firstIndex = mesh.firstIndex;
+            item.indexCount = mesh.indexCount;
+            if (mesh.material != NO_MATERIAL) {
+                // one array for every material in it, so mixed materials still share a run
+                item.textures[0] = materials->getArray(mesh.material);
+                item.textureCount = 1;
+                item.textureTarget = GL_TEXTURE_2D_ARRAY;
+                item.material = mesh.material;
+            } else {
+                item.textureCount = mesh.textureCount;
+                for (GLuint t = 0; t < mesh.textureCount; ++t) {
+                    item.textures[t] = mesh.textures[t]->getID();
+                }
+            }
+
+            float distance = glm::length(glm::vec3(item.model[3]) - m_view.Position);
+            item.key = RenderQueue::makeKey(PASS_OPAQUE, item.shader->getID(), item.textureCount ? item.textures[0] : 0,
+                item.vao, RenderQueue::quantizeDepth(distance, 0.1f, 100.0f));
+            renderQueue.submit(item, thread);
+            ++count;
+        }
+        recorded += count;
+    });
+    m_statsCullTested += (uint32_t)sceneTree.getProxyCount();
+    m_statsCullVisible += recorded.load();
+
+    // merged and replayed here, on the GL thread
+    renderQueue.flush(glState);
 
     // Unbind VAO for cleanliness
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
+
+    frameStream->endFrame();
 }
 
 
@@ -495,51 +879,12 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    mouseLook += glm::vec2(xoffset, yoffset);
 }
 
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
-}
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    mouseScroll += static_cast<float>(yoffset);
 }
@@ -0,0 +1,196 @@
+#include "AssetPack.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "utils/logger.h"
+
+AssetPack::AssetPack(const std::string& path, const std::string& sourceRoot) {
+    std::error_code error;
+    std::filesystem::path canonicalRoot = std::filesystem::weakly_canonical(sourceRoot, error);
+    root = error ? sourceRoot : canonicalRoot.generic_string();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return; // no pack cooked: callers fall back to the loose files
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(PackHeader)) {
+        void* mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            base = static_cast<const unsigned char*>(mapping);
+            mappedBytes = (size_t)info.st_size;
+        }
+    }
+    close(fd); // the mapping keeps the file alive
+
+    if (!base) {
+        return;
+    }
+
+    const PackHeader* header = reinterpret_cast<const PackHeader*>(base);
+    if (header->magic != PACK_MAGIC || header->version != PACK_VERSION || header->fileSize != mappedBytes ||
+        header->tocOffset > mappedBytes || (uint64_t)header->entryCount * sizeof(PackEntry) > mappedBytes - header->tocOffset ||
+        header->stringsOffset > mappedBytes) {
+        LOGF(WARNING, "Asset pack %s is stale or corrupt; re-run the cook target", path.c_str());
+        unmap();
+        return;
+    }
+
+    // The TOC is small and read once; record pages are only touched when an asset is used.
+    // Every record lies inside the file after the strings, which end where the first one starts,
+    // and every name is terminated inside them; anything else would read past the mapping.
+    const PackEntry* toc = reinterpret_cast<const PackEntry*>(base + header->tocOffset);
+    uint64_t stringsEnd = mappedBytes;
+    bool valid = true;
+    for (uint32_t i = 0; i < header->entryCount && valid; ++i) {
+        const PackEntry& entry = toc[i];
+        const uint64_t recordSize = entry.type == PACK_TEXTURE ? sizeof(PackTexture) : sizeof(PackMesh);
+        valid = entry.offset >= header->stringsOffset && entry.offset % PACK_DATA_ALIGNMENT == 0 && entry.offset <= mappedBytes &&
+            entry.size <= mappedBytes - entry.offset && entry.size >= recordSize;
+        stringsEnd = std::min(stringsEnd, entry.offset);
+    }
+    const char* strings = reinterpret_cast<const char*>(base + header->stringsOffset);
+    const uint64_t stringsSize = stringsEnd - header->stringsOffset;
+    for (uint32_t i = 0; i < header->entryCount && valid; ++i) {
+        valid = toc[i].nameOffset < stringsSize &&
+            std::memchr(strings + toc[i].nameOffset, '\0', stringsSize - toc[i].nameOffset) != nullptr;
+    }
+    // the records themselves: one pass over their headers (and mesh indices) at startup
+    for (uint32_t i = 0; i < header->entryCount && valid; ++i) {
+        valid = toc[i].type == PACK_TEXTURE ? isValidTexture(toc[i]) : toc[i].type == PACK_MESH && isValidMesh(toc[i]);
+    }
+    if (!valid) {
+        LOGF(WARNING, "Asset pack %s has entries outside the file or malformed; re-run the cook target", path.c_str());
+        unmap();
+        return;
+    }
+
+    names.reserve(header->entryCount);
+    for (uint32_t i = 0; i < header->entryCount; ++i) {
+        names.emplace(strings + toc[i].nameOffset, i);
+    }
+
+    LOGF(INFO, "Asset pack %s: %zu entries, %zu KB mapped", path.c_str(), names.size(), mappedBytes / 1024);
+}
+
+namespace {
+
+// [offset, offset + size) inside the entry, without overflowing
+bool insideEntry(const PackEntry& entry, uint64_t offset, uint64_t size) {
+    return offset >= entry.offset && offset - entry.offset <= entry.size && size <= entry.size - (offset - entry.offset);
+}
+
+} // namespace
+
+bool AssetPack::isValidTexture(const PackEntry& entry) const {
+    const PackTexture& texture = *reinterpret_cast<const PackTexture*>(base + entry.offset);
+    if (texture.mipCount < 1 || texture.mipCount > PACK_MAX_MIPS || texture.width == 0 || texture.height == 0 ||
+        (texture.format == PACK_FORMAT_RAW ? texture.channels != 1 && texture.channels != 3 && texture.channels != 4
+                                           : packBlockBytes(texture.format) == 0)) {
+        return false;
+    }
+    // each level half the one above, as uploadPacked() hands them to GL, and exactly as large
+    // as its format and size make it
+    uint32_t width = texture.width, height = texture.height;
+    for (uint32_t level = 0; level < texture.mipCount; ++level) {
+        const PackMip& mip = texture.mips[level];
+        if (mip.width != width || mip.height != height || !insideEntry(entry, mip.offset, mip.size) ||
+            mip.size != packMipBytes(texture.format, width, height, texture.channels)) {
+            return false;
+        }
+        width = std::max(width / 2, 1u);
+        height = std::max(height / 2, 1u);
+    }
+    return true;
+}
+
+bool AssetPack::isValidMesh(const PackEntry& entry) const {
+    const PackMesh& mesh = *reinterpret_cast<const PackMesh*>(base + entry.offset);
+    if (mesh.floatsPerVertex == 0 || mesh.vertexOffset % sizeof(float) != 0 ||
+        (uint64_t)mesh.vertexCount * mesh.floatsPerVertex > entry.size / sizeof(float) ||
+        !insideEntry(entry, mesh.vertexOffset, (uint64_t)mesh.vertexCount * mesh.floatsPerVertex * sizeof(float))) {
+        return false;
+    }
+    if (mesh.indexCount == 0) {
+        return true;
+    }
+    if (mesh.indexOffset % sizeof(uint32_t) != 0 || !insideEntry(entry, mesh.indexOffset, (uint64_t)mesh.indexCount * sizeof(uint32_t))) {
+        return false;
+    }
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(base + mesh.indexOffset);
+    for (uint32_t i = 0; i < mesh.indexCount; ++i) {
+        if (indices[i] >= mesh.vertexCount) {
+            return false;
+        }
+    }
+    return true;
+}
+
+AssetPack::~AssetPack() {
+    unmap();
+}
+
+void AssetPack::unmap() {
+    if (base) {
+        munmap(const_cast<unsigned char*>(base), mappedBytes);
+    }
+    base = nullptr;
+    mappedBytes = 0;
+    names.clear();
+}
+
+bool AssetPack::isOpen() const {
+    return base != nullptr;
+}
+
+// "../assets/x.png" -> "assets/x.png" when the pack was cooked from ".."
+std::string AssetPack::relativeName(const std::string& path) const {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    if (error) {
+        return path;
+    }
+    return canonical.lexically_relative(root).generic_string();
+}
+
+const PackEntry* AssetPack::find(const std::string& name, uint32_t type) const {
+    auto it = names.find(name);
+    if (it == names.end()) {
+        return nullptr;
+    }
+    const PackHeader* header = reinterpret_cast<const PackHeader*>(base);
+    const PackEntry* entry = reinterpret_cast<const PackEntry*>(base + header->tocOffset) + it->second;
+    return entry->type == type ? entry : nullptr;
+}
+
+const PackTexture* AssetPack::findTexture(const std::string& path) const {
+    if (!base) {
+        return nullptr;
+    }
+    const PackEntry* entry = find(relativeName(path), PACK_TEXTURE);
+    return entry ? reinterpret_cast<const PackTexture*>(base + entry->offset) : nullptr;
+}
+
+const PackMesh* AssetPack::findMesh(const std::string& name) const {
+    if (!base) {
+        return nullptr;
+    }
+    const PackEntry* entry = find(name, PACK_MESH);
+    return entry ? reinterpret_cast<const PackMesh*>(base + entry->offset) : nullptr;
+}
+
+const unsigned char* AssetPack::data(uint64_t offset) const {
+    return base + offset;
+}
+
+size_t AssetPack::getEntryCount() const {
+    return names.size();
+}
+
+size_t AssetPack::getMappedBytes() const {
+    return mappedBytes;
+}
@@ -30,6 +30,12 @@ glm::mat4 Camera::GetViewMatrix()
     return glm::lookAt(Position, Position + Front, Up);
 }
 
+// returns the world-space clip planes of this camera seen through the given projection
+Frustum Camera::GetFrustum(const glm::mat4& projection)
+{
+    return Frustum::fromMatrix(projection * GetViewMatrix());
+}
+
 // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
 void Camera::ProcessKeyboard(Camera_Movement direction, float deltaTime)
 {
@@ -0,0 +1,274 @@
+#include "DynamicBVH.hpp"
+#include <algorithm>
+
+namespace {
+
+// fat bounds this much larger than the object's, per side, are shrunk back on the next move
+const float MAX_MARGIN_FACTOR = 4.0f;
+// fat bounds reach this many steps of the current displacement ahead of the object
+const float DISPLACEMENT_MULTIPLIER = 2.0f;
+
+} // namespace
+
+ProxyId DynamicBVH::createProxy(const AABB& bounds, uint64_t userData) {
+    int32_t proxy = allocateNode();
+    Node& node = nodes[proxy];
+    node.bounds = { bounds.lower - glm::vec3(margin), bounds.upper + glm::vec3(margin) };
+    node.userData = userData;
+    node.height = 0;
+    insertLeaf(proxy);
+    ++proxyCount;
+    return proxy;
+}
+
+void DynamicBVH::destroyProxy(ProxyId proxy) {
+    assert(proxy >= 0 && proxy < (ProxyId)nodes.size() && nodes[proxy].isLeaf() && nodes[proxy].height == 0);
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --proxyCount;
+}
+
+bool DynamicBVH::moveProxy(ProxyId proxy, const AABB& bounds, const glm::vec3& displacement) {
+    assert(proxy >= 0 && proxy < (ProxyId)nodes.size() && nodes[proxy].isLeaf());
+
+    // still inside its fat bounds, and those have not grown far too loose: nothing to do
+    const AABB& fat = nodes[proxy].bounds;
+    AABB loosest = { bounds.lower - glm::vec3(MAX_MARGIN_FACTOR * margin), bounds.upper + glm::vec3(MAX_MARGIN_FACTOR * margin) };
+    if (fat.contains(bounds) && loosest.contains(fat)) {
+        return false;
+    }
+
+    removeLeaf(proxy);
+    AABB grown = { bounds.lower - glm::vec3(margin), bounds.upper + glm::vec3(margin) };
+    glm::vec3 ahead = DISPLACEMENT_MULTIPLIER * displacement;
+    grown.lower += glm::min(ahead, glm::vec3(0.0f));
+    grown.upper += glm::max(ahead, glm::vec3(0.0f));
+    nodes[proxy].bounds = grown;
+    insertLeaf(proxy);
+    return true;
+}
+
+void DynamicBVH::clear() {
+    nodes.clear();
+    root = NULL_NODE;
+    freeList = NULL_NODE;
+    proxyCount = 0;
+}
+
+int32_t DynamicBVH::allocateNode() {
+    int32_t node;
+    if (freeList != NULL_NODE) {
+        node = freeList;
+        freeList = nodes[node].parent;
+    } else {
+        node = (int32_t)nodes.size();
+        nodes.emplace_back();
+    }
+    nodes[node] = Node();
+    return node;
+}
+
+void DynamicBVH::freeNode(int32_t node) {
+    nodes[node].parent = freeList;
+    nodes[node].height = -1;
+    freeList = node;
+}
+
+void DynamicBVH::insertLeaf(int32_t leaf) {
+    if (root == NULL_NODE) {
+        root = leaf;
+        nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // find the best sibling: descend while pairing deeper costs less than pairing here, where
+    // the cost of a pairing is the area of the new parent plus the growth of every ancestor
+    const AABB leafBounds = nodes[leaf].bounds;
+    int32_t index = root;
+    while (!nodes[index].isLeaf()) {
+        const Node& node = nodes[index];
+        float area = node.bounds.surfaceArea();
+        float combinedArea = AABB::merge(node.bounds, leafBounds).surfaceArea();
+
+        float cost = 2.0f * combinedArea;
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](int32_t child) {
+            const AABB& childBounds = nodes[child].bounds;
+            float merged = AABB::merge(leafBounds, childBounds).surfaceArea();
+            return nodes[child].isLeaf() ? merged + inheritanceCost
+                                         : merged - childBounds.surfaceArea() + inheritanceCost;
+        };
+        float cost1 = descendCost(node.child1);
+        float cost2 = descendCost(node.child2);
+
+        if (cost < cost1 && cost < cost2) {
+            break;
+        }
+        index = cost1 < cost2 ? node.child1 : node.child2;
+    }
+    int32_t sibling = index;
+
+    // a new parent takes the sibling's place
+    int32_t oldParent = nodes[sibling].parent;
+    int32_t newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].bounds = AABB::merge(leafBounds, nodes[sibling].bounds);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent == NULL_NODE) {
+        root = newParent;
+    } else if (nodes[oldParent].child1 == sibling) {
+        nodes[oldParent].child1 = newParent;
+    } else {
+        nodes[oldParent].child2 = newParent;
+    }
+
+    refitUpwards(newParent);
+}
+
+void DynamicBVH::removeLeaf(int32_t leaf) {
+    if (leaf == root) {
+        root = NULL_NODE;
+        return;
+    }
+
+    // the sibling takes the parent's place
+    int32_t parent = nodes[leaf].parent;
+    int32_t grandParent = nodes[parent].parent;
+    int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    if (grandParent == NULL_NODE) {
+        root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+        return;
+    }
+
+    if (nodes[grandParent].child1 == parent) {
+        nodes[grandParent].child1 = sibling;
+    } else {
+        nodes[grandParent].child2 = sibling;
+    }
+    nodes[sibling].parent = grandParent;
+    freeNode(parent);
+
+    refitUpwards(grandParent);
+}
+
+void DynamicBVH::refitUpwards(int32_t index) {
+    while (index != NULL_NODE) {
+        index = balance(index);
+        Node& node = nodes[index];
+        const Node& child1 = nodes[node.child1];
+        const Node& child2 = nodes[node.child2];
+        node.height = 1 + std::max(child1.height, child2.height);
+        node.bounds = AABB::merge(child1.bounds, child2.bounds);
+        index = node.parent;
+    }
+}
+
+int32_t DynamicBVH::balance(int32_t iA) {
+    Node* A = &nodes[iA];
+    if (A->isLeaf() || A->height < 2) {
+        return iA;
+    }
+
+    int32_t iB = A->child1;
+    int32_t iC = A->child2;
+    Node* B = &nodes[iB];
+    Node* C = &nodes[iC];
+    int32_t difference = C->height - B->height;
+
+    // rotate C up: C takes A's place, A takes C's shorter child's place
+    if (difference > 1) {
+        int32_t iF = C->child1;
+        int32_t iG = C->child2;
+        Node* F = &nodes[iF];
+        Node* G = &nodes[iG];
+
+        C->child1 = iA;
+        C->parent = A->parent;
+        A->parent = iC;
+        if (C->parent == NULL_NODE) {
+            root = iC;
+        } else if (nodes[C->parent].child1 == iA) {
+            nodes[C->parent].child1 = iC;
+        } else {
+            nodes[C->parent].child2 = iC;
+        }
+
+        if (F->height > G->height) {
+            C->child2 = iF;
+            A->child2 = iG;
+            G->parent = iA;
+            A->bounds = AABB::merge(B->bounds, G->bounds);
+            C->bounds = AABB::merge(A->bounds, F->bounds);
+            A->height = 1 + std::max(B->height, G->height);
+            C->height = 1 + std::max(A->height, F->height);
+        } else {
+            C->child2 = iG;
+            A->child2 = iF;
+            F->parent = iA;
+            A->bounds = AABB::merge(B->bounds, F->bounds);
+            C->bounds = AABB::merge(A->bounds, G->bounds);
+            A->height = 1 + std::max(B->height, F->height);
+            C->height = 1 + std::max(A->height, G->height);
+        }
+        return iC;
+    }
+
+    // rotate B up, mirrored
+    if (difference < -1) {
+        int32_t iD = B->child1;
+        int32_t iE = B->child2;
+        Node* D = &nodes[iD];
+        Node* E = &nodes[iE];
+
+        B->child1 = iA;
+        B->parent = A->parent;
+        A->parent = iB;
+        if (B->parent == NULL_NODE) {
+            root = iB;
+        } else if (nodes[B->parent].child1 == iA) {
+            nodes[B->parent].child1 = iB;
+        } else {
+            nodes[B->parent].child2 = iB;
+        }
+
+        if (D->height > E->height) {
+            B->child2 = iD;
+            A->child1 = iE;
+            E->parent = iA;
+            A->bounds = AABB::merge(C->bounds, E->bounds);
+            B->bounds = AABB::merge(A->bounds, D->bounds);
+            A->height = 1 + std::max(C->height, E->height);
+            B->height = 1 + std::max(A->height, D->height);
+        } else {
+            B->child2 = iE;
+            A->child1 = iD;
+            D->parent = iA;
+            A->bounds = AABB::merge(C->bounds, D->bounds);
+            B->bounds = AABB::merge(A->bounds, E->bounds);
+            A->height = 1 + std::max(C->height, D->height);
+            B->height = 1 + std::max(A->height, E->height);
+        }
+        return iB;
+    }
+
+    return iA;
+}
+
+float DynamicBVH::rayEntry(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+    glm::vec3 t1 = (box.lower - origin) * inverseDirection;
+    glm::vec3 t2 = (box.upper - origin) * inverseDirection;
+    glm::vec3 nearest = glm::min(t1, t2);
+    glm::vec3 farthest = glm::max(t1, t2);
+    float entry = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+    float exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+    return entry <= exit ? entry : -1.0f;
+}
@@ -0,0 +1,19 @@
+#include "FrameConstants.hpp"
+#include <cstring>
+#include <glad/glad.h>
+#include "utils/logger.h"
+
+FrameConstantsBuffer::FrameConstantsBuffer(StreamBuffer& stream) : stream(stream) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+}
+
+void FrameConstantsBuffer::update(const FrameConstants& constants) {
+    StreamAllocation allocation = stream.allocate(sizeof(FrameConstants), (size_t)offsetAlignment);
+    if (!allocation.data) {
+        LOGF(WARNING, "no stream buffer space for frame constants");
+        return;
+    }
+    std::memcpy(allocation.data, &constants, sizeof(FrameConstants));
+    stream.commit(allocation);
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, stream.getID(), allocation.offset, allocation.size);
+}
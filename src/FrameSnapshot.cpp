@@ -0,0 +1,38 @@
+#include "FrameSnapshot.hpp"
+
+void SnapshotExchange::publish() {
+    writeIndex = exchange.exchange(writeIndex | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+}
+
+bool SnapshotExchange::acquire() {
+    if ((exchange.load(std::memory_order_relaxed) & FRESH) == 0) {
+        return false;
+    }
+    uint32_t oldest = previousIndex;
+    previousIndex = currentIndex;
+    currentIndex = exchange.exchange(oldest, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+}
+
+glm::mat4 interpolateWorld(const FrameSnapshot& from, const FrameSnapshot& to, TransformId id, float alpha) {
+    // a node the older snapshot does not know yet is drawn where it is now
+    if (!from.hasWorld(id)) {
+        return to.worlds[id];
+    }
+    const glm::mat4& a = from.worlds[id];
+    const glm::mat4& b = to.worlds[id];
+    return glm::mat4(glm::mix(a[0], b[0], alpha), glm::mix(a[1], b[1], alpha),
+                     glm::mix(a[2], b[2], alpha), glm::mix(a[3], b[3], alpha));
+}
+
+Camera interpolateCamera(const Camera& from, const Camera& to, float alpha) {
+    Camera camera = to;
+    camera.Position = glm::mix(from.Position, to.Position, alpha);
+    camera.Yaw = glm::mix(from.Yaw, to.Yaw, alpha);
+    camera.Pitch = glm::mix(from.Pitch, to.Pitch, alpha);
+    camera.Zoom = glm::mix(from.Zoom, to.Zoom, alpha);
+    camera.Front = glm::normalize(glm::mix(from.Front, to.Front, alpha));
+    camera.Right = glm::normalize(glm::cross(camera.Front, camera.WorldUp));
+    camera.Up = glm::normalize(glm::cross(camera.Right, camera.Front));
+    return camera;
+}
@@ -0,0 +1,275 @@
+#include "Frustum.hpp"
+#include "JobSystem.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CULL_SSE 1
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection) {
+    // glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    const glm::mat4& m = viewProjection;
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum frustum;
+    frustum.planes[PLANE_LEFT] = row3 + row0;
+    frustum.planes[PLANE_RIGHT] = row3 - row0;
+    frustum.planes[PLANE_BOTTOM] = row3 + row1;
+    frustum.planes[PLANE_TOP] = row3 - row1;
+    frustum.planes[PLANE_NEAR] = row3 + row2;
+    frustum.planes[PLANE_FAR] = row3 - row2;
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+    for (const glm::vec4& plane : planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SphereBounds::clear() {
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+}
+
+void SphereBounds::reserve(size_t count) {
+    centerX.reserve(count);
+    centerY.reserve(count);
+    centerZ.reserve(count);
+    radius.reserve(count);
+}
+
+void SphereBounds::push(const glm::vec3& center, float sphereRadius) {
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    radius.push_back(sphereRadius);
+}
+
+void SphereBounds::pushTransformed(const glm::mat4& world, const glm::vec3& center, float sphereRadius) {
+    float scale2 = std::max({ glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+                              glm::dot(glm::vec3(world[1]), glm::vec3(world[1])),
+                              glm::dot(glm::vec3(world[2]), glm::vec3(world[2])) });
+    push(glm::vec3(world * glm::vec4(center, 1.0f)), sphereRadius * std::sqrt(scale2));
+}
+
+void BoxBounds::clear() {
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+}
+
+void BoxBounds::reserve(size_t count) {
+    centerX.reserve(count);
+    centerY.reserve(count);
+    centerZ.reserve(count);
+    extentX.reserve(count);
+    extentY.reserve(count);
+    extentZ.reserve(count);
+}
+
+void BoxBounds::resize(size_t count) {
+    centerX.resize(count);
+    centerY.resize(count);
+    centerZ.resize(count);
+    extentX.resize(count);
+    extentY.resize(count);
+    extentZ.resize(count);
+}
+
+void BoxBounds::push(const glm::vec3& center, const glm::vec3& halfExtent) {
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    extentX.push_back(halfExtent.x);
+    extentY.push_back(halfExtent.y);
+    extentZ.push_back(halfExtent.z);
+}
+
+// each world axis gathers |column| contributions from every local axis (Arvo)
+static glm::vec3 transformedExtent(const glm::mat4& world, const glm::vec3& halfExtent) {
+    return glm::abs(glm::vec3(world[0])) * halfExtent.x
+         + glm::abs(glm::vec3(world[1])) * halfExtent.y
+         + glm::abs(glm::vec3(world[2])) * halfExtent.z;
+}
+
+void BoxBounds::pushTransformed(const glm::mat4& world, const glm::vec3& center, const glm::vec3& halfExtent) {
+    push(glm::vec3(world * glm::vec4(center, 1.0f)), transformedExtent(world, halfExtent));
+}
+
+void BoxBounds::setTransformed(size_t index, const glm::mat4& world, const glm::vec3& center, const glm::vec3& halfExtent) {
+    glm::vec3 worldCenter(world * glm::vec4(center, 1.0f));
+    glm::vec3 extent = transformedExtent(world, halfExtent);
+    centerX[index] = worldCenter.x;
+    centerY[index] = worldCenter.y;
+    centerZ[index] = worldCenter.z;
+    extentX[index] = extent.x;
+    extentY[index] = extent.y;
+    extentZ[index] = extent.z;
+}
+
+namespace {
+
+// sets at least this large are culled on the job system, in blocks of CULL_BLOCK volumes
+const size_t PARALLEL_CULL_MIN = 32768;
+const size_t CULL_BLOCK = 8192;
+
+// sphere: outside when it lies entirely behind some plane, dot(n, c) + d < -r
+uint32_t* cullSpheres(const Frustum& frustum, const SphereBounds& bounds, size_t begin, size_t end, uint32_t* out) {
+    size_t i = begin;
+
+#ifdef CULL_SSE
+    __m128 nx[Frustum::PLANE_COUNT], ny[Frustum::PLANE_COUNT], nz[Frustum::PLANE_COUNT], nd[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; ++p) {
+        nx[p] = _mm_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm_set1_ps(frustum.planes[p].z);
+        nd[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_loadu_ps(&bounds.radius[i]));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < Frustum::PLANE_COUNT; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz[p], cz), nd[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        for (int mask = _mm_movemask_ps(inside); mask; mask &= mask - 1) {
+            *out++ = (uint32_t)(i + __builtin_ctz(mask));
+        }
+    }
+#endif
+
+    for (; i < end; ++i) {
+        glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes) {
+            inside &= glm::dot(glm::vec3(plane), center) + plane.w >= -bounds.radius[i];
+        }
+        if (inside) {
+            *out++ = (uint32_t)i;
+        }
+    }
+    return out;
+}
+
+// box: outside when even its corner furthest along the plane normal is behind the plane,
+// dot(n, c) + d < -(|nx| ex + |ny| ey + |nz| ez)
+uint32_t* cullBoxes(const Frustum& frustum, const BoxBounds& bounds, size_t begin, size_t end, uint32_t* out) {
+    size_t i = begin;
+
+#ifdef CULL_SSE
+    __m128 nx[Frustum::PLANE_COUNT], ny[Frustum::PLANE_COUNT], nz[Frustum::PLANE_COUNT], nd[Frustum::PLANE_COUNT];
+    __m128 ax[Frustum::PLANE_COUNT], ay[Frustum::PLANE_COUNT], az[Frustum::PLANE_COUNT];
+    for (int p = 0; p < Frustum::PLANE_COUNT; ++p) {
+        nx[p] = _mm_set1_ps(frustum.planes[p].x);
+        ny[p] = _mm_set1_ps(frustum.planes[p].y);
+        nz[p] = _mm_set1_ps(frustum.planes[p].z);
+        nd[p] = _mm_set1_ps(frustum.planes[p].w);
+        ax[p] = _mm_set1_ps(std::fabs(frustum.planes[p].x));
+        ay[p] = _mm_set1_ps(std::fabs(frustum.planes[p].y));
+        az[p] = _mm_set1_ps(std::fabs(frustum.planes[p].z));
+    }
+    for (; i + 4 <= end; i += 4) {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < Frustum::PLANE_COUNT; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz[p], cz), nd[p]));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        for (int mask = _mm_movemask_ps(inside); mask; mask &= mask - 1) {
+            *out++ = (uint32_t)(i + __builtin_ctz(mask));
+        }
+    }
+#endif
+
+    for (; i < end; ++i) {
+        glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+        glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes) {
+            glm::vec3 normal(plane);
+            inside &= glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) >= 0.0f;
+        }
+        if (inside) {
+            *out++ = (uint32_t)i;
+        }
+    }
+    return out;
+}
+
+// Runs kernel(begin, end, out) over [0, count), which writes the passing indices at `out` and
+// returns the end of what it wrote. Large sets are cut into blocks culled in parallel, each
+// into its own part of `visible`, then packed together in order.
+template <typename Kernel>
+void cullAll(size_t count, std::vector<uint32_t>& visible, std::vector<uint32_t>& blockVisible,
+             JobSystem* jobs, const Kernel& kernel) {
+    visible.resize(count);
+    uint32_t* out = visible.data();
+    if (!jobs || count < PARALLEL_CULL_MIN) {
+        visible.resize((size_t)(kernel(0, count, out) - out));
+        return;
+    }
+
+    const uint32_t blockCount = (uint32_t)((count + CULL_BLOCK - 1) / CULL_BLOCK);
+    blockVisible.resize(blockCount);
+    jobs->parallelFor(blockCount, 1, [&](uint32_t first, uint32_t last) {
+        for (uint32_t block = first; block < last; ++block) {
+            size_t begin = block * CULL_BLOCK;
+            size_t end = std::min(count, begin + CULL_BLOCK);
+            blockVisible[block] = (uint32_t)(kernel(begin, end, out + begin) - (out + begin));
+        }
+    });
+    uint32_t* packed = out + blockVisible[0];
+    for (uint32_t block = 1; block < blockCount; ++block) {
+        std::memmove(packed, out + block * CULL_BLOCK, blockVisible[block] * sizeof(uint32_t));
+        packed += blockVisible[block];
+    }
+    visible.resize((size_t)(packed - out));
+}
+
+} // namespace
+
+void FrustumCuller::cull(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint32_t>& visible, JobSystem* jobs) {
+    cullAll(bounds.size(), visible, blockVisible, jobs, [&](size_t begin, size_t end, uint32_t* out) {
+        return cullSpheres(frustum, bounds, begin, end, out);
+    });
+    stats.tested += (uint32_t)bounds.size();
+    stats.visible += (uint32_t)visible.size();
+}
+
+void FrustumCuller::cull(const Frustum& frustum, const BoxBounds& bounds, std::vector<uint32_t>& visible, JobSystem* jobs) {
+    cullAll(bounds.size(), visible, blockVisible, jobs, [&](size_t begin, size_t end, uint32_t* out) {
+        return cullBoxes(frustum, bounds, begin, end, out);
+    });
+    stats.tested += (uint32_t)bounds.size();
+    stats.visible += (uint32_t)visible.size();
+}
@@ -0,0 +1,73 @@
+#include "GLStateCache.hpp"
+#include <glad/glad.h>
+
+GLStateCache::GLStateCache() {
+    invalidate();
+}
+
+void GLStateCache::useProgram(GLuint program) {
+    if (this->program == program) {
+        ++stats.avoided;
+        return;
+    }
+    glUseProgram(program);
+    this->program = program;
+    ++stats.programBinds;
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLuint texture, GLenum target) {
+    if (unit < MAX_TEXTURE_UNITS && textures[unit] == texture && targets[unit] == target) {
+        ++stats.avoided;
+        return;
+    }
+    if (activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+    if (unit < MAX_TEXTURE_UNITS) {
+        textures[unit] = texture;
+        targets[unit] = target;
+    }
+    ++stats.textureBinds;
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+    if (this->vao == vao) {
+        ++stats.avoided;
+        return;
+    }
+    glBindVertexArray(vao);
+    this->vao = vao;
+    ++stats.vertexArrayBinds;
+}
+
+void GLStateCache::deleteTexture(GLuint texture) {
+    if (texture == 0) {
+        return;
+    }
+    glDeleteTextures(1, &texture);
+    for (GLuint i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        if (textures[i] == texture) {
+            textures[i] = 0;
+        }
+    }
+}
+
+void GLStateCache::invalidate() {
+    program = UNKNOWN;
+    activeUnit = UNKNOWN;
+    for (GLuint i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+        textures[i] = UNKNOWN;
+        targets[i] = GL_TEXTURE_2D;
+    }
+    vao = UNKNOWN;
+}
+
+const GLStateCache::Stats& GLStateCache::getStats() const {
+    return stats;
+}
+
+void GLStateCache::resetStats() {
+    stats = Stats();
+}
@@ -0,0 +1,28 @@
+#include "InstanceAttributes.hpp"
+#include <cstddef>
+
+InstanceData makeInstanceData(const glm::mat4& model, uint32_t material) {
+    return InstanceData{ model, glm::transpose(glm::inverse(glm::mat3(model))), material };
+}
+
+void enableInstanceAttributes() {
+    for (GLuint location = INSTANCE_ATTRIBUTE_LOCATION; location < INSTANCE_ATTRIBUTE_LOCATION + 8; ++location) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+void bindInstanceAttributes(GLuint buffer, GLintptr offset) {
+    // model matrix as 4 x vec4, normal matrix as 3 x vec3, material as an integer
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint c = 0; c < 4; ++c) {
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE_LOCATION + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+            (void*)(offset + offsetof(InstanceData, model) + c * sizeof(glm::vec4)));
+    }
+    for (GLuint c = 0; c < 3; ++c) {
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE_LOCATION + 4 + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+            (void*)(offset + offsetof(InstanceData, normalMatrix) + c * sizeof(glm::vec3)));
+    }
+    glVertexAttribIPointer(INSTANCE_ATTRIBUTE_LOCATION + 7, 1, GL_UNSIGNED_INT, sizeof(InstanceData),
+        (void*)(offset + offsetof(InstanceData, material)));
+}
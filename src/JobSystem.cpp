@@ -0,0 +1,307 @@
+#include "JobSystem.hpp"
+#include <cassert>
+#include <cstdlib>
+
+#include "utils/logger.h"
+
+namespace {
+
+// rounds of stealing before an idle worker goes to sleep
+const int IDLE_SPINS = 64;
+// unset on threads that are not part of a JobSystem
+const unsigned NOT_A_JOB_THREAD = ~0u;
+
+thread_local const JobSystem* threadOwner = nullptr;
+thread_local unsigned threadIndex = NOT_A_JOB_THREAD;
+
+// Chase-Lev deque with the C11 orderings of Le et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models" (2013). The owner pushes and pops at the bottom; thieves take from the
+// top. Fixed capacity: push() fails instead of growing.
+class WorkStealingQueue {
+public:
+    static constexpr int64_t CAPACITY = JobSystem::JOB_POOL_SIZE;
+
+    // owner only
+    bool push(Job* job) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY) {
+            return false;
+        }
+        // release stores rather than the paper's release fence: same cost on x86, and visible
+        // to ThreadSanitizer, which does not model fences
+        buffer[b & (CAPACITY - 1)].store(job, std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // owner only; newest first
+    Job* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr; // empty
+        }
+        Job* job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b) {
+            // the last job: race the thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                job = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    // any thread; oldest first
+    Job* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        Job* job = buffer[t & (CAPACITY - 1)].load(std::memory_order_acquire);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr; // lost to another thief or the owner
+        }
+        return job;
+    }
+
+private:
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Job*> buffer[CAPACITY];
+};
+
+} // namespace
+
+struct JobSystem::ThreadState {
+    WorkStealingQueue queue;
+    std::unique_ptr<Job[]> pool{ new Job[JOB_POOL_SIZE] };
+    uint32_t poolNext = 0;
+    uint32_t random;                            // xorshift state for picking victims
+    std::atomic<uint32_t> executed{0};
+    std::atomic<uint32_t> stolen{0};
+
+    explicit ThreadState(unsigned index) : random(index * 2654435761u + 1u) {}
+};
+
+// thread states: clients first, then workers
+JobSystem::JobSystem(unsigned workerCount, unsigned clientCount) : clientCount(std::max(clientCount, 1u)) {
+    if (workerCount == 0) {
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+    for (unsigned i = 0; i < this->clientCount + workerCount; ++i) {
+        threads.push_back(std::unique_ptr<ThreadState>(new ThreadState(i)));
+    }
+    threadOwner = this;
+    threadIndex = 0;
+    for (unsigned i = this->clientCount; i < threads.size(); ++i) {
+        workers.emplace_back(&JobSystem::workerMain, this, i);
+    }
+}
+
+void JobSystem::attach() {
+    assert(threadOwner != this && "thread already attached");
+    unsigned index = attachedClients.fetch_add(1);
+    assert(index < clientCount && "more client threads than the system was built for");
+    threadOwner = this;
+    threadIndex = index;
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping.store(true);
+    }
+    wakeUp.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    if (threadOwner == this) {
+        threadOwner = nullptr;
+        threadIndex = NOT_A_JOB_THREAD;
+    }
+}
+
+unsigned JobSystem::getThreadIndex() const {
+    assert(threadOwner == this && "job system used from a thread outside it");
+    return threadIndex;
+}
+
+JobSystem::ThreadState& JobSystem::current() {
+    assert(threadOwner == this && "job system used from a thread outside it");
+    return *threads[threadIndex];
+}
+
+Job* JobSystem::allocate(void (*invoke)(Job&), JobHandle parent) {
+    ThreadState& thread = current();
+    Job* job = &thread.pool[thread.poolNext++ & (JOB_POOL_SIZE - 1)];
+    if (job->unfinished.load(std::memory_order_acquire) != 0) {
+        // handing the slot out again would overwrite a job someone still runs or waits on
+        LOGF(FATAL, "Job pool of thread %u wrapped onto an unfinished job: more than %u jobs in flight",
+            threadIndex, JOB_POOL_SIZE);
+        std::abort();
+    }
+
+    job->invoke = invoke;
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->blockers.store(1, std::memory_order_relaxed);
+    job->successorCount = 0;
+    if (parent) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::addDependency(JobHandle job, JobHandle prerequisite) {
+    while (prerequisite->successorLock.test_and_set(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    // finish() closes the list under the lock before the job counts as done
+    if (prerequisite->successorCount != Job::SUCCESSORS_CLOSED) {
+        assert(prerequisite->successorCount < Job::MAX_SUCCESSORS);
+        job->blockers.fetch_add(1, std::memory_order_relaxed);
+        prerequisite->successors[prerequisite->successorCount++] = job;
+    }
+    prerequisite->successorLock.clear(std::memory_order_release);
+}
+
+void JobSystem::run(JobHandle job) {
+    release(current(), job);
+}
+
+void JobSystem::release(ThreadState& thread, Job* job) {
+    if (job->blockers.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return; // still waiting on a prerequisite
+    }
+    if (!thread.queue.push(job)) {
+        execute(thread, job); // queue full: run it here instead
+        return;
+    }
+    queued.fetch_add(1);
+    if (sleepers.load() > 0) {
+        // a worker between checking `queued` and sleeping holds the mutex
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wakeUp.notify_one();
+    }
+}
+
+void JobSystem::wait(JobHandle job) {
+    ThreadState& thread = current();
+    while (!isFinished(job)) {
+        if (Job* next = findJob(thread)) {
+            execute(thread, next);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+Job* JobSystem::findJob(ThreadState& thread) {
+    Job* job = thread.queue.pop();
+    if (!job && threads.size() > 1) {
+        // start at a random victim so thieves spread out
+        thread.random ^= thread.random << 13;
+        thread.random ^= thread.random >> 17;
+        thread.random ^= thread.random << 5;
+        size_t start = thread.random % threads.size();
+        for (size_t i = 0; i < threads.size() && !job; ++i) {
+            ThreadState& victim = *threads[(start + i) % threads.size()];
+            if (&victim != &thread) {
+                job = victim.queue.steal();
+            }
+        }
+        if (job) {
+            thread.stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (job) {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::execute(ThreadState& thread, Job* job) {
+    job->invoke(*job);
+    thread.executed.fetch_add(1, std::memory_order_relaxed);
+    finish(thread, job);
+}
+
+void JobSystem::finish(ThreadState& thread, Job* job) {
+    while (job) {
+        // Not the last unit: drop it and leave the rest to whoever finishes last. The last one
+        // is ours alone (children are added while the job still runs), so it is not dropped
+        // until the job has been read: once `unfinished` is 0 the owner may reuse the slot.
+        int32_t unfinished = job->unfinished.load(std::memory_order_acquire);
+        while (unfinished > 1 && !job->unfinished.compare_exchange_weak(unfinished, unfinished - 1,
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+        }
+        if (unfinished > 1) {
+            return;
+        }
+
+        Job* successors[Job::MAX_SUCCESSORS];
+        while (job->successorLock.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        uint32_t successorCount = job->successorCount;
+        std::copy(job->successors, job->successors + successorCount, successors);
+        job->successorCount = Job::SUCCESSORS_CLOSED;
+        job->successorLock.clear(std::memory_order_release);
+        Job* parent = job->parent;
+
+        job->unfinished.store(0, std::memory_order_release);
+        for (uint32_t i = 0; i < successorCount; ++i) {
+            release(thread, successors[i]);
+        }
+        job = parent;
+    }
+}
+
+void JobSystem::workerMain(unsigned index) {
+    threadOwner = this;
+    threadIndex = index;
+    ThreadState& thread = *threads[index];
+
+    int idle = 0;
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (Job* job = findJob(thread)) {
+            execute(thread, job);
+            idle = 0;
+            continue;
+        }
+        if (++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // nothing anywhere: sleep until a job is queued
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepers.fetch_add(1);
+        wakeUp.wait(lock, [this] { return stopping.load() || queued.load() > 0; });
+        sleepers.fetch_sub(1);
+        idle = 0;
+    }
+}
+
+JobSystem::Stats JobSystem::getStats() const {
+    Stats stats;
+    for (const std::unique_ptr<ThreadState>& thread : threads) {
+        stats.executed += thread->executed.load(std::memory_order_relaxed);
+        stats.stolen += thread->stolen.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void JobSystem::resetStats() {
+    for (const std::unique_ptr<ThreadState>& thread : threads) {
+        thread->executed.store(0, std::memory_order_relaxed);
+        thread->stolen.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,271 @@
+#include "MaterialTable.hpp"
+#include <algorithm>
+#include <cassert>
+#include "MipCopy.hpp"
+#include "utils/logger.h"
+
+namespace {
+
+// layers of a newly started array; it doubles from there
+const uint32_t INITIAL_ARRAY_LAYERS = 4;
+// every array's layer 0, standing in for missing maps
+const uint32_t WHITE_LAYER = 0;
+
+uint32_t levelCount(int width, int height) {
+    uint32_t levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2) {
+        ++levels;
+    }
+    return levels;
+}
+
+bool isUsable(const AsyncTextureHandle& texture) {
+    return texture && texture->isResident();
+}
+
+// nothing more will happen to it: resident, failed or absent
+bool isSettled(const AsyncTextureHandle& texture) {
+    return !texture || texture->isResident() || texture->hasFailed();
+}
+
+} // namespace
+
+MaterialTable::MaterialTable(GLStateCache& state) : state(state) {
+    glGenBuffers(1, &ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, MAX_MATERIALS * sizeof(MaterialConstants), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIALS_BINDING, ubo);
+
+    glGenFramebuffers(1, &readFramebuffer);
+    glGenFramebuffers(1, &drawFramebuffer);
+
+    // array 0: the placeholder every material uses until its maps are resident
+    findArray(1, 1);
+}
+
+MaterialTable::~MaterialTable() {
+    for (TextureArray& array : arrays) {
+        state.deleteTexture(array.texture);
+    }
+    glDeleteFramebuffers(1, &readFramebuffer);
+    glDeleteFramebuffers(1, &drawFramebuffer);
+    glDeleteBuffers(1, &ubo);
+}
+
+MaterialId MaterialTable::create(AsyncTextureHandle diffuse, AsyncTextureHandle specular, float shininess) {
+    assert(materials.size() < MAX_MATERIALS && "material table full");
+    if (materials.size() >= MAX_MATERIALS) {
+        LOGF(ERROR, "material table full (%u materials); reusing the last one", MAX_MATERIALS);
+        return (MaterialId)(materials.size() - 1);
+    }
+    Material material;
+    material.diffuse = std::move(diffuse);
+    material.specular = std::move(specular);
+    materials.push_back(std::move(material));
+    constants.push_back(MaterialConstants{ WHITE_LAYER, WHITE_LAYER, shininess, 0.0f });
+
+    dirtyBegin = std::min(dirtyBegin, constants.size() - 1);
+    dirtyEnd = constants.size();
+    return (MaterialId)(materials.size() - 1);
+}
+
+void MaterialTable::update() {
+    bool copied = false;
+    for (size_t i = 0; i < materials.size(); ++i) {
+        Material& material = materials[i];
+        if (material.placed || !isSettled(material.diffuse) || !isSettled(material.specular)) {
+            continue;
+        }
+        // the diffuse map decides the array; without one the material stays on the placeholder
+        MaterialConstants& entry = constants[i];
+        if (isUsable(material.diffuse)) {
+            const AsyncTexture& diffuse = *material.diffuse;
+            material.array = findArray(diffuse.getWidth(), diffuse.getHeight());
+            entry.diffuseLayer = addLayer(material.array, diffuse);
+            if (isUsable(material.specular)) {
+                entry.specularLayer = addLayer(material.array, *material.specular);
+            }
+            copied = true;
+        }
+        material.placed = true;
+        // the layers are copies; the cache may evict the originals when nothing else holds them
+        material.diffuse.reset();
+        material.specular.reset();
+
+        dirtyBegin = std::min(dirtyBegin, i);
+        dirtyEnd = std::max(dirtyEnd, i + 1);
+    }
+
+    if (copied) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // only arrays that took a map with too short a chain to copy
+        for (TextureArray& array : arrays) {
+            if (array.mipsStale) {
+                regenerateMips(state, array.texture, GL_TEXTURE_2D_ARRAY);
+                array.mipsStale = false;
+            }
+        }
+    }
+
+    if (dirtyBegin < dirtyEnd) {
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, dirtyBegin * sizeof(MaterialConstants),
+            (dirtyEnd - dirtyBegin) * sizeof(MaterialConstants), &constants[dirtyBegin]);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirtyBegin = constants.size();
+        dirtyEnd = 0;
+    }
+}
+
+uint32_t MaterialTable::findArray(int width, int height) {
+    GLint maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    for (size_t i = 1; i < arrays.size(); ++i) {
+        const TextureArray& array = arrays[i];
+        // room for both of the material's maps, or for growing to take them
+        if (array.width == width && array.height == height && (array.layers + 2 <= array.capacity || array.capacity < (uint32_t)maxLayers)) {
+            return (uint32_t)i;
+        }
+    }
+
+    TextureArray array;
+    array.width = width;
+    array.height = height;
+    array.capacity = arrays.empty() ? 1 : INITIAL_ARRAY_LAYERS;
+    glGenTextures(1, &array.texture);
+    allocateLevels(array.texture, width, height, array.capacity);
+
+    // layer 0 white at every level, standing in for missing maps
+    const GLfloat white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    for (uint32_t level = 0; level < levelCount(width, height); ++level) {
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, (GLint)level, WHITE_LAYER);
+        glClearBufferfv(GL_COLOR, 0, white);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    array.layers = 1;
+
+    arrays.push_back(array);
+    return (uint32_t)(arrays.size() - 1);
+}
+
+uint32_t MaterialTable::addLayer(uint32_t index, const AsyncTexture& texture) {
+    TextureArray& array = arrays[index];
+    if (array.layers == array.capacity) {
+        grow(array);
+    }
+    if (array.layers == array.capacity) {
+        LOGF(WARNING, "material array %dx%d is at the %u-layer limit; using white", array.width, array.height, array.capacity);
+        return WHITE_LAYER;
+    }
+
+    const int width = texture.getWidth();
+    const int height = texture.getHeight();
+    const int levels = std::max(texture.getLevels(), 1);
+    const GLuint source = texture.isCompressed() ? decompressedCopy(texture.getID(), levels) : texture.getID();
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+    if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOGF(WARNING, "texture %u can't be read into a material array; using white", texture.getID());
+        if (source != texture.getID()) {
+            state.deleteTexture(source);
+        }
+        return WHITE_LAYER;
+    }
+    uint32_t layer = array.layers++;
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    const auto levelSize = [&](int level) {
+        return glm::ivec2(std::max(array.width >> level, 1), std::max(array.height >> level, 1));
+    };
+    const auto blit = [&](int level, glm::ivec2 sourceSize, glm::ivec2 size, GLenum filter) {
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, (GLint)level, (GLint)layer);
+        glBlitFramebuffer(0, 0, sourceSize.x, sourceSize.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, filter);
+    };
+    if (!copyMipChain(source, width, height, levels, (int)levelCount(array.width, array.height), levelSize, blit)) {
+        array.mipsStale = true; // update() regenerates the array's mips
+    }
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    if (source != texture.getID()) {
+        state.deleteTexture(source);
+    }
+    return layer;
+}
+
+// An RGBA8 copy of the first `levels` levels of a block-compressed texture, which can't be
+// attached to a framebuffer for the blit. Reads back through the CPU, once per map when its
+// material is placed.
+GLuint MaterialTable::decompressedCopy(GLuint texture, int levels) {
+    GLint internalFormat = 0;
+    GLuint copy = 0;
+    glGenTextures(1, &copy);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    std::vector<unsigned char> pixels;
+    for (int level = 0; level < levels; ++level) {
+        GLint width = 0, height = 0;
+        state.bindTexture(0, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        pixels.resize((size_t)width * height * 4);
+        glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        // single-channel maps are swizzled to grey when sampled, but read back as red
+        if (internalFormat == GL_COMPRESSED_RED_RGTC1) {
+            for (size_t i = 0; i < pixels.size(); i += 4) {
+                pixels[i + 1] = pixels[i + 2] = pixels[i];
+            }
+        }
+        state.bindTexture(0, copy);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    return copy;
+}
+
+void MaterialTable::grow(TextureArray& array) {
+    GLint maxLayers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    uint32_t capacity = std::min(array.capacity * 2, (uint32_t)maxLayers);
+    if (capacity <= array.capacity) {
+        return;
+    }
+
+    GLuint grown = 0;
+    glGenTextures(1, &grown);
+    allocateLevels(grown, array.width, array.height, capacity);
+
+    // every level of every layer, as is
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    for (uint32_t level = 0; level < levelCount(array.width, array.height); ++level) {
+        const int width = std::max(array.width >> level, 1);
+        const int height = std::max(array.height >> level, 1);
+        for (uint32_t layer = 0; layer < array.layers; ++layer) {
+            glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.texture, (GLint)level, (GLint)layer);
+            glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, grown, (GLint)level, (GLint)layer);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+    }
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0, 0);
+
+    state.deleteTexture(array.texture);
+    array.texture = grown;
+    array.capacity = capacity;
+    LOGF(DEBUG, "material array %dx%d grown to %u layers", array.width, array.height, capacity);
+}
+
+void MaterialTable::allocateLevels(GLuint texture, int width, int height, uint32_t layers) {
+    const uint32_t levels = levelCount(width, height);
+    state.bindTexture(0, texture, GL_TEXTURE_2D_ARRAY);
+    for (uint32_t level = 0; level < levels; ++level) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, GL_RGBA8, std::max(width >> level, 1), std::max(height >> level, 1),
+            (GLsizei)layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
@@ -0,0 +1,236 @@
+#include "MeshPool.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <unordered_map>
+#include "utils/hash.h"
+#include "utils/logger.h"
+
+namespace {
+
+// attribute locations and sizes, in floats, per format; 0 ends the list
+struct FormatLayout {
+    uint32_t floatsPerVertex;
+    GLint components[3];
+};
+
+const FormatLayout FORMAT_LAYOUTS[VERTEX_FORMAT_COUNT] = {
+    { 8, { 3, 3, 2 } },     // VERTEX_P3N3T2
+    { 6, { 3, 3, 0 } },     // VERTEX_P3N3
+    { 5, { 3, 2, 0 } },     // VERTEX_P3T2
+};
+
+// first allocation of an arena, in vertices and indices; it doubles from there
+const uint32_t INITIAL_VERTEX_CAPACITY = 16u << 10;
+const uint32_t INITIAL_INDEX_CAPACITY = 48u << 10;
+
+// Indexes a triangle list by merging bit-identical vertices. On a hash collision the second
+// vertex is simply kept, which costs a duplicate and nothing else.
+void weldVertices(const float* vertices, uint32_t vertexCount, uint32_t floats,
+                  std::vector<float>& welded, std::vector<uint32_t>& indices) {
+    std::unordered_map<uint64_t, uint32_t> seen;
+    seen.reserve(vertexCount);
+    welded.reserve((size_t)vertexCount * floats);
+    indices.reserve(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        const float* vertex = vertices + (size_t)v * floats;
+        auto inserted = seen.emplace(fnv1a64(vertex, floats * sizeof(float)), (uint32_t)(welded.size() / floats));
+        uint32_t index = inserted.first->second;
+        if (!inserted.second && std::memcmp(&welded[(size_t)index * floats], vertex, floats * sizeof(float)) != 0) {
+            index = (uint32_t)(welded.size() / floats);
+            inserted.second = true;
+        }
+        if (inserted.second) {
+            welded.insert(welded.end(), vertex, vertex + floats);
+        }
+        indices.push_back(index);
+    }
+}
+
+// Moves a buffer's contents into a new one of `newBytes` and deletes the old one. Uses the
+// copy targets so no vertex or element binding is disturbed.
+GLuint regrowBuffer(GLuint buffer, size_t oldBytes, size_t newBytes) {
+    GLuint grown = 0;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)newBytes, nullptr, GL_STATIC_DRAW);
+    if (buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)oldBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return grown;
+}
+
+void uploadRange(GLuint buffer, size_t offset, size_t bytes, const void* data) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+} // namespace
+
+bool MeshPool::FreeList::allocate(uint32_t size, uint32_t& offset) {
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        if (ranges[i].size < size) {
+            continue;
+        }
+        offset = ranges[i].offset;
+        ranges[i].offset += size;
+        ranges[i].size -= size;
+        if (ranges[i].size == 0) {
+            ranges.erase(ranges.begin() + i);
+        }
+        return true;
+    }
+    return false;
+}
+
+void MeshPool::FreeList::release(uint32_t offset, uint32_t size) {
+    auto next = std::lower_bound(ranges.begin(), ranges.end(), offset,
+        [](const Range& range, uint32_t value) { return range.offset < value; });
+    // merge with the range ending here and/or the one starting right after
+    bool joinsPrevious = next != ranges.begin() && (next - 1)->offset + (next - 1)->size == offset;
+    bool joinsNext = next != ranges.end() && offset + size == next->offset;
+    if (joinsPrevious && joinsNext) {
+        (next - 1)->size += size + next->size;
+        ranges.erase(next);
+    } else if (joinsPrevious) {
+        (next - 1)->size += size;
+    } else if (joinsNext) {
+        next->offset = offset;
+        next->size += size;
+    } else {
+        ranges.insert(next, Range{ offset, size });
+    }
+}
+
+MeshPool::~MeshPool() {
+    for (Arena& arena : arenas) {
+        glDeleteVertexArrays(1, &arena.vao);
+        glDeleteBuffers(1, &arena.vertexBuffer);
+        glDeleteBuffers(1, &arena.indexBuffer);
+    }
+}
+
+uint32_t MeshPool::getFloatsPerVertex(VertexFormat format) {
+    return FORMAT_LAYOUTS[format].floatsPerVertex;
+}
+
+MeshRange MeshPool::allocate(VertexFormat format, const float* vertices, uint32_t vertexCount,
+                             const uint32_t* indices, uint32_t indexCount) {
+    const uint32_t floats = getFloatsPerVertex(format);
+    std::vector<float> welded;
+    std::vector<uint32_t> generated;
+    if (!indices) {
+        weldVertices(vertices, vertexCount, floats, welded, generated);
+        vertices = welded.data();
+        vertexCount = (uint32_t)(welded.size() / floats);
+        indices = generated.data();
+        indexCount = (uint32_t)generated.size();
+    }
+    MeshRange range;
+    range.format = format;
+    if (vertexCount == 0 || indexCount == 0) {
+        return range;
+    }
+
+    Arena& arena = arenas[format];
+    uint32_t vertexOffset = 0, indexOffset = 0;
+    if (!arena.freeVertices.allocate(vertexCount, vertexOffset)) {
+        reserve(format, vertexCount, 0);
+        arena.freeVertices.allocate(vertexCount, vertexOffset);
+    }
+    if (!arena.freeIndices.allocate(indexCount, indexOffset)) {
+        reserve(format, 0, indexCount);
+        arena.freeIndices.allocate(indexCount, indexOffset);
+    }
+
+    const size_t vertexSize = floats * sizeof(float);
+    uploadRange(arena.vertexBuffer, vertexOffset * vertexSize, vertexCount * vertexSize, vertices);
+    uploadRange(arena.indexBuffer, indexOffset * sizeof(uint32_t), indexCount * sizeof(uint32_t), indices);
+
+    ++arena.meshes;
+    arena.usedVertices += vertexCount;
+    arena.usedIndices += indexCount;
+
+    range.baseVertex = (GLint)vertexOffset;
+    range.firstIndex = indexOffset;
+    range.indexCount = (GLsizei)indexCount;
+    range.vertexCount = vertexCount;
+    return range;
+}
+
+void MeshPool::free(const MeshRange& range) {
+    if (range.isNull()) {
+        return;
+    }
+    Arena& arena = arenas[range.format];
+    assert(arena.meshes > 0);
+    arena.freeVertices.release((uint32_t)range.baseVertex, range.vertexCount);
+    arena.freeIndices.release(range.firstIndex, (uint32_t)range.indexCount);
+    --arena.meshes;
+    arena.usedVertices -= range.vertexCount;
+    arena.usedIndices -= (uint32_t)range.indexCount;
+}
+
+void MeshPool::reserve(VertexFormat format, uint32_t vertices, uint32_t indices) {
+    Arena& arena = arenas[format];
+    const size_t vertexSize = getFloatsPerVertex(format) * sizeof(float);
+
+    // doubling covers any tail already free at the end, so the request fits afterwards
+    if (vertices) {
+        uint32_t capacity = std::max({ arena.vertexCapacity * 2, arena.vertexCapacity + vertices, INITIAL_VERTEX_CAPACITY });
+        arena.vertexBuffer = regrowBuffer(arena.vertexBuffer, arena.vertexCapacity * vertexSize, capacity * vertexSize);
+        arena.freeVertices.release(arena.vertexCapacity, capacity - arena.vertexCapacity);
+        arena.vertexCapacity = capacity;
+    }
+    if (indices) {
+        uint32_t capacity = std::max({ arena.indexCapacity * 2, arena.indexCapacity + indices, INITIAL_INDEX_CAPACITY });
+        arena.indexBuffer = regrowBuffer(arena.indexBuffer, arena.indexCapacity * sizeof(uint32_t), capacity * sizeof(uint32_t));
+        arena.freeIndices.release(arena.indexCapacity, capacity - arena.indexCapacity);
+        arena.indexCapacity = capacity;
+    }
+    if (arena.meshes > 0) {
+        LOGF(DEBUG, "mesh pool format %d grown to %u vertices, %u indices", (int)format, arena.vertexCapacity, arena.indexCapacity);
+    }
+
+    if (!arena.vao) {
+        glGenVertexArrays(1, &arena.vao);
+    }
+    state.bindVertexArray(arena.vao);
+    bindAttributes(format, arena.vertexBuffer, arena.indexBuffer);
+    state.bindVertexArray(0);
+}
+
+void MeshPool::bindAttributes(VertexFormat format) const {
+    bindAttributes(format, arenas[format].vertexBuffer, arenas[format].indexBuffer);
+}
+
+void MeshPool::bindAttributes(VertexFormat format, GLuint vertexBuffer, GLuint indexBuffer) const {
+    const FormatLayout& layout = FORMAT_LAYOUTS[format];
+    const GLsizei stride = (GLsizei)(layout.floatsPerVertex * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    size_t offset = 0;
+    for (GLuint location = 0; location < 3 && layout.components[location]; ++location) {
+        glVertexAttribPointer(location, layout.components[location], GL_FLOAT, GL_FALSE, stride, (void*)(offset * sizeof(float)));
+        glEnableVertexAttribArray(location);
+        offset += layout.components[location];
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+}
+
+MeshPool::Stats MeshPool::getStats() const {
+    Stats stats;
+    for (int format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+        const Arena& arena = arenas[format];
+        const size_t vertexSize = getFloatsPerVertex((VertexFormat)format) * sizeof(float);
+        stats.meshes += arena.meshes;
+        stats.vertexBytes += (uint32_t)(arena.usedVertices * vertexSize);
+        stats.indexBytes += (uint32_t)(arena.usedIndices * sizeof(uint32_t));
+        stats.capacityBytes += (uint32_t)(arena.vertexCapacity * vertexSize + arena.indexCapacity * sizeof(uint32_t));
+    }
+    return stats;
+}
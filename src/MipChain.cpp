@@ -0,0 +1,237 @@
+#include "MipChain.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MIP_SSE 1
+#endif
+
+namespace {
+
+// Texels are filtered as four floats whatever the channel count, so one SSE register holds a
+// texel; absent channels ride along as zeros.
+const int LANES = 4;
+
+// taps of the Kaiser filter, at source texel centres -2.5 .. 2.5 from the destination's
+const int KAISER_TAPS = 6;
+const float KAISER_RADIUS = 3.0f;
+const float KAISER_BETA = 4.0f;
+
+// linear values are encoded back through a table this fine (12 bits beats 8-bit output)
+const int LINEAR_STEPS = 4096;
+
+struct SrgbTables {
+    float toLinear[256];
+    unsigned char fromLinear[LINEAR_STEPS + 1];
+
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            float c = i / 255.0f;
+            toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        for (int i = 0; i <= LINEAR_STEPS; ++i) {
+            float l = (float)i / LINEAR_STEPS;
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            fromLinear[i] = (unsigned char)std::lround(std::min(std::max(c, 0.0f), 1.0f) * 255.0f);
+        }
+    }
+};
+
+const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+// zeroth-order modified Bessel function of the first kind, by its power series
+float besselI0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; k < 20; ++k) {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+struct KaiserWeights {
+    float taps[KAISER_TAPS];
+
+    KaiserWeights() {
+        const float pi = 3.14159265358979f;
+        float total = 0.0f;
+        for (int k = 0; k < KAISER_TAPS; ++k) {
+            // distance in source texels; the sinc is stretched 2x for the halved rate
+            float x = k - 2.5f;
+            float s = x / 2.0f;
+            float sinc = std::sin(pi * s) / (pi * s);
+            float r = x / KAISER_RADIUS;
+            float window = besselI0(KAISER_BETA * std::sqrt(std::max(1.0f - r * r, 0.0f))) / besselI0(KAISER_BETA);
+            taps[k] = sinc * window;
+            total += taps[k];
+        }
+        for (float& tap : taps) {
+            tap /= total;
+        }
+    }
+};
+
+const KaiserWeights& kaiserWeights() {
+    static const KaiserWeights weights;
+    return weights;
+}
+
+int colorChannels(int channels) {
+    return channels == 4 || channels == 2 ? channels - 1 : channels;
+}
+
+// one row of 8-bit texels to LANES floats each, colour channels linearised with `srgb`
+void decodeRow(const unsigned char* src, int width, int channels, bool srgb, float* out) {
+    const float* toLinear = srgbTables().toLinear;
+    const int colors = srgb ? colorChannels(channels) : 0;
+    for (int x = 0; x < width; ++x, src += channels, out += LANES) {
+        for (int c = 0; c < LANES; ++c) {
+            out[c] = c >= channels ? 0.0f : c < colors ? toLinear[src[c]] : src[c] / 255.0f;
+        }
+    }
+}
+
+void encodeRow(const float* in, int width, int channels, bool srgb, unsigned char* dst) {
+    const unsigned char* fromLinear = srgbTables().fromLinear;
+    const int colors = srgb ? colorChannels(channels) : 0;
+    for (int x = 0; x < width; ++x, in += LANES, dst += channels) {
+        for (int c = 0; c < channels; ++c) {
+            // the Kaiser filter's negative lobes can overshoot
+            float v = std::min(std::max(in[c], 0.0f), 1.0f);
+            dst[c] = c < colors ? fromLinear[(int)(v * LINEAR_STEPS + 0.5f)] : (unsigned char)(v * 255.0f + 0.5f);
+        }
+    }
+}
+
+// out[x] = sum of weights[k] * rows[k][x], over whole float rows
+void weightedSum(const float* const* rows, const float* weights, int count, int floats, float* out) {
+    int i = 0;
+#ifdef MIP_SSE
+    for (; i + LANES <= floats; i += LANES) {
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < count; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < floats; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < count; ++k) {
+            sum += weights[k] * rows[k][i];
+        }
+        out[i] = sum;
+    }
+}
+
+void boxLevel(const unsigned char* src, int width, int height, int channels, bool srgb, unsigned char* dst) {
+    const int w = std::max(width / 2, 1);
+    const int h = std::max(height / 2, 1);
+    std::vector<float> rows((size_t)(2 * width + w) * LANES);
+    float* row0 = rows.data();
+    float* row1 = row0 + (size_t)width * LANES;
+    float* out = row1 + (size_t)width * LANES;
+
+    for (int y = 0; y < h; ++y) {
+        int y0 = std::min(y * 2, height - 1);
+        int y1 = std::min(y * 2 + 1, height - 1);
+        decodeRow(src + (size_t)y0 * width * channels, width, channels, srgb, row0);
+        decodeRow(src + (size_t)y1 * width * channels, width, channels, srgb, row1);
+        for (int x = 0; x < w; ++x) {
+            // odd sizes reuse the edge texel
+            const size_t x0 = (size_t)std::min(x * 2, width - 1) * LANES;
+            const size_t x1 = (size_t)std::min(x * 2 + 1, width - 1) * LANES;
+#ifdef MIP_SSE
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+                                    _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+            _mm_storeu_ps(out + (size_t)x * LANES, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+            for (int c = 0; c < LANES; ++c) {
+                out[(size_t)x * LANES + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+            }
+#endif
+        }
+        encodeRow(out, w, channels, srgb, dst + (size_t)y * w * channels);
+    }
+}
+
+// Separable: every source row filtered across into half-width rows, then each destination
+// row from six of those
+void kaiserLevel(const unsigned char* src, int width, int height, int channels, bool srgb, unsigned char* dst) {
+    const int w = std::max(width / 2, 1);
+    const int h = std::max(height / 2, 1);
+    const float* taps = kaiserWeights().taps;
+
+    std::vector<float> source((size_t)width * LANES);
+    std::vector<float> across((size_t)w * height * LANES);
+    for (int y = 0; y < height; ++y) {
+        decodeRow(src + (size_t)y * width * channels, width, channels, srgb, source.data());
+        float* out = &across[(size_t)y * w * LANES];
+        for (int x = 0; x < w; ++x, out += LANES) {
+            const float* texels[KAISER_TAPS];
+            for (int k = 0; k < KAISER_TAPS; ++k) {
+                int sx = std::min(std::max(2 * x - 2 + k, 0), width - 1);
+                texels[k] = &source[(size_t)sx * LANES];
+            }
+            weightedSum(texels, taps, KAISER_TAPS, LANES, out);
+        }
+    }
+
+    std::vector<float> row((size_t)w * LANES);
+    for (int y = 0; y < h; ++y) {
+        const float* rows[KAISER_TAPS];
+        for (int k = 0; k < KAISER_TAPS; ++k) {
+            int sy = std::min(std::max(2 * y - 2 + k, 0), height - 1);
+            rows[k] = &across[(size_t)sy * w * LANES];
+        }
+        weightedSum(rows, taps, KAISER_TAPS, w * LANES, row.data());
+        encodeRow(row.data(), w, channels, srgb, dst + (size_t)y * w * channels);
+    }
+}
+
+} // namespace
+
+size_t mipChainLayout(int width, int height, int channels, std::vector<MipLevel>& levels, uint32_t maxLevels) {
+    levels.clear();
+    size_t offset = 0;
+    for (int w = width, h = height; levels.size() < maxLevels; w = std::max(w / 2, 1), h = std::max(h / 2, 1)) {
+        size_t size = (size_t)w * h * channels;
+        levels.push_back(MipLevel{ w, h, offset, size });
+        offset += size;
+        if (w == 1 && h == 1) {
+            break;
+        }
+    }
+    return offset;
+}
+
+void downsampleLevel(const unsigned char* src, int width, int height, int channels, bool srgb, MipFilter filter, unsigned char* dst) {
+    if (filter == MIP_FILTER_KAISER) {
+        kaiserLevel(src, width, height, channels, srgb, dst);
+    } else {
+        boxLevel(src, width, height, channels, srgb, dst);
+    }
+}
+
+void buildMipChain(unsigned char* chain, const std::vector<MipLevel>& levels, int channels, bool srgb, MipFilter filter) {
+    for (size_t level = 1; level < levels.size(); ++level) {
+        const MipLevel& above = levels[level - 1];
+        downsampleLevel(chain + above.offset, above.width, above.height, channels, srgb, filter, chain + levels[level].offset);
+    }
+}
+
+int mipCopySourceLevel(int width, int height, int levels, int dstWidth, int dstHeight) {
+    int level = 0;
+    while (level + 1 < levels && std::max(width >> (level + 1), 1) >= dstWidth &&
+           std::max(height >> (level + 1), 1) >= dstHeight) {
+        ++level;
+    }
+    if (std::max(width >> level, 1) > 2 * dstWidth || std::max(height >> level, 1) > 2 * dstHeight) {
+        return -1;
+    }
+    return level;
+}
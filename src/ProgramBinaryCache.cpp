@@ -0,0 +1,154 @@
+#include "ProgramBinaryCache.hpp"
+#include <glad/glad.h>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "utils/hash.h"
+
+// On-disk entry header, followed by `length` bytes of program binary
+struct ProgramBinaryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint64_t driverHash;
+    uint32_t format;
+    uint32_t length;
+};
+
+static const uint32_t PROGRAM_BINARY_MAGIC = 0x50424331; // "PBC1"
+static const uint32_t PROGRAM_BINARY_VERSION = 1;
+
+static uint64_t hashGLString(GLenum name, uint64_t hash) {
+    const char* value = reinterpret_cast<const char*>(glGetString(name));
+    if (!value) {
+        return hash;
+    }
+    return fnv1a64(value, strlen(value) + 1, hash);
+}
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& directory) : directory(directory) {}
+
+bool ProgramBinaryCache::isSupported() {
+    if (supported < 0) {
+        GLint formats = 0;
+        if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        }
+        supported = formats > 0 ? 1 : 0;
+
+        if (supported) {
+            driverHash = hashGLString(GL_VENDOR, FNV1A64_SEED);
+            driverHash = hashGLString(GL_RENDERER, driverHash);
+            driverHash = hashGLString(GL_VERSION, driverHash);
+
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+        }
+    }
+    return supported == 1;
+}
+
+uint64_t ProgramBinaryCache::makeKey(const std::string& vertexCode, const std::string& fragmentCode) {
+    uint64_t hash = fnv1a64(vertexCode.data(), vertexCode.size() + 1);
+    hash = fnv1a64(fragmentCode.data(), fragmentCode.size() + 1, hash);
+    return fnv1a64(&driverHash, sizeof(driverHash), hash);
+}
+
+std::string ProgramBinaryCache::pathFor(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return directory + "/" + name;
+}
+
+bool ProgramBinaryCache::load(uint64_t key, GLuint program) {
+    std::string path = pathFor(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        ++misses;
+        return false;
+    }
+
+    ProgramBinaryHeader header;
+    std::vector<char> binary;
+    bool valid = false;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        && header.magic == PROGRAM_BINARY_MAGIC
+        && header.version == PROGRAM_BINARY_VERSION
+        && header.key == key
+        && header.driverHash == driverHash) {
+        binary.resize(header.length);
+        valid = (bool)file.read(binary.data(), header.length);
+    }
+    file.close();
+
+    if (valid) {
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked) {
+            ++hits;
+            return true;
+        }
+    }
+
+    // stale or corrupt: drop it so the recompiled program replaces it
+    std::cerr << "WARNING::SHADER::PROGRAM_BINARY_REJECTED: " << path << std::endl;
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    ++rejected;
+    ++misses;
+    return false;
+}
+
+void ProgramBinaryCache::store(uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return;
+    }
+
+    ProgramBinaryHeader header;
+    header.magic = PROGRAM_BINARY_MAGIC;
+    header.version = PROGRAM_BINARY_VERSION;
+    header.key = key;
+    header.driverHash = driverHash;
+    header.format = format;
+    header.length = (uint32_t)written;
+
+    // write to a temporary name first so a crash never leaves a truncated entry behind
+    std::string path = pathFor(key);
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), written);
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+}
+
+uint32_t ProgramBinaryCache::getHits() const {
+    return hits;
+}
+
+uint32_t ProgramBinaryCache::getMisses() const {
+    return misses;
+}
+
+uint32_t ProgramBinaryCache::getRejected() const {
+    return rejected;
+}
@@ -1,142 +1,167 @@
 #include "RenderObjects.hpp"
 #include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#include <iostream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "utils/logger.h"
 
+RenderObjects::RenderObjects(World& world, TransformHierarchy& transforms, MeshPool& meshes)
+    : world(world), transforms(transforms), meshes(meshes) {}
+
+RenderObjects::~RenderObjects() {
+    for (Entity object : objects) {
+        if (Transform* transform = world.get<Transform>(object)) {
+            transforms.destroy(transform->id);
+        }
+        world.destroy(object);
+    }
+    for (const MeshRange& range : ranges) {
+        meshes.free(range);
+    }
+}
+
 // Add a new renderable object
-void RenderObjects::addObject(
+Entity RenderObjects::addObject(
     std::vector<float> vertexData,
-    std::unique_ptr<Shader> shader,
+    ShaderHandle shader,
     std::vector<Texture> tex,
     const glm::vec3& pos,
     const glm::vec3& rot,
     const glm::vec3& scl
 ) {
-    uint64_t vaoCnt = vaos.size();
-    vaos.push_back(0);
-    vbos.push_back(0);
-    ebos.push_back(0);
-
-    glGenVertexArrays(1, &vaos[vaoCnt]);
-    glGenBuffers(1, &vbos[vaoCnt]);
-
-    glBindVertexArray(vaos[vaoCnt]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[vaoCnt]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertexData, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebos[vaoCnt]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(vertexData), &vertexData, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    // Store vertex data
-    vertices.emplace_back(std::move(vertexData));
-
-    // Move shader into the shaders vector
-    shaders.emplace_back(std::move(shader));
+    // position (location 0) and texture coords (location 1) in the pool's shared buffers
+    const uint32_t floats = MeshPool::getFloatsPerVertex(VERTEX_P3T2);
+    MeshRange range = meshes.allocate(VERTEX_P3T2, vertexData.data(), (uint32_t)(vertexData.size() / floats));
+    ranges.push_back(range);
+
+    // small textures go into the atlas if the mesh samples only inside the image
+    AtlasEntry atlasEntry = NO_ATLAS_ENTRY;
+    if (atlas && tex.size() == 1) {
+        bool inside = true;
+        for (size_t v = 3; v + 1 < vertexData.size() && inside; v += floats) {
+            inside = vertexData[v] >= 0.0f && vertexData[v] <= 1.0f && vertexData[v + 1] >= 0.0f && vertexData[v + 1] <= 1.0f;
+        }
+        if (inside) {
+            atlasEntry = atlas->insert(tex[0].getHandle());
+        }
+    }
 
-    // Move textures into the textures vector
-    textures.emplace_back(std::move(tex));
+    // Per-object uniforms that never change: sampler units and the fixed camera.
+    // Assuming shader uniform names are "ourTexture0", "ourTexture1", etc.
+    static const char* samplerNames[MAX_TEXTURE_UNITS] = { "ourTexture0", "ourTexture1", "ourTexture2", "ourTexture3" };
+    glm::mat4 view          = glm::mat4(1.0f);
+    glm::mat4 projection    = glm::mat4(1.0f);
+    view  = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
+    projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+
+    shader->Use();
+    for (size_t t = 0; t < tex.size() && t < MAX_TEXTURE_UNITS; ++t) {
+        shader->setInt(samplerNames[t], static_cast<int>(t));
+    }
+    shader->setMat4("view", view);
+    shader->setMat4("projection", projection);
+
+    // bounding sphere around the positions (5 floats per vertex)
+    glm::vec3 lower(0.0f), upper(0.0f);
+    for (size_t v = 0; v + 3 <= vertexData.size(); v += 5) {
+        glm::vec3 position(vertexData[v], vertexData[v + 1], vertexData[v + 2]);
+        lower = v == 0 ? position : glm::min(lower, position);
+        upper = v == 0 ? position : glm::max(upper, position);
+    }
+    Bounds localBounds{ (lower + upper) * 0.5f, glm::length(upper - lower) * 0.5f };
+
+    MeshRenderer mesh;
+    mesh.shader = std::move(shader);
+    mesh.vao = meshes.getVertexArray(VERTEX_P3T2);
+    mesh.baseVertex = range.baseVertex;
+    mesh.firstIndex = range.firstIndex;
+    mesh.indexCount = range.indexCount;
+    for (size_t t = 0; t < tex.size() && t < MAX_TEXTURE_UNITS; ++t) {
+        mesh.textures[mesh.textureCount++] = tex[t].getHandle();
+    }
 
-    // Store transformation data
-    positions.push_back(pos);
-    rotations.push_back(rot);
-    scales.push_back(scl);
+    // rot holds Euler angles in radians
+    TransformId transform = transforms.create(NULL_TRANSFORM, pos, glm::quat(rot), scl);
+    Entity object = world.create(Transform{ transform }, localBounds, std::move(mesh));
+    objects.push_back(object);
+    atlasEntries.push_back(NO_ATLAS_ENTRY);
+    if (atlasEntry != NO_ATLAS_ENTRY) {
+        atlasPending.push_back(PendingAtlasObject{ objects.size() - 1, atlasEntry, std::move(vertexData) });
+    }
+    return object;
 }
 
-// Render all objects
-void RenderObjects::render() {
-    for (size_t i = 0; i < shaders.size(); ++i) {
-        Shader* currentShader = shaders[i].get();
-        if (!currentShader) {
-            std::cerr << "Shader at index " << i << " is null.\n";
+void RenderObjects::update() {
+    for (size_t i = 0; i < atlasPending.size();) {
+        PendingAtlasObject& pending = atlasPending[i];
+        TextureAtlas::EntryState state = atlas->getState(pending.entry);
+        if (state == TextureAtlas::ENTRY_PENDING) {
+            ++i;
             continue;
         }
-
-        // 1. bind textures on corresponding texture units
-        // 2. activate shader
-        // 3. create transformations
-        // 4. render container
-
-        // Use the shader program
-        currentShader->Use();
-
-        // Bind textures
-        for (size_t t = 0; t < textures[i].size(); ++t) {
-            textures[i][t].Use(static_cast<unsigned int>(t));
-            // Assuming shader uniform names are "ourTexture0", "ourTexture1", etc.
-            currentShader->setInt("ourTexture" + std::to_string(t), static_cast<int>(t));
+        MeshRenderer* mesh = world.get<MeshRenderer>(objects[pending.object]);
+        if (state == TextureAtlas::ENTRY_PLACED && mesh) {
+            // same triangles, uvs pointing into the page
+            const uint32_t floats = MeshPool::getFloatsPerVertex(VERTEX_P3T2);
+            for (size_t v = 3; v + 1 < pending.vertices.size(); v += floats) {
+                glm::vec2 uv = atlas->remap(pending.entry, glm::vec2(pending.vertices[v], pending.vertices[v + 1]));
+                pending.vertices[v] = uv.x;
+                pending.vertices[v + 1] = uv.y;
+            }
+            MeshRange& range = ranges[pending.object];
+            meshes.free(range);
+            range = meshes.allocate(VERTEX_P3T2, pending.vertices.data(), (uint32_t)(pending.vertices.size() / floats));
+            mesh->baseVertex = range.baseVertex;
+            mesh->firstIndex = range.firstIndex;
+            mesh->indexCount = range.indexCount;
+            mesh->textures[0].reset();
+            atlasEntries[pending.object] = pending.entry;
         }
-
-        
-        glm::mat4 model         = glm::mat4(1.0f);
-        glm::mat4 view          = glm::mat4(1.0f);
-        glm::mat4 projection    = glm::mat4(1.0f);
-        model = glm::rotate(model, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-        view  = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-        projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
-
-        currentShader->setMat4("view", view);
-        currentShader->setMat4("model", model);
-        currentShader->setMat4("projection", projection);
-
-        // Set the model matrix uniform
-        // currentShader->setMat4("model", model);
-
-        // Bind VAO and draw
-        glBindVertexArray(vaos[i]);
-
-        // 5 floats per vertex
-        size_t vertexCount = vertices[i].size() / 5;
-        // glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        // glBindVertexArray(0);
-        // LOG(INFO, (std::string("Rendered object ") + std::to_string(i)).c_str());
+        atlasPending[i] = std::move(atlasPending.back());
+        atlasPending.pop_back();
     }
+}
 
+// Record the objects in view into the render queue
+void RenderObjects::render(RenderQueue& queue, FrustumCuller& culler, const Frustum& frustum) {
+    drawable.clear();
+    bounds.clear();
+    for (size_t i = 0; i < objects.size(); ++i) {
+        MeshRenderer* mesh = world.get<MeshRenderer>(objects[i]);
+        Transform* transform = world.get<Transform>(objects[i]);
+        Bounds* local = world.get<Bounds>(objects[i]);
+        if (!mesh || !transform || !local || !mesh->shader) {
+            LOGF(ERROR, "object %zu has no transform, bounds, mesh or shader", i);
+            continue;
+        }
+        bounds.pushTransformed(transforms.getWorld(transform->id), local->center, local->radius);
+        drawable.push_back((uint32_t)i);
+    }
+    culler.cull(frustum, bounds, visible);
+
+    for (uint32_t index : visible) {
+        const uint32_t object = drawable[index];
+        const MeshRenderer* mesh = world.get<MeshRenderer>(objects[object]);
+        Shader* currentShader = mesh->shader.get();
+
+        DrawItem item;
+        item.shader = currentShader;
+        item.vao = mesh->vao;
+        item.textureCount = mesh->textureCount;
+        for (GLuint t = 0; t < mesh->textureCount; ++t) {
+            item.textures[t] = mesh->textures[t] ? mesh->textures[t]->getID() : 0;
+        }
+        if (atlasEntries[object] != NO_ATLAS_ENTRY) {
+            item.textures[0] = atlas->getPage(atlasEntries[object]);
+        }
+        GLuint material = item.textureCount > 0 ? item.textures[0] : 0;
 
-    // 1. bind textures on corresponding texture units
-    // glActiveTexture(GL_TEXTURE0);
-    // glBindTexture(GL_TEXTURE_2D, texture1);
-    // glActiveTexture(GL_TEXTURE1);
-    // glBindTexture(GL_TEXTURE_2D, texture2);
-
-    // 2. activate shader
-    // ourShader.use();
-    
-    // 3. create transformations
-    // glm::mat4 model         = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-    // glm::mat4 view          = glm::mat4(1.0f);
-    // glm::mat4 projection    = glm::mat4(1.0f);
-    // model = glm::rotate(model, glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    // view  = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-    // projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    // // retrieve the matrix uniform locations
-    // unsigned int modelLoc = glGetUniformLocation(ourShader.ID, "model");
-    // unsigned int viewLoc  = glGetUniformLocation(ourShader.ID, "view");
-    // // pass them to the shaders (3 different ways)
-    // glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    // glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
-    // // note: currently we set the projection matrix each frame, but since the projection matrix rarely changes it's often best practice to set it outside the main loop only once.
-    // ourShader.setMat4("projection", projection);
-
-    // 4. render container
-    // glBindVertexArray(VAO);
-    // glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        item.model = transforms.getWorld(world.get<Transform>(objects[object])->id);
 
-    // // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    // // -------------------------------------------------------------------------------
-    // glfwSwapBuffers(window);
-    // Reset active texture to default
-    // glActiveTexture(GL_TEXTURE0);
+        item.baseVertex = mesh->baseVertex;
+        item.firstIndex = mesh->firstIndex;
+        item.indexCount = mesh->indexCount;
+        item.key = RenderQueue::makeKey(PASS_OPAQUE, currentShader->getID(), material, item.vao, 0);
+        queue.submit(item);
+    }
 }
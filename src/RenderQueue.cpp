@@ -0,0 +1,292 @@
+#include "RenderQueue.hpp"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "InstanceAttributes.hpp"
+#include "Shader.hpp"
+#include "StreamBuffer.hpp"
+#include "utils/logger.h"
+
+static constexpr UniformName U_MODEL("model");
+
+namespace {
+
+// A recorded draw: this header, then textureCount texture names. Sized in multiples of 16
+// bytes so every header (and its matrix) stays aligned in the buffer.
+struct DrawPacket {
+    glm::mat4 model;
+    Shader* shader;
+    GLuint vao;
+    GLint baseVertex;
+    GLuint firstIndex;
+    GLsizei indexCount;
+    GLuint textureCount;
+    GLenum textureTarget;
+    uint32_t material;
+};
+
+const size_t PACKET_ALIGNMENT = 16;
+const size_t INITIAL_RECORDER_BYTES = 64u << 10;
+// per-frame stream space for indirect mode before the first flush asks for more, and the
+// padding its two aligned allocations may need on top of their size
+const size_t INITIAL_STREAM_BYTES = 256u << 10;
+const size_t STREAM_ALIGNMENT_SLACK = 64;
+
+size_t packetSize(GLuint textureCount) {
+    size_t size = sizeof(DrawPacket) + textureCount * sizeof(GLuint);
+    return (size + PACKET_ALIGNMENT - 1) & ~(PACKET_ALIGNMENT - 1);
+}
+
+// draws that can share one call: same program, vertex array and textures
+bool sameState(const DrawPacket& a, const DrawPacket& b) {
+    return a.shader == b.shader && a.vao == b.vao && a.textureCount == b.textureCount && a.textureTarget == b.textureTarget
+        && memcmp(&a + 1, &b + 1, a.textureCount * sizeof(GLuint)) == 0;
+}
+
+} // namespace
+
+RenderQueue::RenderQueue(unsigned threadCount) : recorders(std::max(threadCount, 1u)) {}
+
+RenderQueue::~RenderQueue() = default;
+
+void RenderQueue::setIndirect(bool indirect) {
+    if (!indirect) {
+        stream.reset();
+    } else if (!stream) {
+        stream.reset(new StreamBuffer(INITIAL_STREAM_BYTES));
+    }
+}
+
+bool RenderQueue::hasMultiDrawIndirect() {
+    // the commands' baseInstance needs ARB_base_instance; both are core in 4.3
+    return (GLAD_GL_VERSION_4_3 || (GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance))
+        && glMultiDrawElementsIndirect != nullptr;
+}
+
+uint64_t RenderQueue::makeKey(RenderPass pass, uint32_t program, uint32_t material, uint32_t mesh, uint16_t depth) {
+    return ((uint64_t)(pass & 0xF) << 60)
+        | ((uint64_t)(program & 0xFFF) << 48)
+        | ((uint64_t)(material & 0xFFFF) << 32)
+        | ((uint64_t)(mesh & 0xFFFF) << 16)
+        | (uint64_t)depth;
+}
+
+uint16_t RenderQueue::quantizeDepth(float distance, float nearPlane, float farPlane) {
+    float t = (distance - nearPlane) / (farPlane - nearPlane);
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    return (uint16_t)(t * 65535.0f);
+}
+
+void RenderQueue::submit(const DrawItem& item, unsigned thread) {
+    assert(thread < recorders.size());
+    Recorder& recorder = recorders[thread];
+    size_t size = packetSize(item.textureCount);
+    if (recorder.used + size > recorder.capacity) {
+        // operator new[] aligns to at least 16, which packets rely on
+        size_t capacity = std::max(recorder.capacity * 2, std::max(recorder.used + size, INITIAL_RECORDER_BYTES));
+        std::unique_ptr<unsigned char[]> bytes(new unsigned char[capacity]);
+        if (recorder.used) {
+            memcpy(bytes.get(), recorder.bytes.get(), recorder.used);
+        }
+        recorder.bytes = std::move(bytes);
+        recorder.capacity = capacity;
+    }
+
+    unsigned char* at = recorder.bytes.get() + recorder.used;
+    DrawPacket* packet = reinterpret_cast<DrawPacket*>(at);
+    packet->model = item.model;
+    packet->shader = item.shader;
+    packet->vao = item.vao;
+    packet->baseVertex = item.baseVertex;
+    packet->firstIndex = item.firstIndex;
+    packet->indexCount = item.indexCount;
+    packet->textureCount = item.textureCount;
+    packet->textureTarget = item.textureTarget;
+    packet->material = item.material;
+    memcpy(packet + 1, item.textures, item.textureCount * sizeof(GLuint));
+
+    recorder.entries.push_back({ item.key, thread, (uint32_t)recorder.used });
+    recorder.used += size;
+}
+
+size_t RenderQueue::size() const {
+    size_t count = 0;
+    for (const Recorder& recorder : recorders) {
+        count += recorder.entries.size();
+    }
+    return count;
+}
+
+size_t RenderQueue::getRecordedBytes() const {
+    size_t bytes = 0;
+    for (const Recorder& recorder : recorders) {
+        bytes += recorder.used;
+    }
+    return bytes;
+}
+
+// LSD radix sort on the 64-bit keys, one byte per pass. Passes where every key has the
+// same byte (common for the pass/program bytes) are skipped.
+void RenderQueue::sortKeys() {
+    const size_t count = order.size();
+    scratch.resize(count);
+
+    for (unsigned shift = 0; shift < 64; shift += 8) {
+        uint32_t histogram[256] = {};
+        for (size_t i = 0; i < count; ++i) {
+            ++histogram[(order[i].key >> shift) & 0xFF];
+        }
+        if (histogram[(order[0].key >> shift) & 0xFF] == count) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (unsigned b = 0; b < 256; ++b) {
+            uint32_t n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            scratch[histogram[(order[i].key >> shift) & 0xFF]++] = order[i];
+        }
+        order.swap(scratch);
+    }
+}
+
+void RenderQueue::flush(GLStateCache& state) {
+    // merge: every thread's keys into one sort
+    order.clear();
+    for (const Recorder& recorder : recorders) {
+        order.insert(order.end(), recorder.entries.begin(), recorder.entries.end());
+    }
+    if (order.empty()) {
+        return;
+    }
+
+    sortKeys();
+    stats.draws += (uint32_t)order.size();
+    if (stream) {
+        flushIndirect(state);
+    } else {
+        flushDirect(state);
+    }
+
+    for (Recorder& recorder : recorders) {
+        recorder.used = 0;
+        recorder.entries.clear();
+    }
+    order.clear();
+}
+
+void RenderQueue::flushDirect(GLStateCache& state) {
+    Shader* lastShader = nullptr;
+    GLint modelLocation = -1;
+    for (const SortEntry& entry : order) {
+        const DrawPacket& packet = *reinterpret_cast<const DrawPacket*>(recorders[entry.thread].bytes.get() + entry.offset);
+        const GLuint* textures = reinterpret_cast<const GLuint*>(&packet + 1);
+
+        state.useProgram(packet.shader->getID());
+        if (packet.shader != lastShader) {
+            modelLocation = packet.shader->getUniformLocation(U_MODEL);
+            lastShader = packet.shader;
+        }
+        for (GLuint t = 0; t < packet.textureCount; ++t) {
+            state.bindTexture(t, textures[t], packet.textureTarget);
+        }
+        state.bindVertexArray(packet.vao);
+
+        packet.shader->setMat4(modelLocation, packet.model);
+        glDrawElementsBaseVertex(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT,
+            (void*)(packet.firstIndex * sizeof(uint32_t)), packet.baseVertex);
+    }
+    stats.drawCalls += (uint32_t)order.size();
+}
+
+void RenderQueue::flushIndirect(GLStateCache& state) {
+    const size_t count = order.size();
+    const size_t instanceBytes = count * sizeof(InstanceData);
+    const size_t commandBytes = count * sizeof(DrawElementsIndirectCommand);
+    // grown, with headroom, before this frame allocates anything, so nothing still points at
+    // the old buffer
+    const size_t needed = instanceBytes + commandBytes + STREAM_ALIGNMENT_SLACK;
+    if (needed > stream->getBytesPerFrame()) {
+        stream->reserve(needed + needed / 2);
+    }
+    stream->beginFrame();
+
+    auto packetAt = [this](size_t i) -> const DrawPacket& {
+        return *reinterpret_cast<const DrawPacket*>(recorders[order[i].thread].bytes.get() + order[i].offset);
+    };
+
+    // draw i reads record i: its base instance in the commands, its offset in the CPU loop
+    StreamAllocation instances = stream->allocate(instanceBytes, 16);
+    if (!instances.data) {
+        // the frame's draws are dropped; flush() still clears the recorders
+        LOGF(WARNING, "no stream buffer space for %zu indirect draws; skipping them", count);
+        stream->endFrame();
+        return;
+    }
+    InstanceData* instanceData = static_cast<InstanceData*>(instances.data);
+    for (size_t i = 0; i < count; ++i) {
+        instanceData[i] = makeInstanceData(packetAt(i).model, packetAt(i).material);
+    }
+    stream->commit(instances);
+
+    const bool multiDraw = hasMultiDrawIndirect();
+    StreamAllocation commands;
+    if (multiDraw) {
+        commands = stream->allocate(commandBytes, 4);
+        if (!commands.data) {
+            LOGF(WARNING, "no stream buffer space for %zu indirect draw commands; skipping them", count);
+            stream->endFrame();
+            return;
+        }
+        DrawElementsIndirectCommand* command = static_cast<DrawElementsIndirectCommand*>(commands.data);
+        for (size_t i = 0; i < count; ++i) {
+            const DrawPacket& packet = packetAt(i);
+            command[i] = { (GLuint)packet.indexCount, 1, packet.firstIndex, packet.baseVertex, (GLuint)i };
+        }
+        stream->commit(commands);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream->getID());
+    }
+
+    size_t begin = 0;
+    while (begin < count) {
+        const DrawPacket& first = packetAt(begin);
+        size_t end = begin + 1;
+        while (end < count && sameState(first, packetAt(end))) {
+            ++end;
+        }
+
+        const GLuint* textures = reinterpret_cast<const GLuint*>(&first + 1);
+        state.useProgram(first.shader->getID());
+        for (GLuint t = 0; t < first.textureCount; ++t) {
+            state.bindTexture(t, textures[t], first.textureTarget);
+        }
+        state.bindVertexArray(first.vao);
+        // cheap next to the draws; the VAO may never have carried instance attributes before
+        enableInstanceAttributes();
+
+        if (multiDraw) {
+            bindInstanceAttributes(stream->getID(), instances.offset);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (void*)(commands.offset + begin * sizeof(DrawElementsIndirectCommand)), (GLsizei)(end - begin), 0);
+            ++stats.drawCalls;
+        } else {
+            for (size_t i = begin; i < end; ++i) {
+                const DrawPacket& packet = packetAt(i);
+                bindInstanceAttributes(stream->getID(), instances.offset + i * sizeof(InstanceData));
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT,
+                    (void*)(packet.firstIndex * sizeof(uint32_t)), 1, packet.baseVertex);
+            }
+            stats.drawCalls += (uint32_t)(end - begin);
+        }
+        begin = end;
+    }
+
+    if (multiDraw) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    stream->endFrame();
+}
@@ -1,14 +1,34 @@
 #include "Shader.hpp"
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
-#include <stb_image/stb_image.h>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include "FrameConstants.hpp"
+#include "MaterialTable.hpp"
+#include "ProgramBinaryCache.hpp"
+#include "TextureCache.hpp"
 #include "utils/logger.h"
 
-Shader::Shader(const char* vShaderPath, const char* fShaderPath) {
+// Inserts "#define NAME" lines right after the #version directive (which must stay first)
+static void injectDefines(std::string& code, const std::vector<std::string>& defines) {
+    if (defines.empty()) {
+        return;
+    }
+    std::string block;
+    for (const std::string& define : defines) {
+        block += "#define " + define + "\n";
+    }
+    size_t insertAt = 0;
+    if (code.compare(0, 8, "#version") == 0) {
+        size_t lineEnd = code.find('\n');
+        insertAt = lineEnd == std::string::npos ? code.size() : lineEnd + 1;
+    }
+    code.insert(insertAt, block);
+}
+
+Shader::Shader(const char* vShaderPath, const char* fShaderPath, const std::vector<std::string>& defines, ProgramBinaryCache* binaryCache) {
     // Load vertex shader file
     std::ifstream vertexFile(vShaderPath);
     if (!vertexFile.is_open()) {
@@ -18,6 +38,7 @@ Shader::Shader(const char* vShaderPath, const char* fShaderPath) {
     std::stringstream vShaderStream;
     vShaderStream << vertexFile.rdbuf();
     std::string vertexCode = vShaderStream.str();
+    injectDefines(vertexCode, defines);
     const char* vShaderCode = vertexCode.c_str();
     // std::cout << "Vertex Shader Code Loaded:\n" << vertexCode << std::endl;
 
@@ -30,9 +51,25 @@ Shader::Shader(const char* vShaderPath, const char* fShaderPath) {
     std::stringstream fShaderStream;
     fShaderStream << fragmentFile.rdbuf();
     std::string fragmentCode = fShaderStream.str();
+    injectDefines(fragmentCode, defines);
     const char* fShaderCode = fragmentCode.c_str();
     // std::cout << "Fragment Shader Code Loaded:\n" << fragmentCode << std::endl;
 
+    programID = glCreateProgram();
+
+    // Try a cached program binary before compiling anything (defines are already part of the code)
+    bool useBinaryCache = binaryCache && binaryCache->isSupported();
+    uint64_t binaryKey = 0;
+    if (useBinaryCache) {
+        binaryKey = binaryCache->makeKey(vertexCode, fragmentCode);
+        if (binaryCache->load(binaryKey, programID)) {
+            buildUniformTable();
+            bindUniformBlocks();
+            return;
+        }
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
     // Compile vertex shader
     vertexShader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vertexShader, 1, &vShaderCode, NULL);
@@ -62,7 +99,6 @@ Shader::Shader(const char* vShaderPath, const char* fShaderPath) {
     }
 
     // Link shaders
-    programID = glCreateProgram();
     glAttachShader(programID, vertexShader);
     glAttachShader(programID, fragmentShader);
     glLinkProgram(programID);
@@ -73,6 +109,11 @@ Shader::Shader(const char* vShaderPath, const char* fShaderPath) {
         std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     } else {
         // std::cout << "Shader program linked successfully!" << std::endl;
+        buildUniformTable();
+        bindUniformBlocks();
+        if (useBinaryCache) {
+            binaryCache->store(binaryKey, programID);
+        }
     }
 
     glDeleteShader(vertexShader);
@@ -84,115 +125,138 @@ Shader::~Shader() {
     glDeleteProgram(programID);
 }
 
-void Shader::setBool(const std::string &name, bool value) const {         
-    glUniform1i(glGetUniformLocation(this->programID, name.c_str()), (int)value); 
+uint32_t Shader::driverLookups = 0;
+
+void Shader::buildUniformTable() {
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::string name(maxLength > 0 ? maxLength : 1, '\0');
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(programID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+
+        std::string uniformName = name.substr(0, length);
+        GLint location = glGetUniformLocation(programID, uniformName.c_str());
+        if (location < 0) {
+            // uniform block members have no location
+            continue;
+        }
+
+        uint32_t hash = hashUniformName(uniformName.c_str());
+        auto it = uniforms.find(hash);
+        if (it != uniforms.end() && it->second != location) {
+            std::cerr << "WARNING::SHADER::UNIFORM_HASH_COLLISION: " << uniformName << std::endl;
+        }
+        uniforms[hash] = location;
+
+        // arrays are reported as "name[0]"; make the bare name resolve to element 0 as well
+        size_t bracket = uniformName.find("[0]");
+        if (bracket != std::string::npos && bracket + 3 == uniformName.size()) {
+            uniforms[hashUniformName(uniformName.substr(0, bracket).c_str())] = location;
+        }
+    }
+}
+
+void Shader::bindUniformBlocks() {
+    GLuint frameBlock = glGetUniformBlockIndex(programID, "FrameConstants");
+    if (frameBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(programID, frameBlock, FRAME_CONSTANTS_BINDING);
+    }
+    GLuint materialBlock = glGetUniformBlockIndex(programID, "Materials");
+    if (materialBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(programID, materialBlock, MATERIALS_BINDING);
+    }
+}
+
+GLint Shader::getUniformLocation(UniformName name) const {
+    auto it = uniforms.find(name.hash);
+    if (it != uniforms.end()) {
+        return it->second;
+    }
+
+    // not in the link-time table (e.g. array element other than [0]); ask the driver once and remember it
+    ++driverLookups;
+    GLint location = glGetUniformLocation(this->programID, name.name);
+    uniforms.emplace(name.hash, location);
+    return location;
 }
 
-void Shader::setInt(const std::string &name, int value) const { 
-    glUniform1i(glGetUniformLocation(this->programID, name.c_str()), value); 
+void Shader::setBool(UniformName name, bool value) const {
+    setBool(getUniformLocation(name), value);
 }
 
-void Shader::setFloat(const std::string &name, float value) const { 
-    glUniform1f(glGetUniformLocation(this->programID, name.c_str()), value); 
-} 
+void Shader::setInt(UniformName name, int value) const {
+    setInt(getUniformLocation(name), value);
+}
 
-void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(
-        glGetUniformLocation(
-            this->programID,
-            name.c_str()
-        ),
-        1,
-        GL_FALSE,
-        glm::value_ptr(mat)
-    );
+void Shader::setFloat(UniformName name, float value) const {
+    setFloat(getUniformLocation(name), value);
 }
 
-void Shader::setVec3(const std::string &name, const glm::vec3 &vec) const {
-    glUniform3fv(glGetUniformLocation(this->programID, name.c_str()), 1, glm::value_ptr(vec));
+void Shader::setMat4(UniformName name, const glm::mat4 &mat) const {
+    setMat4(getUniformLocation(name), mat);
 }
 
-void Shader::setVec3(const std::string &name, float x, float y, float z) const { 
-    glUniform3f(glGetUniformLocation(this->programID, name.c_str()), x, y, z); 
+void Shader::setVec3(UniformName name, const glm::vec3 &vec) const {
+    setVec3(getUniformLocation(name), vec);
 }
 
-void Shader::Use() {
-    glUseProgram(programID);
+void Shader::setVec3(UniformName name, float x, float y, float z) const {
+    setVec3(getUniformLocation(name), x, y, z);
 }
 
-void Shader::loadDiffuseTexture(const char* path) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1) {
-            format = GL_RED;
-        } else if (nrChannels == 3) {
-            format = GL_RGB;
-        } else if (nrChannels == 4) {
-            format = GL_RGBA;
-        }
+void Shader::setBool(GLint location, bool value) const {
+    glUniform1i(location, (int)value);
+}
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+void Shader::setInt(GLint location, int value) const {
+    glUniform1i(location, value);
+}
 
-        // Set the texture wrapping/filtering options (on the currently bound texture object)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void Shader::setFloat(GLint location, float value) const {
+    glUniform1f(location, value);
+}
 
-        stbi_image_free(data);
-    } else {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-        stbi_image_free(data);
-    }
+void Shader::setMat4(GLint location, const glm::mat4 &mat) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+}
 
-    diffuseMap = textureID;
+void Shader::setVec3(GLint location, const glm::vec3 &vec) const {
+    glUniform3fv(location, 1, glm::value_ptr(vec));
 }
 
-void Shader::loadSpecularTexture(const char* path) {
-    GLuint textureID;
-    glGenTextures(1, &textureID);
+void Shader::setVec3(GLint location, float x, float y, float z) const {
+    glUniform3f(location, x, y, z);
+}
 
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1) {
-            format = GL_RED;
-        } else if (nrChannels == 3) {
-            format = GL_RGB;
-        } else if (nrChannels == 4) {
-            format = GL_RGBA;
-        }
+uint32_t Shader::getDriverLookups() {
+    return driverLookups;
+}
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+void Shader::resetDriverLookups() {
+    driverLookups = 0;
+}
 
-        // Set the texture wrapping/filtering options (on the currently bound texture object)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void Shader::Use() {
+    glUseProgram(programID);
+}
 
-        stbi_image_free(data);
-    } else {
-        std::cerr << "Failed to load texture: " << path << std::endl;
-        stbi_image_free(data);
-    }
+void Shader::loadDiffuseTexture(TextureCache& cache, const char* path) {
+    diffuseMap = cache.get(path);
+}
 
-    specularMap = textureID;
+void Shader::loadSpecularTexture(TextureCache& cache, const char* path) {
+    specularMap = cache.get(path);
 }
 
-GLuint Shader::getDiffuseMap() const { return diffuseMap; }
+GLuint Shader::getDiffuseMap() const { return diffuseMap ? diffuseMap->getID() : 0; }
 
-GLuint Shader::getSpecularMap() const { return specularMap; }
+GLuint Shader::getSpecularMap() const { return specularMap ? specularMap->getID() : 0; }
 
 uint32_t Shader::getID() const {
     return programID;
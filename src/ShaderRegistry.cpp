@@ -0,0 +1,61 @@
+#include "ShaderRegistry.hpp"
+#include <algorithm>
+#include <chrono>
+
+// Defines are sorted so { "A", "B" } and { "B", "A" } share a program
+std::string ShaderRegistry::makeKey(const char* vertexPath, const char* fragmentPath, std::vector<std::string> defines) {
+    std::sort(defines.begin(), defines.end());
+
+    std::string key = vertexPath;
+    key += '|';
+    key += fragmentPath;
+    for (const std::string& define : defines) {
+        key += '|';
+        key += define;
+    }
+    return key;
+}
+
+ShaderHandle ShaderRegistry::get(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines) {
+    std::string key = makeKey(vertexPath, fragmentPath, defines);
+
+    std::weak_ptr<Shader>& slot = programs[key];
+    if (ShaderHandle existing = slot.lock()) {
+        ++hits;
+        return existing;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ShaderHandle shader = std::make_shared<Shader>(vertexPath, fragmentPath, defines, binaryCache);
+    createMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    slot = shader;
+    ++compiles;
+    return shader;
+}
+
+void ShaderRegistry::setBinaryCache(ProgramBinaryCache* cache) {
+    binaryCache = cache;
+}
+
+size_t ShaderRegistry::size() const {
+    size_t alive = 0;
+    for (const auto& entry : programs) {
+        if (!entry.second.expired()) {
+            ++alive;
+        }
+    }
+    return alive;
+}
+
+uint32_t ShaderRegistry::getHits() const {
+    return hits;
+}
+
+uint32_t ShaderRegistry::getCompiles() const {
+    return compiles;
+}
+
+double ShaderRegistry::getCreateMilliseconds() const {
+    return createMilliseconds;
+}
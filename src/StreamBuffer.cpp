@@ -0,0 +1,153 @@
+#include "StreamBuffer.hpp"
+#include <cassert>
+#include <chrono>
+#include "utils/logger.h"
+
+namespace {
+
+// regions start on this boundary so aligned offsets stay aligned in every region; covers
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT on all current hardware
+const size_t REGION_ALIGNMENT = 256;
+// longest single glClientWaitSync before looping again, in nanoseconds
+const GLuint64 FENCE_TIMEOUT = 100000000;
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace
+
+StreamBuffer::StreamBuffer(size_t bytesPerFrame) {
+    create(bytesPerFrame);
+}
+
+StreamBuffer::~StreamBuffer() {
+    destroy();
+}
+
+void StreamBuffer::create(size_t bytesPerFrame) {
+    regionSize = alignUp(bytesPerFrame, REGION_ALIGNMENT);
+    const GLsizeiptr total = (GLsizeiptr)(regionSize * FRAME_COUNT);
+
+    // GL_COPY_WRITE_BUFFER is bound by nobody else, so this disturbs no vertex or uniform binding
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if ((GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) && glBufferStorage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+        persistent = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags));
+        if (!persistent) {
+            LOGF(WARNING, "persistent mapping of a %zu KB stream buffer failed; mapping per allocation", (size_t)total / 1024);
+            // immutable storage can't be respecified; start over with a mutable buffer
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        }
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    region = 0;
+    used = 0;
+}
+
+void StreamBuffer::destroy() {
+    for (GLsync& fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (buffer) {
+        if (persistent) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            persistent = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+void StreamBuffer::reserve(size_t bytesPerFrame) {
+    if (bytesPerFrame <= regionSize) {
+        return;
+    }
+    // the old buffer may still be read by queued draws; GL keeps it alive until they finish
+    destroy();
+    create(bytesPerFrame);
+}
+
+void StreamBuffer::beginFrame() {
+    used = 0;
+    GLsync& fence = fences[region];
+    if (!fence) {
+        return;
+    }
+    // the common case: the GPU finished with this region frames ago
+    GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        auto start = std::chrono::steady_clock::now();
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        ++stats.fenceWaits;
+        stats.fenceWaitMilliseconds += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    if (result == GL_WAIT_FAILED) {
+        LOGF(WARNING, "stream buffer fence wait failed");
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+StreamAllocation StreamBuffer::allocate(size_t size, size_t alignment) {
+    StreamAllocation allocation;
+    size_t start = alignUp(used, alignment);
+    if (size == 0 || start + size > regionSize) {
+        return allocation;
+    }
+
+    const GLintptr offset = (GLintptr)(region * regionSize + start);
+    if (persistent) {
+        allocation.data = persistent + offset;
+    } else {
+        // the fence in beginFrame() has already made this range safe to overwrite
+        assert(!mapped && "commit() the previous allocation first");
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        allocation.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, (GLsizeiptr)size,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (!allocation.data) {
+            // nothing is mapped, so the next allocate() may try again
+            LOGF(WARNING, "mapping %zu bytes of the stream buffer failed", size);
+            return allocation;
+        }
+        mapped = true;
+    }
+    used = start + size;
+    allocation.offset = offset;
+    allocation.size = (GLsizeiptr)size;
+    stats.allocatedBytes += size;
+    return allocation;
+}
+
+void StreamBuffer::commit(const StreamAllocation& allocation) {
+    // coherent persistent writes are visible to commands issued after them
+    if (persistent || !allocation.data) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mapped = false;
+}
+
+void StreamBuffer::endFrame() {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % FRAME_COUNT;
+}
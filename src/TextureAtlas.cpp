@@ -0,0 +1,218 @@
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "TextureAtlas.hpp"
+#include <algorithm>
+#include "MipCopy.hpp"
+#include "utils/logger.h"
+
+namespace {
+
+// the packer works in cells of MIP_ALIGNMENT texels, so every rectangle starts on a texel
+// that is still a texel boundary at MAX_MIP_LEVEL
+int toCells(int texels) {
+    return (texels + TextureAtlas::MIP_ALIGNMENT - 1) / TextureAtlas::MIP_ALIGNMENT;
+}
+
+} // namespace
+
+TextureAtlas::TextureAtlas(GLStateCache& state) : state(state) {
+    GLint maxTextureSize = 1024;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    pageSize = std::min(MAX_PAGE_SIZE, (int)maxTextureSize);
+    maxEntrySize = pageSize / 2;
+    glGenFramebuffers(1, &readFramebuffer);
+    glGenFramebuffers(1, &drawFramebuffer);
+}
+
+TextureAtlas::~TextureAtlas() {
+    for (std::unique_ptr<Page>& page : pages) {
+        state.deleteTexture(page->texture);
+    }
+    glDeleteFramebuffers(1, &readFramebuffer);
+    glDeleteFramebuffers(1, &drawFramebuffer);
+}
+
+AtlasEntry TextureAtlas::insert(AsyncTextureHandle texture) {
+    Entry entry;
+    entry.texture = std::move(texture);
+    entries.push_back(std::move(entry));
+    return (AtlasEntry)(entries.size() - 1);
+}
+
+void TextureAtlas::update() {
+    bool copied = false;
+    for (size_t i = firstPending; i < entries.size(); ++i) {
+        Entry& entry = entries[i];
+        if (entry.state != ENTRY_PENDING) {
+            continue;
+        }
+        if (!entry.texture || entry.texture->hasFailed()) {
+            entry.state = ENTRY_REJECTED;
+        } else if (entry.texture->isResident()) {
+            copied |= place(entry);
+        }
+    }
+    while (firstPending < entries.size() && entries[firstPending].state != ENTRY_PENDING) {
+        ++firstPending;
+    }
+
+    if (copied) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // only pages that took an entry with too short a chain to copy
+        for (std::unique_ptr<Page>& page : pages) {
+            if (page->mipsStale) {
+                regenerateMips(state, page->texture);
+                page->mipsStale = false;
+            }
+        }
+    }
+}
+
+bool TextureAtlas::place(Entry& entry) {
+    const AsyncTexture& texture = *entry.texture;
+    // compressed textures are already small, and can't be blitted from; blits don't swizzle,
+    // so single-channel ones would land in the page red
+    if (texture.isCompressed() || texture.getChannels() < 3) {
+        entry.state = ENTRY_REJECTED;
+        return false;
+    }
+    // larger ones keep their aspect, scaled down to fit
+    const int largest = std::max(texture.getWidth(), texture.getHeight());
+    const int width = largest > maxEntrySize ? std::max(texture.getWidth() * maxEntrySize / largest, 1) : texture.getWidth();
+    const int height = largest > maxEntrySize ? std::max(texture.getHeight() * maxEntrySize / largest, 1) : texture.getHeight();
+
+    uint32_t page = 0;
+    int x = 0, y = 0;
+    if (!allocate(toCells(width + 2 * GUTTER), toCells(height + 2 * GUTTER), page, x, y)) {
+        entry.state = ENTRY_REJECTED;
+        return false;
+    }
+    x = x * MIP_ALIGNMENT + GUTTER;
+    y = y * MIP_ALIGNMENT + GUTTER;
+    if (!copy(texture.getID(), texture.getWidth(), texture.getHeight(), std::max(texture.getLevels(), 1), *pages[page], x, y, width, height)) {
+        entry.state = ENTRY_REJECTED;
+        return false;
+    }
+
+    entry.state = ENTRY_PLACED;
+    entry.page = page;
+    entry.uvTransform = glm::vec4((float)width, (float)height, (float)x, (float)y) / (float)pageSize;
+    // the page holds a copy; the cache may evict the original when nothing else holds it
+    entry.texture.reset();
+    return true;
+}
+
+bool TextureAtlas::allocate(int width, int height, uint32_t& page, int& x, int& y) {
+    stbrp_rect rect = {};
+    rect.w = width;
+    rect.h = height;
+    // first page with room; entries are at most half a page, so a new page always has some
+    for (uint32_t i = 0; i <= pages.size(); ++i) {
+        if (i == pages.size()) {
+            addPage();
+        }
+        Page& candidate = *pages[i];
+        stbrp_pack_rects(&candidate.packer, &rect, 1);
+        if (rect.was_packed) {
+            candidate.usedTexels += (uint64_t)width * height * MIP_ALIGNMENT * MIP_ALIGNMENT;
+            page = i;
+            x = rect.x;
+            y = rect.y;
+            return true;
+        }
+        if (candidate.usedTexels == 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void TextureAtlas::addPage() {
+    std::unique_ptr<Page> page(new Page());
+    const int pageCells = pageSize / MIP_ALIGNMENT;
+    page->nodes.resize(pageCells);
+    stbrp_init_target(&page->packer, pageCells, pageCells, page->nodes.data(), (int)page->nodes.size());
+
+    glGenTextures(1, &page->texture);
+    state.bindTexture(0, page->texture);
+    for (int level = 0; level <= MAX_MIP_LEVEL; ++level) {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, pageSize >> level, pageSize >> level, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    // deeper levels would mix entries across their gutters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MAX_MIP_LEVEL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // transparent between entries, at every level
+    const GLfloat clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    for (int level = 0; level <= MAX_MIP_LEVEL; ++level) {
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, page->texture, level);
+        glClearBufferfv(GL_COLOR, 0, clear);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    pages.push_back(std::move(page));
+    LOGF(DEBUG, "texture atlas page %zu started", pages.size() - 1);
+}
+
+bool TextureAtlas::copy(GLuint source, int sourceWidth, int sourceHeight, int levels, Page& page, int x, int y, int width, int height) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+    if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOGF(WARNING, "texture %u can't be read into the atlas; drawing it on its own", source);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        return false;
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+
+    // x and y are whole cells, so still texel boundaries at every page level; the size rounds up
+    // to cover the entry's last partial texel
+    const auto levelSize = [&](int level) {
+        return glm::ivec2((width + (1 << level) - 1) >> level, (height + (1 << level) - 1) >> level);
+    };
+    const auto blit = [&](int level, glm::ivec2 sourceSize, glm::ivec2 size, GLenum filter) {
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, page.texture, level);
+        const int px = x >> level;
+        const int py = y >> level;
+        const int w = size.x;
+        const int h = size.y;
+        const int sw = sourceSize.x;
+        const int sh = sourceSize.y;
+        const int g = GUTTER >> level;
+
+        // the image, then its edge rows, columns and corner texels stretched over the gutter
+        const int blits[9][8] = {
+            // source rectangle              destination rectangle
+            { 0, 0, sw, sh,                  px, py, px + w, py + h },
+            { 0, 0, 1, sh,                   px - g, py, px, py + h },
+            { sw - 1, 0, sw, sh,             px + w, py, px + w + g, py + h },
+            { 0, 0, sw, 1,                   px, py - g, px + w, py },
+            { 0, sh - 1, sw, sh,             px, py + h, px + w, py + h + g },
+            { 0, 0, 1, 1,                    px - g, py - g, px, py },
+            { sw - 1, 0, sw, 1,              px + w, py - g, px + w + g, py },
+            { 0, sh - 1, 1, sh,              px - g, py + h, px, py + h + g },
+            { sw - 1, sh - 1, sw, sh,        px + w, py + h, px + w + g, py + h + g },
+        };
+        for (const int* b : blits) {
+            glBlitFramebuffer(b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7], GL_COLOR_BUFFER_BIT, filter);
+        }
+    };
+    if (!copyMipChain(source, sourceWidth, sourceHeight, levels, MAX_MIP_LEVEL + 1, levelSize, blit)) {
+        page.mipsStale = true; // update() regenerates the page's mips
+    }
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    return true;
+}
+
+TextureAtlas::Stats TextureAtlas::getStats() const {
+    Stats stats;
+    stats.entries = (uint32_t)entries.size();
+    stats.pages = (uint32_t)pages.size();
+    for (const std::unique_ptr<Page>& page : pages) {
+        stats.usedTexels += page->usedTexels;
+    }
+    return stats;
+}
@@ -0,0 +1,129 @@
+#include "TextureCache.hpp"
+#include <filesystem>
+#include <unordered_set>
+#include "utils/logger.h"
+
+TextureCache::TextureCache(TextureLoader& loader, size_t vramBudget) : loader(loader), budget(vramBudget) {}
+
+// "./a/../b.png" and "b.png" name the same file; the flip flag changes the pixels so it is part of the key
+std::string TextureCache::makeKey(const std::string& path, bool flipVertically) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    std::string key = error ? path : canonical.string();
+    key += flipVertically ? "|flip" : "|noflip";
+    return key;
+}
+
+AsyncTextureHandle TextureCache::get(const std::string& path, bool flipVertically) {
+    std::string key = makeKey(path, flipVertically);
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        ++hits;
+        lru.splice(lru.begin(), lru, it->second.lru);
+        return it->second.texture;
+    }
+
+    lru.push_front(key);
+    Entry& entry = entries[key];
+    entry.texture = loader.load(path, flipVertically);
+    entry.lru = lru.begin();
+    return entry.texture;
+}
+
+void TextureCache::trim() {
+    size_t resident = getResidentBytes();
+    if (resident <= budget) {
+        loader.pruneContentIndex();
+        return;
+    }
+
+    auto it = lru.end();
+    while (resident > budget && it != lru.begin()) {
+        --it;
+        auto entry = entries.find(*it);
+        const AsyncTextureHandle& texture = entry->second.texture;
+
+        // still drawn with somewhere, or still in flight: keep it
+        if (texture.use_count() > 1 || (!texture->isResident() && !texture->hasFailed())) {
+            continue;
+        }
+
+        const TextureStorage* storage = texture->getStorage();
+        bool aliased = false;
+        if (storage) {
+            for (const auto& other : entries) {
+                if (&other.second != &entry->second && other.second.texture->getStorage() == storage) {
+                    aliased = true;
+                    break;
+                }
+            }
+        }
+        if (storage && !aliased) {
+            resident -= storage->bytes;
+        }
+
+        LOGF(DEBUG, "Texture cache: evicting %s (%zu KB)",
+            texture->getPath().c_str(), texture->getBytes() / 1024);
+        entries.erase(entry);
+        it = lru.erase(it);
+        ++evictions;
+    }
+    // evicted textures leave expired entries in the loader's dedupe index
+    loader.pruneContentIndex();
+
+    if (resident > budget) {
+        LOGF(WARNING, "Texture cache: %zu MB resident, over the %zu MB budget with nothing left to evict",
+            resident >> 20, budget >> 20);
+    }
+}
+
+void TextureCache::setBudget(size_t bytes) {
+    budget = bytes;
+}
+
+size_t TextureCache::getBudget() const {
+    return budget;
+}
+
+size_t TextureCache::getResidentBytes() const {
+    std::unordered_set<const TextureStorage*> counted;
+    size_t bytes = 0;
+    for (const auto& entry : entries) {
+        const TextureStorage* storage = entry.second.texture->getStorage();
+        if (storage && counted.insert(storage).second) {
+            bytes += storage->bytes;
+        }
+    }
+    return bytes;
+}
+
+size_t TextureCache::size() const {
+    return entries.size();
+}
+
+size_t TextureCache::getHits() const {
+    return hits;
+}
+
+size_t TextureCache::getEvictions() const {
+    return evictions;
+}
+
+void TextureCache::report() const {
+    LOGF(INFO, "Texture cache: %zu textures, %zu KB resident of %zu KB budget, %zu hits, %zu evictions",
+        entries.size(), getResidentBytes() / 1024, budget / 1024, hits, evictions);
+
+    for (const std::string& key : lru) {
+        const AsyncTextureHandle& texture = entries.at(key).texture;
+        const TextureStorage* storage = texture->getStorage();
+        if (storage) {
+            LOGF(INFO, "  %s: %dx%d, %zu KB (texture %u, %ld refs)",
+                texture->getPath().c_str(), storage->width, storage->height, storage->bytes / 1024,
+                storage->id, texture.use_count());
+        } else {
+            LOGF(INFO, "  %s: %s",
+                texture->getPath().c_str(), texture->hasFailed() ? "failed" : "loading");
+        }
+    }
+}
@@ -0,0 +1,379 @@
+#include "TextureLoader.hpp"
+#include <glad/glad.h>
+#include <stb_image/stb_image.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include "MipChain.hpp"
+#include "TextureUsage.hpp"
+#include "utils/logger.h"
+
+namespace {
+
+// GL internal format of a block-compressed pack format; 0 for raw texels
+GLenum compressedFormat(uint32_t format) {
+    switch (format) {
+    case PACK_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case PACK_FORMAT_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case PACK_FORMAT_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case PACK_FORMAT_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case PACK_FORMAT_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    case PACK_FORMAT_ETC2_RGB8: return GL_COMPRESSED_RGB8_ETC2;
+    case PACK_FORMAT_ETC2_RGBA8: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    default: return 0;
+    }
+}
+
+// RGTC is core since 3.0; S3TC is an extension everywhere, BPTC core in 4.2, ETC2 in 4.3
+bool canSample(uint32_t format) {
+    switch (format) {
+    case PACK_FORMAT_RAW:
+    case PACK_FORMAT_BC4:
+    case PACK_FORMAT_BC5:
+        return true;
+    case PACK_FORMAT_BC1:
+    case PACK_FORMAT_BC3:
+        return GLAD_GL_EXT_texture_compression_s3tc != 0;
+    case PACK_FORMAT_BC7:
+        return GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc;
+    case PACK_FORMAT_ETC2_RGB8:
+    case PACK_FORMAT_ETC2_RGBA8:
+        return GLAD_GL_VERSION_4_3 || GLAD_GL_ARB_ES3_compatibility;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+TextureStorage::~TextureStorage() {
+    if (id) {
+        glDeleteTextures(1, &id);
+    }
+}
+
+void TextureLoader::DecodedDeleter::operator()(unsigned char* data) const {
+    stbi_image_free(data);
+}
+
+StagingPool::StagingPool(size_t capacity) : capacity(capacity) {}
+
+// Returns the smallest idle buffer that fits, or a new one
+std::vector<unsigned char> StagingPool::acquire(size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t best = free.size();
+        for (size_t i = 0; i < free.size(); ++i) {
+            if (free[i].capacity() >= size && (best == free.size() || free[i].capacity() < free[best].capacity())) {
+                best = i;
+            }
+        }
+        if (best != free.size()) {
+            std::vector<unsigned char> buffer = std::move(free[best]);
+            free[best] = std::move(free.back());
+            free.pop_back();
+            freeBytes -= buffer.capacity();
+            buffer.resize(size);
+            return buffer;
+        }
+    }
+    return std::vector<unsigned char>(size);
+}
+
+void StagingPool::release(std::vector<unsigned char>&& buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (buffer.capacity() == 0 || freeBytes + buffer.capacity() > capacity) {
+        return; // over budget: let it go back to the allocator
+    }
+    freeBytes += buffer.capacity();
+    free.push_back(std::move(buffer));
+}
+
+TextureLoader::TextureLoader(unsigned workerCount, size_t uploadQueueCapacity)
+    : uploadQueueCapacity(std::max<size_t>(uploadQueueCapacity, 1)), staging(64u << 20) {
+    // 1x1 mid-grey stand-in bound until the real image is resident
+    const unsigned char grey[4] = { 128, 128, 128, 255 };
+    glGenTextures(1, &placeholder);
+    glBindTexture(GL_TEXTURE_2D, placeholder);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    if (workerCount == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        workerCount = std::min(std::max(cores, 2u) - 1, 4u);
+    }
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&TextureLoader::workerMain, this);
+    }
+}
+
+TextureLoader::~TextureLoader() {
+    {
+        std::lock_guard<std::mutex> requestLock(requestMutex);
+        std::lock_guard<std::mutex> uploadLock(uploadMutex);
+        stopping = true;
+    }
+    requestReady.notify_all();
+    uploadSpace.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    requests.clear();
+    uploads.clear();
+    glDeleteTextures(1, &placeholder);
+}
+
+AsyncTextureHandle TextureLoader::load(const std::string& path, bool flipVertically) {
+    AsyncTextureHandle texture = std::make_shared<AsyncTexture>();
+    texture->path = path;
+    texture->placeholder = placeholder;
+
+    ++pending;
+
+    // cooked: nothing to read or decode, queue the mapped mip chain for upload directly
+    const PackTexture* packed = pack ? pack->findTexture(path) : nullptr;
+    if (packed && !canSample(packed->format)) {
+        LOGF(WARNING, "%s is cooked in a format this context can't sample (%u); decoding the loose file", path.c_str(), packed->format);
+        packed = nullptr;
+    }
+    if (packed && ((packed->flags & PACK_TEXTURE_FLIPPED) != 0) == flipVertically) {
+        Upload item;
+        item.texture = texture;
+        item.packed = packed;
+        item.width = (int)packed->width;
+        item.height = (int)packed->height;
+        item.channels = (int)packed->channels;
+        item.contentHash = packed->contentHash;
+        for (uint32_t level = 0; level < packed->mipCount; ++level) {
+            item.bytes += packed->mips[level].size;
+        }
+        ++packedLoads;
+        std::lock_guard<std::mutex> lock(uploadMutex);
+        uploads.push_back(std::move(item));
+        return texture;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        requests.push_back({ texture, path, flipVertically });
+    }
+    requestReady.notify_one();
+    return texture;
+}
+
+void TextureLoader::workerMain() {
+    std::vector<unsigned char> fileBytes;
+
+    for (;;) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(requestMutex);
+            requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping) {
+                return;
+            }
+            request = std::move(requests.front());
+            requests.pop_front();
+        }
+
+        Upload item;
+        item.texture = std::move(request.texture);
+
+        // read the whole file, then decode from memory (fileBytes is reused per worker)
+        std::ifstream file(request.path, std::ios::binary);
+        if (file.is_open()) {
+            fileBytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        } else {
+            fileBytes.clear();
+        }
+
+        stbi_set_flip_vertically_on_load_thread(request.flip ? 1 : 0);
+        item.decoded.reset(fileBytes.empty() ? nullptr : stbi_load_from_memory(
+            fileBytes.data(), (int)fileBytes.size(), &item.width, &item.height, &item.channels, 0));
+        if (item.decoded) {
+            // level 0 is uploaded from stb_image's own buffer; the chain below it is built here,
+            // instead of by the driver, into staging memory
+            item.bytes = mipChainLayout(item.width, item.height, item.channels, item.levels);
+            const size_t size = item.levels[0].size;
+            item.pixels = staging.acquire(item.bytes - size);
+            item.contentHash = hashImagePixels(item.width, item.height, item.channels, item.decoded.get(), size);
+            const bool srgb = classifyTexture(request.path, item.channels) == TEXTURE_USAGE_COLOR;
+            const unsigned char* above = item.decoded.get();
+            for (size_t level = 1; level < item.levels.size(); ++level) {
+                const MipLevel& source = item.levels[level - 1];
+                unsigned char* target = item.pixels.data() + item.levels[level].offset - size;
+                downsampleLevel(above, source.width, source.height, item.channels, srgb, MIP_FILTER_BOX, target);
+                above = target;
+            }
+        }
+
+        // failed loads are queued too so the handle is released on the render thread
+        std::unique_lock<std::mutex> lock(uploadMutex);
+        uploadSpace.wait(lock, [this] { return stopping || uploads.size() < uploadQueueCapacity; });
+        if (stopping) {
+            return;
+        }
+        uploads.push_back(std::move(item));
+    }
+}
+
+size_t TextureLoader::processUploads(size_t byteBudget) {
+    size_t spent = 0;
+    for (;;) {
+        Upload item;
+        {
+            std::lock_guard<std::mutex> lock(uploadMutex);
+            if (uploads.empty()) {
+                break;
+            }
+            // always make progress, even if a single image exceeds the budget
+            if (spent > 0 && spent + uploads.front().bytes > byteBudget) {
+                break;
+            }
+            item = std::move(uploads.front());
+            uploads.pop_front();
+        }
+        uploadSpace.notify_one();
+
+        spent += item.bytes;
+        upload(item);
+        staging.release(std::move(item.pixels));
+        --pending;
+    }
+    uploadedBytes += spent;
+    return spent;
+}
+
+void TextureLoader::pruneContentIndex() {
+    for (auto it = contentIndex.begin(); it != contentIndex.end();) {
+        it = it->second.expired() ? contentIndex.erase(it) : std::next(it);
+    }
+}
+
+void TextureLoader::upload(Upload& item) {
+    AsyncTexture& texture = *item.texture;
+    if (!item.decoded && !item.packed) {
+        texture.failed = true;
+        std::cout << "Texture failed to load at path: " << texture.path << std::endl;
+        return;
+    }
+
+    // identical pixels already on the GPU: share that texture
+    auto existing = contentIndex.find(item.contentHash);
+    if (existing != contentIndex.end()) {
+        if (std::shared_ptr<TextureStorage> storage = existing->second.lock()) {
+            texture.storage = storage;
+            ++dedupedUploads;
+            return;
+        }
+    }
+
+    if (item.packed) {
+        uploadPacked(texture, *item.packed);
+        return;
+    }
+
+    GLenum format = GL_RGB;
+    if (item.channels == 1)
+        format = GL_RED;
+    else if (item.channels == 3)
+        format = GL_RGB;
+    else if (item.channels == 4)
+        format = GL_RGBA;
+    else
+        std::cout << "Unsupported number of channels: " << item.channels << std::endl;
+
+    std::shared_ptr<TextureStorage> storage = std::make_shared<TextureStorage>();
+    glGenTextures(1, &storage->id);
+    glBindTexture(GL_TEXTURE_2D, storage->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < item.levels.size(); ++level) {
+        const MipLevel& mip = item.levels[level];
+        const unsigned char* texels = level == 0 ? item.decoded.get() : item.pixels.data() + mip.offset - item.levels[0].size;
+        glTexImage2D(GL_TEXTURE_2D, (GLint)level, format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, texels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)item.levels.size() - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    storage->width = item.width;
+    storage->height = item.height;
+    storage->contentHash = item.contentHash;
+    storage->bytes = item.bytes;
+    storage->levels = (int)item.levels.size();
+    storage->channels = item.channels;
+
+    contentIndex[item.contentHash] = storage;
+    texture.storage = std::move(storage);
+}
+
+// Every level comes precomputed from the pack; the pointers go to GL as they are, so the only
+// copy is the driver's
+void TextureLoader::uploadPacked(AsyncTexture& texture, const PackTexture& packed) {
+    GLenum format = packed.channels == 1 ? GL_RED : packed.channels == 4 ? GL_RGBA : GL_RGB;
+    const GLenum compressed = compressedFormat(packed.format);
+
+    std::shared_ptr<TextureStorage> storage = std::make_shared<TextureStorage>();
+    glGenTextures(1, &storage->id);
+    glBindTexture(GL_TEXTURE_2D, storage->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (uint32_t level = 0; level < packed.mipCount; ++level) {
+        const PackMip& mip = packed.mips[level];
+        if (compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, compressed, mip.width, mip.height, 0, (GLsizei)mip.size, pack->data(mip.offset));
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, format, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, pack->data(mip.offset));
+        }
+        storage->bytes += mip.size;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // single-channel maps were greyscale images; sample them as grey, not red
+    if (packed.format == PACK_FORMAT_BC4) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+    storage->compressed = compressed != 0;
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, packed.mipCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, packed.mipCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    storage->width = (int)packed.width;
+    storage->height = (int)packed.height;
+    storage->contentHash = packed.contentHash;
+    storage->levels = (int)packed.mipCount;
+    storage->channels = (int)packed.channels;
+
+    contentIndex[packed.contentHash] = storage;
+    texture.storage = std::move(storage);
+}
+
+void TextureLoader::setPack(const AssetPack* assetPack) {
+    pack = assetPack;
+}
+
+size_t TextureLoader::getPending() const {
+    return pending;
+}
+
+size_t TextureLoader::getUploadedBytes() const {
+    return uploadedBytes;
+}
+
+size_t TextureLoader::getDedupedUploads() const {
+    return dedupedUploads;
+}
+
+size_t TextureLoader::getPackedLoads() const {
+    return packedLoads;
+}
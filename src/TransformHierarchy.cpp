@@ -0,0 +1,577 @@
+#include "TransformHierarchy.hpp"
+#include "JobSystem.hpp"
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE 1
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define TRANSFORM_AVX 1
+#endif
+
+namespace {
+
+// once 1/16th of the nodes are dirty, one pass over the whole hierarchy beats expanding the
+// dirty list node by node
+const size_t FULL_SCAN_DIVISOR = 16;
+
+// levels at least this large are spread over the job system, in ranges of PARALLEL_GRAIN nodes
+const size_t PARALLEL_LEVEL_MIN = 8192;
+const uint32_t PARALLEL_GRAIN = 2048;
+
+struct NodeArrays {
+    const uint32_t* parents;
+    const glm::vec3* positions;
+    const glm::quat* rotations;
+    const glm::vec3* scales;
+    glm::mat4* worlds;
+};
+
+const glm::mat4 identity(1.0f);
+
+const float* parentWorld(const NodeArrays& nodes, uint32_t slot) {
+    uint32_t parent = nodes.parents[slot];
+    return parent == 0xffffffffu ? &identity[0][0] : &nodes.worlds[parent][0][0];
+}
+
+// world = parent * translate(position) * rotate(rotation) * scale(scale)
+void composeScalar(const NodeArrays& nodes, uint32_t slot) {
+    glm::mat3 rotation = glm::mat3_cast(nodes.rotations[slot]);
+    const glm::vec3& scale = nodes.scales[slot];
+    glm::mat4 local(
+        glm::vec4(rotation[0] * scale.x, 0.0f),
+        glm::vec4(rotation[1] * scale.y, 0.0f),
+        glm::vec4(rotation[2] * scale.z, 0.0f),
+        glm::vec4(nodes.positions[slot], 1.0f));
+    uint32_t parent = nodes.parents[slot];
+    nodes.worlds[slot] = parent == 0xffffffffu ? local : nodes.worlds[parent] * local;
+}
+
+// Local TRS for a batch, one node per lane: quaternion, scale and translation components.
+// Filled with scalar loads, since the nodes of a level are not contiguous once some are skipped.
+template <size_t LANES>
+struct alignas(32) LaneInputs {
+    float qx[LANES], qy[LANES], qz[LANES], qw[LANES];
+    float sx[LANES], sy[LANES], sz[LANES];
+    float tx[LANES], ty[LANES], tz[LANES];
+
+    void gather(const NodeArrays& nodes, const uint32_t* slots) {
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            uint32_t slot = slots[lane];
+            const glm::quat& q = nodes.rotations[slot];
+            const glm::vec3& s = nodes.scales[slot];
+            const glm::vec3& t = nodes.positions[slot];
+            qx[lane] = q.x; qy[lane] = q.y; qz[lane] = q.z; qw[lane] = q.w;
+            sx[lane] = s.x; sy[lane] = s.y; sz[lane] = s.z;
+            tx[lane] = t.x; ty[lane] = t.y; tz[lane] = t.z;
+        }
+    }
+};
+
+#ifdef TRANSFORM_SSE
+// Four nodes at once, one per lane. Matrices are transposed in and out so that every
+// multiply works on the same element of four matrices.
+void composeSse(const NodeArrays& nodes, const uint32_t* slots) {
+    LaneInputs<4> in;
+    in.gather(nodes, slots);
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    __m128 qx = _mm_load_ps(in.qx), qy = _mm_load_ps(in.qy), qz = _mm_load_ps(in.qz), qw = _mm_load_ps(in.qw);
+    __m128 sx = _mm_load_ps(in.sx), sy = _mm_load_ps(in.sy), sz = _mm_load_ps(in.sz);
+
+    __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+    __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+    __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+    // local[column][row] for the 3x3 part, scale folded into the columns
+    __m128 l[3][3];
+    l[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    l[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    l[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+    l[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    l[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    l[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+    l[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    l[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    l[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+    __m128 t[3] = { _mm_load_ps(in.tx), _mm_load_ps(in.ty), _mm_load_ps(in.tz) };
+
+    // parent[column][row], one parent per lane
+    const float* parent[4];
+    for (size_t lane = 0; lane < 4; ++lane) {
+        parent[lane] = parentWorld(nodes, slots[lane]);
+    }
+    __m128 p[4][4];
+    for (int c = 0; c < 4; ++c) {
+        p[c][0] = _mm_loadu_ps(parent[0] + 4 * c);
+        p[c][1] = _mm_loadu_ps(parent[1] + 4 * c);
+        p[c][2] = _mm_loadu_ps(parent[2] + 4 * c);
+        p[c][3] = _mm_loadu_ps(parent[3] + 4 * c);
+        _MM_TRANSPOSE4_PS(p[c][0], p[c][1], p[c][2], p[c][3]);
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        __m128 r[4];
+        for (int row = 0; row < 4; ++row) {
+            if (c < 3) {
+                r[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0][row], l[c][0]), _mm_mul_ps(p[1][row], l[c][1])),
+                                    _mm_mul_ps(p[2][row], l[c][2]));
+            } else {
+                r[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p[0][row], t[0]), _mm_mul_ps(p[1][row], t[1])),
+                                    _mm_add_ps(_mm_mul_ps(p[2][row], t[2]), p[3][row]));
+            }
+        }
+        _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+        for (size_t lane = 0; lane < 4; ++lane) {
+            _mm_storeu_ps(&nodes.worlds[slots[lane]][c][0], r[lane]);
+        }
+    }
+}
+#endif
+
+#ifdef TRANSFORM_AVX
+// The SSE kernel eight wide; lanes 0-3 travel in the low halves, 4-7 in the high halves
+__attribute__((target("avx")))
+void composeAvx(const NodeArrays& nodes, const uint32_t* slots) {
+    LaneInputs<8> in;
+    in.gather(nodes, slots);
+
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    __m256 qx = _mm256_load_ps(in.qx), qy = _mm256_load_ps(in.qy), qz = _mm256_load_ps(in.qz), qw = _mm256_load_ps(in.qw);
+    __m256 sx = _mm256_load_ps(in.sx), sy = _mm256_load_ps(in.sy), sz = _mm256_load_ps(in.sz);
+
+    __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+    __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+    __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+    __m256 l[3][3];
+    l[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+    l[0][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+    l[0][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+    l[1][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+    l[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+    l[1][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+    l[2][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+    l[2][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+    l[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+    __m256 t[3] = { _mm256_load_ps(in.tx), _mm256_load_ps(in.ty), _mm256_load_ps(in.tz) };
+
+    const float* parent[8];
+    for (size_t lane = 0; lane < 8; ++lane) {
+        parent[lane] = parentWorld(nodes, slots[lane]);
+    }
+    __m256 p[4][4];
+    for (int c = 0; c < 4; ++c) {
+        __m128 a0 = _mm_loadu_ps(parent[0] + 4 * c), a1 = _mm_loadu_ps(parent[1] + 4 * c);
+        __m128 a2 = _mm_loadu_ps(parent[2] + 4 * c), a3 = _mm_loadu_ps(parent[3] + 4 * c);
+        __m128 b0 = _mm_loadu_ps(parent[4] + 4 * c), b1 = _mm_loadu_ps(parent[5] + 4 * c);
+        __m128 b2 = _mm_loadu_ps(parent[6] + 4 * c), b3 = _mm_loadu_ps(parent[7] + 4 * c);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        p[c][0] = _mm256_insertf128_ps(_mm256_castps128_ps256(a0), b0, 1);
+        p[c][1] = _mm256_insertf128_ps(_mm256_castps128_ps256(a1), b1, 1);
+        p[c][2] = _mm256_insertf128_ps(_mm256_castps128_ps256(a2), b2, 1);
+        p[c][3] = _mm256_insertf128_ps(_mm256_castps128_ps256(a3), b3, 1);
+    }
+
+    for (int c = 0; c < 4; ++c) {
+        __m256 r[4];
+        for (int row = 0; row < 4; ++row) {
+            if (c < 3) {
+                r[row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p[0][row], l[c][0]), _mm256_mul_ps(p[1][row], l[c][1])),
+                                       _mm256_mul_ps(p[2][row], l[c][2]));
+            } else {
+                r[row] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p[0][row], t[0]), _mm256_mul_ps(p[1][row], t[1])),
+                                       _mm256_add_ps(_mm256_mul_ps(p[2][row], t[2]), p[3][row]));
+            }
+        }
+        __m128 a0 = _mm256_castps256_ps128(r[0]), a1 = _mm256_castps256_ps128(r[1]);
+        __m128 a2 = _mm256_castps256_ps128(r[2]), a3 = _mm256_castps256_ps128(r[3]);
+        __m128 b0 = _mm256_extractf128_ps(r[0], 1), b1 = _mm256_extractf128_ps(r[1], 1);
+        __m128 b2 = _mm256_extractf128_ps(r[2], 1), b3 = _mm256_extractf128_ps(r[3], 1);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        _mm_storeu_ps(&nodes.worlds[slots[0]][c][0], a0);
+        _mm_storeu_ps(&nodes.worlds[slots[1]][c][0], a1);
+        _mm_storeu_ps(&nodes.worlds[slots[2]][c][0], a2);
+        _mm_storeu_ps(&nodes.worlds[slots[3]][c][0], a3);
+        _mm_storeu_ps(&nodes.worlds[slots[4]][c][0], b0);
+        _mm_storeu_ps(&nodes.worlds[slots[5]][c][0], b1);
+        _mm_storeu_ps(&nodes.worlds[slots[6]][c][0], b2);
+        _mm_storeu_ps(&nodes.worlds[slots[7]][c][0], b3);
+    }
+}
+
+bool cpuHasAvx() {
+    static const bool hasAvx = __builtin_cpu_supports("avx");
+    return hasAvx;
+}
+#endif
+
+template <typename T>
+void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+    std::vector<T> result;
+    result.reserve(order.size());
+    for (uint32_t slot : order) {
+        result.push_back(values[slot]);
+    }
+    values.swap(result);
+}
+
+} // namespace
+
+TransformId TransformHierarchy::create(TransformId parent, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    assert((parent == NULL_TRANSFORM || isValid(parent)) && "parent transform was destroyed");
+
+    TransformId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else {
+        id = (TransformId)slotOf.size();
+        slotOf.push_back(NO_SLOT);
+    }
+
+    uint32_t slot = (uint32_t)ids.size();
+    uint32_t parentSlot = parent == NULL_TRANSFORM ? NO_SLOT : slotOf[parent];
+    uint32_t depth = parentSlot == NO_SLOT ? 0 : depths[parentSlot] + 1;
+
+    // appending keeps the order when the node sorts after the current last one
+    if (orderValid && slot > 0) {
+        uint32_t lastDepth = depths[slot - 1];
+        uint32_t lastParent = parents[slot - 1];
+        orderValid = depth > lastDepth || (depth == lastDepth && (parentSlot == lastParent ||
+            (parentSlot != NO_SLOT && lastParent != NO_SLOT && parentSlot > lastParent)));
+    }
+
+    slotOf[id] = slot;
+    ids.push_back(id);
+    parents.push_back(parentSlot);
+    depths.push_back(depth);
+    firstChild.push_back(0);
+    childCount.push_back(0);
+    positions.push_back(position);
+    rotations.push_back(rotation);
+    scales.push_back(scale);
+    worlds.push_back(glm::mat4(1.0f));
+    dirty.push_back(0);
+    dead.push_back(0);
+
+    if (orderValid && parentSlot != NO_SLOT) {
+        if (childCount[parentSlot]++ == 0) {
+            firstChild[parentSlot] = slot;
+        }
+    }
+    markDirty(slot);
+    return id;
+}
+
+void TransformHierarchy::destroy(TransformId id) {
+    if (!isValid(id)) {
+        return;
+    }
+    uint32_t root = slotOf[id];
+
+    // the subtree: child ranges when they are current, otherwise each node's ancestor chain
+    std::vector<uint32_t> subtree;
+    if (orderValid) {
+        subtree.push_back(root);
+        for (size_t i = 0; i < subtree.size(); ++i) {
+            uint32_t slot = subtree[i];
+            for (uint32_t c = 0; c < childCount[slot]; ++c) {
+                subtree.push_back(firstChild[slot] + c);
+            }
+        }
+    } else {
+        for (uint32_t slot = 0; slot < ids.size(); ++slot) {
+            for (uint32_t s = slot; s != NO_SLOT && !dead[s]; s = parents[s]) {
+                if (s == root) {
+                    subtree.push_back(slot);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (uint32_t slot : subtree) {
+        dead[slot] = 1;
+        slotOf[ids[slot]] = NO_SLOT;
+        retiredIds.push_back(ids[slot]);
+    }
+    deadCount += subtree.size();
+    orderValid = false;
+}
+
+void TransformHierarchy::clear() {
+    slotOf.clear();
+    freeIds.clear();
+    ids.clear();
+    parents.clear();
+    depths.clear();
+    firstChild.clear();
+    childCount.clear();
+    positions.clear();
+    rotations.clear();
+    scales.clear();
+    worlds.clear();
+    dirty.clear();
+    dead.clear();
+    dirtyIds.clear();
+    retiredIds.clear();
+    deadCount = 0;
+    orderValid = true;
+}
+
+bool TransformHierarchy::isValid(TransformId id) const {
+    return id < slotOf.size() && slotOf[id] != NO_SLOT;
+}
+
+void TransformHierarchy::setParent(TransformId id, TransformId parent) {
+    assert(isValid(id) && (parent == NULL_TRANSFORM || isValid(parent)));
+    uint32_t slot = slotOf[id];
+    uint32_t parentSlot = parent == NULL_TRANSFORM ? NO_SLOT : slotOf[parent];
+    for (uint32_t s = parentSlot; s != NO_SLOT; s = parents[s]) {
+        if (s == slot) {
+            assert(false && "setParent would make a transform its own ancestor");
+            return;
+        }
+    }
+    if (parents[slot] == parentSlot) {
+        return;
+    }
+    parents[slot] = parentSlot;
+    orderValid = false;
+    markDirty(slot);
+}
+
+TransformId TransformHierarchy::getParent(TransformId id) const {
+    uint32_t parent = parents[slotOf[id]];
+    return parent == NO_SLOT ? NULL_TRANSFORM : ids[parent];
+}
+
+void TransformHierarchy::setPosition(TransformId id, const glm::vec3& position) {
+    uint32_t slot = slotOf[id];
+    positions[slot] = position;
+    markDirty(slot);
+}
+
+void TransformHierarchy::setRotation(TransformId id, const glm::quat& rotation) {
+    uint32_t slot = slotOf[id];
+    rotations[slot] = rotation;
+    markDirty(slot);
+}
+
+void TransformHierarchy::setScale(TransformId id, const glm::vec3& scale) {
+    uint32_t slot = slotOf[id];
+    scales[slot] = scale;
+    markDirty(slot);
+}
+
+void TransformHierarchy::setLocal(TransformId id, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    uint32_t slot = slotOf[id];
+    positions[slot] = position;
+    rotations[slot] = rotation;
+    scales[slot] = scale;
+    markDirty(slot);
+}
+
+void TransformHierarchy::markDirty(uint32_t slot) {
+    if (!dirty[slot]) {
+        dirty[slot] = 1;
+        dirtyIds.push_back(ids[slot]);
+    }
+}
+
+void TransformHierarchy::update(JobSystem* jobs) {
+    lastUpdated = 0;
+    if (!orderValid) {
+        rebuildOrder();
+    }
+    if (dirtyIds.empty()) {
+        return; // nothing moved
+    }
+
+    collectDirty();
+
+    // pending is in slot order, so it is grouped by depth; nodes of one level are independent
+    for (size_t begin = 0; begin < pending.size();) {
+        uint32_t depth = depths[pending[begin]];
+        size_t end = begin + 1;
+        while (end < pending.size() && depths[pending[end]] == depth) {
+            ++end;
+        }
+        const uint32_t* slots = pending.data() + begin;
+        if (jobs && end - begin >= PARALLEL_LEVEL_MIN) {
+            jobs->parallelFor((uint32_t)(end - begin), PARALLEL_GRAIN, [this, slots](uint32_t first, uint32_t last) {
+                computeLevel(slots + first, last - first);
+            });
+        } else {
+            computeLevel(slots, end - begin);
+        }
+        begin = end;
+    }
+
+    for (uint32_t slot : pending) {
+        dirty[slot] = 0;
+    }
+    lastUpdated = pending.size();
+    dirtyIds.clear();
+}
+
+void TransformHierarchy::copyWorlds(std::vector<glm::mat4>& byId, JobSystem* jobs) const {
+    byId.resize(slotOf.size());
+    auto copy = [this, &byId](uint32_t begin, uint32_t end) {
+        for (uint32_t slot = begin; slot < end; ++slot) {
+            if (!dead[slot]) {
+                byId[ids[slot]] = worlds[slot];
+            }
+        }
+    };
+    if (jobs && ids.size() >= PARALLEL_LEVEL_MIN) {
+        jobs->parallelFor((uint32_t)ids.size(), PARALLEL_GRAIN, copy);
+    } else {
+        copy(0, (uint32_t)ids.size());
+    }
+}
+
+void TransformHierarchy::collectDirty() {
+    pending.clear();
+
+    if (dirtyIds.size() >= ids.size() / FULL_SCAN_DIVISOR) {
+        // much of the hierarchy changed: one pass in depth order, children inherit the flag
+        for (uint32_t slot = 0; slot < ids.size(); ++slot) {
+            uint32_t parent = parents[slot];
+            if (parent != NO_SLOT && dirty[parent]) {
+                dirty[slot] = 1;
+            }
+            if (dirty[slot]) {
+                pending.push_back(slot);
+            }
+        }
+        return;
+    }
+
+    // a few changed: walk down from each through the child ranges, then restore depth order
+    for (TransformId id : dirtyIds) {
+        if (isValid(id)) { // skips nodes destroyed since they were marked
+            pending.push_back(slotOf[id]);
+        }
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+        uint32_t slot = pending[i];
+        for (uint32_t c = 0; c < childCount[slot]; ++c) {
+            uint32_t child = firstChild[slot] + c;
+            if (!dirty[child]) {
+                dirty[child] = 1;
+                pending.push_back(child);
+            }
+        }
+    }
+    std::sort(pending.begin(), pending.end());
+}
+
+void TransformHierarchy::computeLevel(const uint32_t* slots, size_t count) {
+    NodeArrays nodes = { parents.data(), positions.data(), rotations.data(), scales.data(), worlds.data() };
+    size_t i = 0;
+#ifdef TRANSFORM_AVX
+    if (cpuHasAvx()) {
+        for (; i + 8 <= count; i += 8) {
+            composeAvx(nodes, slots + i);
+        }
+    }
+#endif
+#ifdef TRANSFORM_SSE
+    for (; i + 4 <= count; i += 4) {
+        composeSse(nodes, slots + i);
+    }
+#endif
+    for (; i < count; ++i) {
+        composeScalar(nodes, slots[i]);
+    }
+}
+
+void TransformHierarchy::rebuildOrder() {
+    const uint32_t count = (uint32_t)ids.size();
+    const uint32_t UNKNOWN = 0xffffffffu;
+
+    // depth of every live node; parents may sit after their children until this runs
+    std::vector<uint32_t> depth(count, UNKNOWN);
+    std::vector<uint32_t> chain;
+    uint32_t maxDepth = 0;
+    for (uint32_t slot = 0; slot < count; ++slot) {
+        if (dead[slot]) {
+            continue;
+        }
+        uint32_t s = slot;
+        while (s != NO_SLOT && depth[s] == UNKNOWN) {
+            chain.push_back(s);
+            s = parents[s];
+        }
+        uint32_t d = s == NO_SLOT ? 0 : depth[s] + 1;
+        while (!chain.empty()) {
+            depth[chain.back()] = d++;
+            chain.pop_back();
+        }
+        maxDepth = std::max(maxDepth, depth[slot]);
+    }
+
+    // bucket by depth, then order each level by its parents' new positions
+    std::vector<std::vector<uint32_t>> levels(maxDepth + 1);
+    for (uint32_t slot = 0; slot < count; ++slot) {
+        if (!dead[slot]) {
+            levels[depth[slot]].push_back(slot);
+        }
+    }
+    std::vector<uint32_t> newSlot(count, NO_SLOT);
+    std::vector<uint32_t> order;
+    order.reserve(count - deadCount);
+    for (std::vector<uint32_t>& level : levels) {
+        if (&level != &levels[0]) {
+            std::stable_sort(level.begin(), level.end(),
+                [&](uint32_t a, uint32_t b) { return newSlot[parents[a]] < newSlot[parents[b]]; });
+        }
+        for (uint32_t slot : level) {
+            newSlot[slot] = (uint32_t)order.size();
+            order.push_back(slot);
+        }
+    }
+
+    std::vector<uint32_t> newParents;
+    std::vector<uint32_t> newDepths;
+    newParents.reserve(order.size());
+    newDepths.reserve(order.size());
+    for (uint32_t slot : order) {
+        newParents.push_back(parents[slot] == NO_SLOT ? NO_SLOT : newSlot[parents[slot]]);
+        newDepths.push_back(depth[slot]);
+    }
+    parents.swap(newParents);
+    depths.swap(newDepths);
+    permute(ids, order);
+    permute(positions, order);
+    permute(rotations, order);
+    permute(scales, order);
+    permute(worlds, order);
+    permute(dirty, order);
+    dead.assign(order.size(), 0);
+
+    // children of a node are now one contiguous run of the next level
+    firstChild.assign(order.size(), 0);
+    childCount.assign(order.size(), 0);
+    for (uint32_t slot = 0; slot < order.size(); ++slot) {
+        slotOf[ids[slot]] = slot;
+        uint32_t parent = parents[slot];
+        if (parent != NO_SLOT && childCount[parent]++ == 0) {
+            firstChild[parent] = slot;
+        }
+    }
+
+    freeIds.insert(freeIds.end(), retiredIds.begin(), retiredIds.end());
+    retiredIds.clear();
+    deadCount = 0;
+    orderValid = true;
+}
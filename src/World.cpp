@@ -0,0 +1,246 @@
+#include "World.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+std::mutex componentMutex;
+std::vector<ComponentInfo>& componentTable() {
+    static std::vector<ComponentInfo> table;
+    return table;
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+uint32_t registerComponent(const ComponentInfo& info) {
+    std::lock_guard<std::mutex> lock(componentMutex);
+    std::vector<ComponentInfo>& table = componentTable();
+    assert(table.size() < MAX_COMPONENT_TYPES && "raise MAX_COMPONENT_TYPES (and widen ComponentMask)");
+    table.push_back(info);
+    return (uint32_t)(table.size() - 1);
+}
+
+const ComponentInfo& getComponentInfo(uint32_t id) {
+    return componentTable()[id];
+}
+
+Archetype::Archetype(ComponentMask mask) : mask(mask) {
+    memset(columns, 0xff, sizeof(columns));
+    for (uint32_t id = 0; id < MAX_COMPONENT_TYPES; ++id) {
+        if (mask & (ComponentMask(1) << id)) {
+            columns[id] = (uint8_t)types.size();
+            types.push_back(id);
+        }
+    }
+
+    // as many rows as fit once every array is padded to its alignment
+    size_t rowBytes = sizeof(Entity);
+    for (uint32_t id : types) {
+        rowBytes += getComponentInfo(id).size;
+    }
+    size_t padding = (types.size() + 1) * CHUNK_ARRAY_ALIGNMENT;
+    capacity = (uint32_t)((CHUNK_BYTES - padding) / rowBytes);
+    assert(capacity > 0 && "component set too large for one chunk row");
+
+    size_t offset = alignUp(capacity * sizeof(Entity), CHUNK_ARRAY_ALIGNMENT);
+    for (uint32_t id : types) {
+        const ComponentInfo& info = getComponentInfo(id);
+        offset = alignUp(offset, std::max(info.alignment, CHUNK_ARRAY_ALIGNMENT));
+        offsets.push_back(offset);
+        offset += capacity * info.size;
+    }
+    assert(offset <= CHUNK_BYTES);
+}
+
+Archetype::~Archetype() {
+    for (uint32_t row = 0; row < count; ++row) {
+        for (uint32_t id : types) {
+            getComponentInfo(id).destroy(component(row, id));
+        }
+    }
+}
+
+size_t Archetype::getChunkSize(size_t chunk) const {
+    size_t first = chunk * capacity;
+    return std::min<size_t>(capacity, count - first);
+}
+
+void* Archetype::component(uint32_t row, uint32_t id) {
+    uint8_t column = columns[id];
+    return chunks[row / capacity]->data + offsets[column] + (row % capacity) * getComponentInfo(id).size;
+}
+
+uint32_t Archetype::appendRow(Entity entity) {
+    uint32_t row = (uint32_t)count;
+    if (row / capacity == chunks.size()) {
+        chunks.push_back(std::make_unique<Chunk>());
+    }
+    entities(row / capacity)[row % capacity] = entity;
+    ++count;
+    return row;
+}
+
+Entity Archetype::removeRow(uint32_t row, bool destroyRow) {
+    if (destroyRow) {
+        for (uint32_t id : types) {
+            getComponentInfo(id).destroy(component(row, id));
+        }
+    }
+
+    uint32_t last = (uint32_t)count - 1;
+    Entity moved;
+    if (row != last) {
+        for (uint32_t id : types) {
+            const ComponentInfo& info = getComponentInfo(id);
+            info.moveConstruct(component(row, id), component(last, id));
+            info.destroy(component(last, id));
+        }
+        moved = entities(last / capacity)[last % capacity];
+        entities(row / capacity)[row % capacity] = moved;
+    }
+
+    --count;
+    if (count % capacity == 0 && chunks.size() > count / capacity) {
+        chunks.pop_back();
+    }
+    return moved;
+}
+
+World::World() {
+    records.resize(1); // index 0 unused, so no live entity has index 0 and generation 0
+    records[0].generation = 0;
+}
+
+World::~World() {
+    queries.clear();
+    archetypeList.clear();
+    archetypes.clear();
+}
+
+Entity World::allocate() {
+    uint32_t index;
+    if (!freeIndices.empty()) {
+        index = freeIndices.back();
+        freeIndices.pop_back();
+    } else {
+        index = (uint32_t)records.size();
+        records.emplace_back();
+    }
+    ++alive;
+    return Entity{ index, records[index].generation };
+}
+
+Entity World::create() {
+    Entity entity = allocate();
+    Archetype& archetype = getArchetype(0);
+    records[entity.index].archetype = &archetype;
+    records[entity.index].row = archetype.appendRow(entity);
+    return entity;
+}
+
+void World::destroy(Entity entity) {
+    if (!find(entity)) {
+        return;
+    }
+    Record& record = records[entity.index];
+    removeRow(*record.archetype, record.row, true);
+
+    record.archetype = nullptr;
+    if (++record.generation == 0) {
+        record.generation = 1;
+    }
+    freeIndices.push_back(entity.index);
+    --alive;
+}
+
+void World::clear() {
+    for (uint32_t index = 1; index < records.size(); ++index) {
+        Record& record = records[index];
+        if (record.archetype) {
+            record.archetype = nullptr;
+            if (++record.generation == 0) {
+                record.generation = 1;
+            }
+            freeIndices.push_back(index);
+        }
+    }
+    alive = 0;
+    queries.clear();
+    archetypeList.clear();
+    archetypes.clear();
+}
+
+bool World::isAlive(Entity entity) const {
+    return find(entity) != nullptr;
+}
+
+const World::Record* World::find(Entity entity) const {
+    if (entity.index == 0 || entity.index >= records.size()) {
+        return nullptr;
+    }
+    const Record& record = records[entity.index];
+    return record.archetype && record.generation == entity.generation ? &record : nullptr;
+}
+
+void World::removeRow(Archetype& archetype, uint32_t row, bool destroyRow) {
+    Entity moved = archetype.removeRow(row, destroyRow);
+    if (!moved.isNull()) {
+        records[moved.index].row = row;
+    }
+}
+
+void World::migrate(Entity entity, ComponentMask mask) {
+    Record& record = records[entity.index];
+    Archetype& source = *record.archetype;
+    Archetype& destination = getArchetype(mask);
+    uint32_t sourceRow = record.row;
+    uint32_t row = destination.appendRow(entity);
+
+    // components in both sets move across; ones only in the source were destroyed by the caller
+    for (uint32_t id : source.types) {
+        if (mask & (ComponentMask(1) << id)) {
+            const ComponentInfo& info = getComponentInfo(id);
+            info.moveConstruct(destination.component(row, id), source.component(sourceRow, id));
+            info.destroy(source.component(sourceRow, id));
+        }
+    }
+    removeRow(source, sourceRow, false);
+
+    record.archetype = &destination;
+    record.row = row;
+}
+
+Archetype& World::getArchetype(ComponentMask mask) {
+    auto it = archetypes.find(mask);
+    if (it != archetypes.end()) {
+        return *it->second;
+    }
+    Archetype* archetype = new Archetype(mask);
+    archetypes.emplace(mask, std::unique_ptr<Archetype>(archetype));
+    archetypeList.push_back(archetype);
+    return *archetype;
+}
+
+Query& World::getQuery(ComponentMask mask) {
+    // find before inserting: looking up an existing query leaves the table untouched
+    auto it = queries.find(mask);
+    if (it == queries.end()) {
+        it = queries.emplace(mask, Query()).first;
+        it->second.mask = mask;
+    }
+    Query& query = it->second;
+    // archetypes are never destroyed, so only the ones created since the last call need checking
+    for (; query.examined < archetypeList.size(); ++query.examined) {
+        Archetype* archetype = archetypeList[query.examined];
+        if ((archetype->getMask() & mask) == mask) {
+            query.archetypes.push_back(archetype);
+        }
+    }
+    return query;
+}
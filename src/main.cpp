@@ -1,9 +1,24 @@
 #include "Application.hpp"
+#include <cstring>
 
-int main() {
+int main(int argc, char** argv) {
     // Create the application (or "Engine") object
     Application app;
 
+    // Command line options:
+    //   --instanced   draw the cube field with a single instanced draw call
+    //   --benchmark   ramp the instanced cube count up to 1M and log frame times
+    //   --indirect    submit scene draws through multi-draw indirect
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--instanced") == 0) {
+            app.setInstanced(true);
+        } else if (strcmp(argv[i], "--benchmark") == 0) {
+            app.enableBenchmark();
+        } else if (strcmp(argv[i], "--indirect") == 0) {
+            app.setIndirect(true);
+        }
+    }
+
     // Initialize (create window, init GLAD, etc.)
     if (!app.init()) {
         return -1;
@@ -1,42 +1,321 @@
 #include "utils/logger.h"
-#include <stdio.h>
-#include <iostream>
-#include <stdlib.h>
-#include <time.h>
-#include <string.h>
-#include <pthread.h>
-#include "stdbool.h"
-
-pthread_mutex_t logger_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-void LOG(unsigned tag, const char* file, unsigned line, const char* message) {
-    // Disable log based on log-type.
-    DISABLE_HANDLER(tag);
-
-    // Lock log file.
-    pthread_mutex_lock(&logger_mutex);
-
-    FILE *fp;
-    fp = fopen(FILENAME, "a");
-
-    time_t now;
-    time(&now);
-    char *t = ctime(&now);
-
-    time_t timer;
-    char buffer[26];
-    struct tm* tm_info;
-
-    // Get and format time.
-    timer = time(NULL);
-    tm_info = localtime(&timer);
-    strftime(buffer, 26, TIME_FORMAT, tm_info);
-    if (t[strlen(t)-1] == '\n') t[strlen(t)-1] = '\0';
-    // std::cout << "MESSAGE: " << message << std::endl;
-    // Write to file.
-    printf("%s [%s]: %s:%d %s\n", buffer, CONVERT_INT_TO_NAME(tag), file, line, message);
-    // fclose(fp);
-
-    // Unlock log file.
-    pthread_mutex_unlock(&logger_mutex);
-}
\ No newline at end of file
+#include "utils/logformat.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Producers never lock or touch a FILE*: each call site registers its format once, and every
+// call encodes just its arguments into a fixed-size record in the calling thread's own
+// single-producer/single-consumer ring. One background thread drains every ring, orders the
+// batch by timestamp and either formats it as text or appends it to the binary log, writing
+// the batch with one fwrite per sink.
+
+namespace logging {
+
+namespace {
+
+const size_t LOG_RING_CAPACITY = 1024;      // records per thread, power of two
+const size_t LOG_ARG_BYTES = 240;           // encoded arguments beyond this are cut off
+
+struct LogRecord {
+    uint64_t timestamp;                     // steady_clock nanoseconds
+    uint32_t formatId;
+    uint16_t tag;
+    uint16_t argBytes;
+    uint8_t args[LOG_ARG_BYTES];
+};
+static_assert(sizeof(LogRecord) == 256, "keep records a whole number of cache lines");
+
+struct LogRing {
+    alignas(64) std::atomic<size_t> head{0};    // next slot to write (producer)
+    alignas(64) std::atomic<size_t> tail{0};    // next slot to read (consumer)
+    alignas(64) std::atomic<bool> retired{false};
+    std::atomic<uint64_t> dropped{0};
+    LogRecord records[LOG_RING_CAPACITY];
+};
+
+struct FormatSite {
+    unsigned tag;
+    const char* file;
+    unsigned line;
+    const char* format;
+};
+
+uint64_t now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Logger {
+public:
+    Logger() : startSteady(now()) {
+        startWall = (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+#ifdef LOG_BINARY
+        file = fopen(BINARY_FILENAME, "wb");
+        if (file) {
+            BinaryLogHeader header = { BINARY_LOG_MAGIC, BINARY_LOG_VERSION, startWall, startSteady };
+            fwrite(&header, sizeof(header), 1, file);
+        }
+        lastTimestamp = startSteady;
+#else
+        file = fopen(FILENAME, "a");
+#endif
+        writer = std::thread(&Logger::writerMain, this);
+    }
+
+    ~Logger() {
+        stopping = true;
+        writer.join();
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    uint32_t registerFormat(unsigned tag, const char* file, unsigned line, const char* format) {
+        std::lock_guard<std::mutex> lock(sitesMutex);
+        sites.push_back({ tag, file, line, format });
+        return (uint32_t)(sites.size() - 1);
+    }
+
+    // the calling thread's ring, registered on first use and retired when the thread exits
+    LogRing& ring() {
+        struct Owner {
+            std::shared_ptr<LogRing> ring;
+            ~Owner() {
+                if (ring) {
+                    ring->retired = true;
+                }
+            }
+        };
+        thread_local Owner owner;
+        if (!owner.ring) {
+            owner.ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(ringsMutex); // once per thread
+            rings.push_back(owner.ring);
+        }
+        return *owner.ring;
+    }
+
+    // the next free slot, or nullptr when the writer has fallen a full ring behind
+    static LogRecord* begin(LogRing& ring) {
+        size_t head = ring.head.load(std::memory_order_relaxed);
+        if (head - ring.tail.load(std::memory_order_acquire) >= LOG_RING_CAPACITY) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &ring.records[head & (LOG_RING_CAPACITY - 1)];
+    }
+
+    static void commit(LogRing& ring) {
+        ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // waits until everything committed before the call has been written
+    void flush() {
+        uint64_t target = now();
+        while (writtenUpTo.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+
+private:
+    void writerMain() {
+        std::vector<LogRecord> batch;
+        std::string out;
+        for (;;) {
+            bool stop = stopping.load();
+            uint64_t drainedAt = now();
+            uint64_t dropped = drain(batch);
+
+            if (!batch.empty() || dropped) {
+                {
+                    std::lock_guard<std::mutex> lock(sitesMutex);
+#ifdef LOG_BINARY
+                    encode(batch, dropped, out);
+#else
+                    format(batch, dropped, out);
+#endif
+                }
+#ifndef LOG_BINARY
+                fwrite(out.data(), 1, out.size(), stdout);
+                fflush(stdout);
+#endif
+                if (file) {
+                    fwrite(out.data(), 1, out.size(), file);
+                    fflush(file);
+                }
+                batch.clear();
+                out.clear();
+            }
+            writtenUpTo.store(drainedAt, std::memory_order_release);
+
+            if (stop) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // moves every committed record into `batch`, oldest first; frees rings of exited threads
+    uint64_t drain(std::vector<LogRecord>& batch) {
+        uint64_t dropped = 0;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (size_t r = 0; r < rings.size();) {
+            LogRing& ring = *rings[r];
+            bool retired = ring.retired.load(std::memory_order_acquire);
+            size_t tail = ring.tail.load(std::memory_order_relaxed);
+            size_t head = ring.head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail) {
+                batch.push_back(ring.records[tail & (LOG_RING_CAPACITY - 1)]);
+            }
+            ring.tail.store(tail, std::memory_order_release);
+            dropped += ring.dropped.exchange(0, std::memory_order_relaxed);
+
+            if (retired) {
+                rings[r] = std::move(rings.back());
+                rings.pop_back();
+            } else {
+                ++r;
+            }
+        }
+        // each ring is already in order; interleave threads by time
+        std::stable_sort(batch.begin(), batch.end(),
+            [](const LogRecord& a, const LogRecord& b) { return a.timestamp < b.timestamp; });
+        return dropped;
+    }
+
+    void format(const std::vector<LogRecord>& batch, uint64_t dropped, std::string& out) {
+        std::string message;
+        for (const LogRecord& record : batch) {
+            const FormatSite& site = sites[record.formatId];
+            message.clear();
+            formatMessage(site.format, record.args, record.argBytes, message);
+            formatLine(timeString(record.timestamp), site.tag, site.file, site.line, message, out);
+        }
+        if (dropped) {
+            formatDroppedLine(timeString(now()), dropped, out);
+        }
+    }
+
+    // format definitions go out once, ahead of their first record
+    void encode(const std::vector<LogRecord>& batch, uint64_t dropped, std::string& out) {
+        uint8_t scratch[16];
+        auto varint = [&](uint64_t value) {
+            ArgWriter writer{ scratch, sizeof(scratch) };
+            writer.varint(value);
+            out.append(reinterpret_cast<const char*>(scratch), writer.size);
+        };
+        auto text = [&](const char* value) {
+            size_t length = strlen(value);
+            varint(length);
+            out.append(value, length);
+        };
+
+        for (const LogRecord& record : batch) {
+            if (record.formatId >= formatsWritten.size()) {
+                formatsWritten.resize(sites.size(), false);
+            }
+            if (!formatsWritten[record.formatId]) {
+                const FormatSite& site = sites[record.formatId];
+                out += 'F';
+                varint(record.formatId);
+                out += (char)site.tag;
+                varint(site.line);
+                text(site.file);
+                text(site.format);
+                formatsWritten[record.formatId] = true;
+            }
+            int64_t delta = (int64_t)(record.timestamp - lastTimestamp);
+            lastTimestamp = record.timestamp;
+            out += 'R';
+            varint(record.formatId);
+            varint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+            varint(record.argBytes);
+            out.append(reinterpret_cast<const char*>(record.args), record.argBytes);
+        }
+        if (dropped) {
+            out += 'D';
+            varint(dropped);
+        }
+    }
+
+    // wall-clock text for a steady timestamp; strftime only runs when the second changes
+    const char* timeString(uint64_t timestamp) {
+        int64_t wall = startWall + (int64_t)(timestamp - startSteady);
+        int64_t second = wall / 1000000000;
+        if (second != cachedSecond) {
+            formatTime(wall, cachedTime, sizeof(cachedTime));
+            cachedSecond = second;
+        }
+        return cachedTime;
+    }
+
+    const uint64_t startSteady;
+    int64_t startWall = 0;
+    int64_t cachedSecond = -1;
+    char cachedTime[64] = {};
+    uint64_t lastTimestamp = 0;
+    std::vector<bool> formatsWritten;
+
+    FILE* file = nullptr;
+    std::thread writer;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> writtenUpTo{0};
+
+    std::mutex ringsMutex; // registration and the writer only, never taken per message
+    std::vector<std::shared_ptr<LogRing>> rings;
+
+    std::mutex sitesMutex; // first call of each call site, and the writer
+    std::deque<FormatSite> sites;
+};
+
+Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+// the record reserve() handed out, finished by commit() on the same thread
+thread_local LogRing* pendingRing = nullptr;
+thread_local LogRecord* pendingRecord = nullptr;
+
+} // namespace
+
+uint32_t registerFormat(unsigned tag, const char* file, unsigned line, const char* format) {
+    return logger().registerFormat(tag, file, line, format);
+}
+
+uint8_t* reserve(size_t& capacity) {
+    pendingRing = &logger().ring();
+    pendingRecord = Logger::begin(*pendingRing);
+    if (!pendingRecord) {
+        return nullptr;
+    }
+    pendingRecord->timestamp = now();
+    capacity = LOG_ARG_BYTES;
+    return pendingRecord->args;
+}
+
+void commit(uint32_t formatId, unsigned tag, size_t argBytes) {
+    pendingRecord->formatId = formatId;
+    pendingRecord->tag = (uint16_t)tag;
+    pendingRecord->argBytes = (uint16_t)argBytes;
+    Logger::commit(*pendingRing);
+    if (tag == 4) {
+        logger().flush(); // FATAL: make sure it is written before the caller goes down
+    }
+}
+
+} // namespace logging
+
+void LOG_FLUSH() {
+    logging::logger().flush();
+}
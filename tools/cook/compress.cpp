@@ -0,0 +1,488 @@
+#include "compress.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Principal axis of the block's first `channels` channels, by power iteration on the
+// covariance; returns false for a flat block (every texel the same)
+bool principalAxis(const unsigned char block[16][4], int channels, float mean[4], float axis[4]) {
+    for (int c = 0; c < 4; ++c) {
+        mean[c] = 0.0f;
+        axis[c] = c < channels ? 1.0f : 0.0f;
+    }
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            mean[c] += block[i][c] / 16.0f;
+        }
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        float d[4];
+        for (int c = 0; c < channels; ++c) {
+            d[c] = block[i][c] - mean[c];
+        }
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length = std::max(length, std::fabs(next[a]));
+        }
+        if (length < 1e-6f) {
+            return false;
+        }
+        for (int a = 0; a < channels; ++a) {
+            axis[a] = next[a] / length;
+        }
+    }
+    return true;
+}
+
+// The block's extremes along its principal axis
+void axisEndpoints(const unsigned char block[16][4], int channels, float low[4], float high[4]) {
+    float mean[4], axis[4];
+    if (!principalAxis(block, channels, mean, axis)) {
+        for (int c = 0; c < 4; ++c) {
+            low[c] = high[c] = mean[c];
+        }
+        return;
+    }
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (block[i][c] - mean[c]) * axis[c];
+        }
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float lengthSquared = 0.0f;
+    for (int c = 0; c < channels; ++c) {
+        lengthSquared += axis[c] * axis[c];
+    }
+    for (int c = 0; c < 4; ++c) {
+        low[c] = std::min(std::max(mean[c] + axis[c] * minT / lengthSquared, 0.0f), 255.0f);
+        high[c] = std::min(std::max(mean[c] + axis[c] * maxT / lengthSquared, 0.0f), 255.0f);
+    }
+}
+
+int distanceSquared(const unsigned char* a, const int* b, int channels) {
+    int sum = 0;
+    for (int c = 0; c < channels; ++c) {
+        int d = (int)a[c] - b[c];
+        sum += d * d;
+    }
+    return sum;
+}
+
+// writes bits least significant first, as BC7 lays them out
+struct BitWriter {
+    unsigned char* out;
+    int position = 0;
+
+    void put(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++position) {
+            if (value & (1u << i)) {
+                out[position >> 3] |= (unsigned char)(1u << (position & 7));
+            }
+        }
+    }
+};
+
+void storeBigEndian(uint64_t value, unsigned char* out) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = (unsigned char)(value >> (56 - 8 * i));
+    }
+}
+
+uint16_t packRGB565(const float rgb[3]) {
+    int r = (int)std::lround(rgb[0] * 31.0f / 255.0f);
+    int g = (int)std::lround(rgb[1] * 63.0f / 255.0f);
+    int b = (int)std::lround(rgb[2] * 31.0f / 255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t color, int rgb[3]) {
+    int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// ETC1 intensity modifiers, per table: small and large step
+const int ETC_MODIFIERS[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// EAC alpha modifiers, per table
+const int EAC_MODIFIERS[16][8] = {
+    { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+    { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+    { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+    { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+    { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+    { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+    { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+// BC7 4-bit index interpolation weights, out of 64
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Best table and per-texel modifier indices for an ETC1 subblock around `base`; texels are
+// the block indices in the subblock. Returns the squared error.
+int fitETCSubblock(const unsigned char block[16][4], const int* texels, const int base[3], int& table, int indices[16]) {
+    int bestError = -1;
+    for (int t = 0; t < 8; ++t) {
+        int error = 0;
+        int chosen[8];
+        for (int i = 0; i < 8; ++i) {
+            int bestTexel = -1;
+            for (int m = 0; m < 4; ++m) {
+                // index bits: msb = negative, lsb = large
+                int modifier = ETC_MODIFIERS[t][m & 1] * ((m & 2) ? -1 : 1);
+                int color[3];
+                for (int c = 0; c < 3; ++c) {
+                    color[c] = std::min(std::max(base[c] + modifier, 0), 255);
+                }
+                int d = distanceSquared(block[texels[i]], color, 3);
+                if (bestTexel < 0 || d < bestTexel) {
+                    bestTexel = d;
+                    chosen[i] = m;
+                }
+            }
+            error += bestTexel;
+        }
+        if (bestError < 0 || error < bestError) {
+            bestError = error;
+            table = t;
+            for (int i = 0; i < 8; ++i) {
+                indices[texels[i]] = chosen[i];
+            }
+        }
+    }
+    return bestError;
+}
+
+// One orientation of an ETC1 block (two 2x4 or two 4x2 halves); fills the 64-bit word and
+// returns the squared error
+int encodeETCOrientation(const unsigned char block[16][4], bool flip, uint64_t& word) {
+    int texels[2][8];
+    int counts[2] = { 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        int x = i & 3, y = i >> 2;
+        int half = flip ? (y >= 2) : (x >= 2);
+        texels[half][counts[half]++] = i;
+    }
+    float average[2][3] = {};
+    for (int half = 0; half < 2; ++half) {
+        for (int i = 0; i < 8; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                average[half][c] += block[texels[half][i]][c] / 8.0f;
+            }
+        }
+    }
+
+    // differential mode (5-bit base, 3-bit signed delta) when the halves are close enough,
+    // otherwise two independent 4-bit bases
+    int quantized[2][3];
+    bool differential = true;
+    for (int c = 0; c < 3; ++c) {
+        quantized[0][c] = (int)std::lround(average[0][c] * 31.0f / 255.0f);
+        quantized[1][c] = (int)std::lround(average[1][c] * 31.0f / 255.0f);
+        int delta = quantized[1][c] - quantized[0][c];
+        differential = differential && delta >= -4 && delta <= 3;
+    }
+    int base[2][3];
+    for (int half = 0; half < 2; ++half) {
+        for (int c = 0; c < 3; ++c) {
+            if (differential) {
+                int q = quantized[half][c];
+                base[half][c] = (q << 3) | (q >> 2);
+            } else {
+                quantized[half][c] = (int)std::lround(average[half][c] * 15.0f / 255.0f);
+                base[half][c] = quantized[half][c] * 17;
+            }
+        }
+    }
+
+    int tables[2];
+    int indices[16] = {};
+    int error = fitETCSubblock(block, texels[0], base[0], tables[0], indices)
+              + fitETCSubblock(block, texels[1], base[1], tables[1], indices);
+
+    word = 0;
+    for (int c = 0; c < 3; ++c) {
+        int shift = 56 - 8 * c;
+        if (differential) {
+            word |= (uint64_t)quantized[0][c] << (shift + 3);
+            word |= (uint64_t)((quantized[1][c] - quantized[0][c]) & 7) << shift;
+        } else {
+            word |= (uint64_t)quantized[0][c] << (shift + 4);
+            word |= (uint64_t)quantized[1][c] << shift;
+        }
+    }
+    word |= (uint64_t)tables[0] << 37;
+    word |= (uint64_t)tables[1] << 34;
+    word |= (uint64_t)(differential ? 1 : 0) << 33;
+    word |= (uint64_t)(flip ? 1 : 0) << 32;
+    // texel (x, y) is bit x * 4 + y of each index plane
+    for (int i = 0; i < 16; ++i) {
+        int bit = (i & 3) * 4 + (i >> 2);
+        word |= (uint64_t)((indices[i] >> 1) & 1) << (16 + bit);
+        word |= (uint64_t)(indices[i] & 1) << bit;
+    }
+    return error;
+}
+
+} // namespace
+
+void encodeBC1(const unsigned char block[16][4], unsigned char* out) {
+    float low[4], high[4];
+    axisEndpoints(block, 3, low, high);
+    uint16_t color0 = packRGB565(high);
+    uint16_t color1 = packRGB565(low);
+    if (color0 < color1) {
+        std::swap(color0, color1);
+    }
+
+    int palette[4][3];
+    unpackRGB565(color0, palette[0]);
+    unpackRGB565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestDistance = distanceSquared(block[i], palette[0], 3);
+            for (int p = 1; p < 4; ++p) {
+                int d = distanceSquared(block[i], palette[p], 3);
+                if (d < bestDistance) {
+                    bestDistance = d;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+    out[0] = (unsigned char)(color0 & 0xff);
+    out[1] = (unsigned char)(color0 >> 8);
+    out[2] = (unsigned char)(color1 & 0xff);
+    out[3] = (unsigned char)(color1 >> 8);
+    for (int i = 0; i < 4; ++i) {
+        out[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+}
+
+void encodeBC3(const unsigned char block[16][4], unsigned char* out) {
+    encodeBC4(block, 3, out);
+    encodeBC1(block, out + 8);
+}
+
+void encodeBC4(const unsigned char block[16][4], int channel, unsigned char* out) {
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; ++i) {
+        low = std::min(low, (int)block[i][channel]);
+        high = std::max(high, (int)block[i][channel]);
+    }
+    // eight-value mode: endpoint 0 above endpoint 1, six steps between
+    int palette[8] = { high, low };
+    for (int p = 2; p < 8; ++p) {
+        palette[p] = ((8 - p) * high + (p - 1) * low + 3) / 7;
+    }
+
+    uint64_t indices = 0;
+    if (high != low) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0;
+            int bestDistance = 256;
+            for (int p = 0; p < 8; ++p) {
+                int d = std::abs((int)block[i][channel] - palette[p]);
+                if (d < bestDistance) {
+                    bestDistance = d;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+    out[0] = (unsigned char)high;
+    out[1] = (unsigned char)low;
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = (unsigned char)(indices >> (8 * i));
+    }
+}
+
+void encodeBC5(const unsigned char block[16][4], unsigned char* out) {
+    encodeBC4(block, 0, out);
+    encodeBC4(block, 1, out + 8);
+}
+
+void encodeBC7(const unsigned char block[16][4], unsigned char* out) {
+    float low[4], high[4];
+    axisEndpoints(block, 4, low, high);
+
+    // 7-bit endpoints sharing a parity bit each; pick the parity that lands closest
+    const float* ends[2] = { low, high };
+    int quantized[2][4];
+    int parity[2];
+    int endpoint[2][4];
+    for (int e = 0; e < 2; ++e) {
+        int bestError = -1;
+        for (int p = 0; p < 2; ++p) {
+            int q[4], error = 0;
+            for (int c = 0; c < 4; ++c) {
+                q[c] = std::min(std::max((int)std::lround((ends[e][c] - p) / 2.0f), 0), 127);
+                int value = (q[c] << 1) | p;
+                error += (int)((value - ends[e][c]) * (value - ends[e][c]));
+            }
+            if (bestError < 0 || error < bestError) {
+                bestError = error;
+                parity[e] = p;
+                std::copy(q, q + 4, quantized[e]);
+            }
+        }
+        for (int c = 0; c < 4; ++c) {
+            endpoint[e][c] = (quantized[e][c] << 1) | parity[e];
+        }
+    }
+
+    int palette[16][4];
+    for (int w = 0; w < 16; ++w) {
+        for (int c = 0; c < 4; ++c) {
+            palette[w][c] = ((64 - BC7_WEIGHTS[w]) * endpoint[0][c] + BC7_WEIGHTS[w] * endpoint[1][c] + 32) >> 6;
+        }
+    }
+    int indices[16];
+    for (int i = 0; i < 16; ++i) {
+        int bestDistance = -1;
+        for (int w = 0; w < 16; ++w) {
+            int d = distanceSquared(block[i], palette[w], 4);
+            if (bestDistance < 0 || d < bestDistance) {
+                bestDistance = d;
+                indices[i] = w;
+            }
+        }
+    }
+    // the first texel's index drops its top bit, so it must be below 8
+    if (indices[0] >= 8) {
+        std::swap(quantized[0], quantized[1]);
+        std::swap(parity[0], parity[1]);
+        for (int& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter bits{ out };
+    bits.put(1u << 6, 7);                   // mode 6
+    for (int c = 0; c < 4; ++c) {
+        bits.put((uint32_t)quantized[0][c], 7);
+        bits.put((uint32_t)quantized[1][c], 7);
+    }
+    bits.put((uint32_t)parity[0], 1);
+    bits.put((uint32_t)parity[1], 1);
+    bits.put((uint32_t)indices[0], 3);
+    for (int i = 1; i < 16; ++i) {
+        bits.put((uint32_t)indices[i], 4);
+    }
+}
+
+void encodeETC2RGB(const unsigned char block[16][4], unsigned char* out) {
+    uint64_t sideBySide = 0, stacked = 0;
+    int sideBySideError = encodeETCOrientation(block, false, sideBySide);
+    int stackedError = encodeETCOrientation(block, true, stacked);
+    storeBigEndian(stackedError < sideBySideError ? stacked : sideBySide, out);
+}
+
+void encodeETC2RGBA(const unsigned char block[16][4], unsigned char* out) {
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; ++i) {
+        low = std::min(low, (int)block[i][3]);
+        high = std::max(high, (int)block[i][3]);
+    }
+
+    // per table, the multipliers that about span the block's range, around a centred base
+    int bestError = -1;
+    uint64_t best = 0;
+    for (int t = 0; t < 16; ++t) {
+        const int* modifiers = EAC_MODIFIERS[t];
+        int span = modifiers[7] - modifiers[3];
+        int guess = std::max((high - low + span - 1) / span, 1);
+        for (int multiplier = std::max(guess - 1, 1); multiplier <= std::min(guess + 1, 15); ++multiplier) {
+            int base = std::min(std::max((int)std::lround((high + low) / 2.0 - (modifiers[7] + modifiers[3]) * multiplier / 2.0), 0), 255);
+            int error = 0;
+            uint64_t word = ((uint64_t)base << 56) | ((uint64_t)multiplier << 52) | ((uint64_t)t << 48);
+            for (int i = 0; i < 16; ++i) {
+                int bestIndex = 0, bestDistance = -1;
+                for (int m = 0; m < 8; ++m) {
+                    int value = std::min(std::max(base + modifiers[m] * multiplier, 0), 255);
+                    int d = std::abs(value - (int)block[i][3]);
+                    if (bestDistance < 0 || d < bestDistance) {
+                        bestDistance = d;
+                        bestIndex = m;
+                    }
+                }
+                error += bestDistance * bestDistance;
+                // texel (x, y) is the (x * 4 + y)th index, first in the top bits
+                int position = (i & 3) * 4 + (i >> 2);
+                word |= (uint64_t)bestIndex << (45 - 3 * position);
+            }
+            if (bestError < 0 || error < bestError) {
+                bestError = error;
+                best = word;
+            }
+        }
+    }
+    storeBigEndian(best, out);
+    encodeETC2RGB(block, out + 8);
+}
+
+std::vector<unsigned char> compressImage(const unsigned char* pixels, int width, int height, int channels, PackTextureFormat format) {
+    const int blocksWide = (width + 3) / 4;
+    const int blocksHigh = (height + 3) / 4;
+    const size_t bytes = (size_t)packBlockBytes(format);
+    std::vector<unsigned char> out((size_t)blocksWide * blocksHigh * bytes);
+
+    unsigned char block[16][4];
+    unsigned char* cursor = out.data();
+    for (int by = 0; by < blocksHigh; ++by) {
+        for (int bx = 0; bx < blocksWide; ++bx) {
+            for (int i = 0; i < 16; ++i) {
+                int x = std::min(bx * 4 + (i & 3), width - 1);
+                int y = std::min(by * 4 + (i >> 2), height - 1);
+                const unsigned char* texel = pixels + ((size_t)y * width + x) * channels;
+                block[i][0] = texel[0];
+                block[i][1] = channels >= 3 ? texel[1] : texel[0];
+                block[i][2] = channels >= 3 ? texel[2] : texel[0];
+                block[i][3] = channels == 4 ? texel[3] : channels == 2 ? texel[1] : 255;
+            }
+            switch (format) {
+            case PACK_FORMAT_BC1: encodeBC1(block, cursor); break;
+            case PACK_FORMAT_BC3: encodeBC3(block, cursor); break;
+            case PACK_FORMAT_BC4: encodeBC4(block, 0, cursor); break;
+            case PACK_FORMAT_BC5: encodeBC5(block, cursor); break;
+            case PACK_FORMAT_BC7: encodeBC7(block, cursor); break;
+            case PACK_FORMAT_ETC2_RGB8: encodeETC2RGB(block, cursor); break;
+            case PACK_FORMAT_ETC2_RGBA8: encodeETC2RGBA(block, cursor); break;
+            default: break;
+            }
+            cursor += bytes;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,28 @@
+// Block compression for the cooker: each function encodes one 4x4 block of RGBA8 texels
+// (row-major, rows in the order GL receives them) into the bytes GL expects for the format.
+// The encoders aim for reasonable quality at cook-time speed: endpoints from the principal
+// axis of the block's colours, then the nearest palette entry per texel.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "AssetPack.hpp"
+
+// 8 bytes: RGB, 1-bit alpha unused (always the four-colour mode)
+void encodeBC1(const unsigned char block[16][4], unsigned char* out);
+// 16 bytes: BC4-style alpha block, then a BC1 colour block
+void encodeBC3(const unsigned char block[16][4], unsigned char* out);
+// 8 bytes: one channel of the block
+void encodeBC4(const unsigned char block[16][4], int channel, unsigned char* out);
+// 16 bytes: red, then green, each as BC4
+void encodeBC5(const unsigned char block[16][4], unsigned char* out);
+// 16 bytes: mode 6 only (one subset, RGBA endpoints, 4-bit indices)
+void encodeBC7(const unsigned char block[16][4], unsigned char* out);
+// 8 bytes: ETC1-compatible individual or differential mode, valid ETC2 RGB8
+void encodeETC2RGB(const unsigned char block[16][4], unsigned char* out);
+// 16 bytes: EAC alpha block, then the ETC2 RGB block
+void encodeETC2RGBA(const unsigned char block[16][4], unsigned char* out);
+
+// Compresses a tightly packed 8-bit image of 1..4 channels; edge blocks repeat the last row
+// and column. Greyscale expands to RGB, missing alpha is opaque.
+std::vector<unsigned char> compressImage(const unsigned char* pixels, int width, int height, int channels, PackTextureFormat format);
@@ -0,0 +1,337 @@
+// Offline asset cooker: decodes every image under the given directories, precomputes its mip
+// chain and writes it, together with the built-in meshes, into one pack file the engine mmaps
+// (format in include/AssetPack.hpp).
+//
+//   assetcooker [--flip] [--compress=<target>] <output.pack> <source root> <dir>...
+//
+// Entry names are paths relative to <source root>, e.g. "assets/container2.png".
+//
+// --compress picks block formats per usage, judged from the file name:
+//   target   colour (albedo)          *_specular, *_mask, grey   *_normal
+//   none     raw                      raw                        raw
+//   bc7      BC7                      BC4                        BC5
+//   s3tc     BC1, or BC3 with alpha   BC4                        BC5
+//   etc2     ETC2 RGB8 / RGBA8        ETC2 RGB8                  ETC2 RGB8
+// The engine falls back to the loose file for formats its context can't sample. Mips are
+// Kaiser-filtered, colour images in linear light; images are cooked in parallel.
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stb_image/stb_image.h>
+#include "AssetPack.hpp"
+#include "BuiltinMeshes.hpp"
+#include "MipChain.hpp"
+#include "TextureUsage.hpp"
+#include "compress.hpp"
+
+namespace fs = std::filesystem;
+
+struct CookedEntry {
+    std::string name;
+    uint32_t type = 0;
+    // record struct followed by payload; offsets inside are relative to the record until
+    // the entry is placed in the file
+    std::vector<unsigned char> bytes;
+};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+enum CompressTarget {
+    COMPRESS_NONE,
+    COMPRESS_BC7,
+    COMPRESS_S3TC,
+    COMPRESS_ETC2,
+};
+
+static bool hasTranslucency(const std::vector<unsigned char>& pixels, int channels) {
+    if (channels != 4) {
+        return false;
+    }
+    for (size_t i = 3; i < pixels.size(); i += 4) {
+        if (pixels[i] != 255) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static PackTextureFormat chooseFormat(CompressTarget target, TextureUsage usage, bool translucent) {
+    switch (target) {
+    case COMPRESS_BC7:
+        return usage == TEXTURE_USAGE_NORMAL ? PACK_FORMAT_BC5 : usage == TEXTURE_USAGE_MASK ? PACK_FORMAT_BC4 : PACK_FORMAT_BC7;
+    case COMPRESS_S3TC:
+        if (usage != TEXTURE_USAGE_COLOR) {
+            return usage == TEXTURE_USAGE_NORMAL ? PACK_FORMAT_BC5 : PACK_FORMAT_BC4;
+        }
+        return translucent ? PACK_FORMAT_BC3 : PACK_FORMAT_BC1;
+    case COMPRESS_ETC2:
+        return usage == TEXTURE_USAGE_COLOR && translucent ? PACK_FORMAT_ETC2_RGBA8 : PACK_FORMAT_ETC2_RGB8;
+    default:
+        return PACK_FORMAT_RAW;
+    }
+}
+
+static bool cookTexture(const fs::path& file, bool flip, CompressTarget target, CookedEntry& entry) {
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(flip ? 1 : 0);
+    unsigned char* data = stbi_load(file.string().c_str(), &width, &height, &channels, 0);
+    if (!data) {
+        std::cerr << "cook: failed to decode " << file << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    // two-channel images have no matching upload format in the engine; expand to RGBA
+    if (channels == 2) {
+        stbi_image_free(data);
+        data = stbi_load(file.string().c_str(), &width, &height, &channels, 4);
+        if (!data) {
+            std::cerr << "cook: failed to decode " << file << ": " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+        channels = 4;
+    }
+
+    PackTexture record = {};
+    record.width = (uint32_t)width;
+    record.height = (uint32_t)height;
+    record.channels = (uint32_t)channels;
+    record.flags = flip ? PACK_TEXTURE_FLIPPED : 0;
+
+    std::vector<unsigned char> level(data, data + (size_t)width * height * channels);
+    stbi_image_free(data);
+    record.contentHash = hashImagePixels(width, height, channels, level.data(), level.size());
+    const TextureUsage usage = classifyTexture(file.string(), channels);
+    const PackTextureFormat format = chooseFormat(target, usage, hasTranslucency(level, channels));
+    record.format = format;
+
+    // levels are Kaiser-filtered from the uncompressed level above (colour in linear light),
+    // then compressed on their own
+    entry.bytes.resize(sizeof(PackTexture));
+    int w = width, h = height;
+    for (;;) {
+        std::vector<unsigned char> compressed;
+        if (format != PACK_FORMAT_RAW) {
+            compressed = compressImage(level.data(), w, h, channels, format);
+        }
+        const std::vector<unsigned char>& stored = format != PACK_FORMAT_RAW ? compressed : level;
+
+        PackMip& mip = record.mips[record.mipCount++];
+        mip.width = (uint32_t)w;
+        mip.height = (uint32_t)h;
+        mip.offset = alignUp(entry.bytes.size(), PACK_DATA_ALIGNMENT);
+        mip.size = stored.size();
+        entry.bytes.resize(mip.offset + mip.size);
+        memcpy(entry.bytes.data() + mip.offset, stored.data(), stored.size());
+
+        if ((w == 1 && h == 1) || record.mipCount == PACK_MAX_MIPS) {
+            break;
+        }
+        std::vector<unsigned char> next((size_t)std::max(w / 2, 1) * std::max(h / 2, 1) * channels);
+        downsampleLevel(level.data(), w, h, channels, usage == TEXTURE_USAGE_COLOR, MIP_FILTER_KAISER, next.data());
+        level.swap(next);
+        w = std::max(w / 2, 1);
+        h = std::max(h / 2, 1);
+    }
+    memcpy(entry.bytes.data(), &record, sizeof(record));
+    return true;
+}
+
+static void cookMesh(const float* vertices, size_t floatCount, uint32_t floatsPerVertex, CookedEntry& entry) {
+    PackMesh record = {};
+    record.floatsPerVertex = floatsPerVertex;
+    record.vertexCount = (uint32_t)(floatCount / floatsPerVertex);
+    record.vertexOffset = alignUp(sizeof(PackMesh), PACK_DATA_ALIGNMENT);
+    record.indexOffset = 0;
+
+    entry.bytes.resize(record.vertexOffset + floatCount * sizeof(float));
+    memcpy(entry.bytes.data(), &record, sizeof(record));
+    memcpy(entry.bytes.data() + record.vertexOffset, vertices, floatCount * sizeof(float));
+}
+
+// Offsets inside a record are relative until now; make them absolute file offsets
+static void relocate(CookedEntry& entry, uint64_t base) {
+    if (entry.type == PACK_TEXTURE) {
+        PackTexture record;
+        memcpy(&record, entry.bytes.data(), sizeof(record));
+        for (uint32_t level = 0; level < record.mipCount; ++level) {
+            record.mips[level].offset += base;
+        }
+        memcpy(entry.bytes.data(), &record, sizeof(record));
+    } else if (entry.type == PACK_MESH) {
+        PackMesh record;
+        memcpy(&record, entry.bytes.data(), sizeof(record));
+        record.vertexOffset += base;
+        if (record.indexCount) {
+            record.indexOffset += base;
+        }
+        memcpy(entry.bytes.data(), &record, sizeof(record));
+    }
+}
+
+static bool isImage(const fs::path& file) {
+    std::string extension = file.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".bmp" || extension == ".tga";
+}
+
+int main(int argc, char** argv) {
+    bool flip = false;
+    CompressTarget target = COMPRESS_NONE;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--flip") == 0) {
+            flip = true;
+        } else if (strncmp(argv[i], "--compress=", 11) == 0) {
+            const char* name = argv[i] + 11;
+            if (strcmp(name, "none") == 0) {
+                target = COMPRESS_NONE;
+            } else if (strcmp(name, "bc7") == 0) {
+                target = COMPRESS_BC7;
+            } else if (strcmp(name, "s3tc") == 0) {
+                target = COMPRESS_S3TC;
+            } else if (strcmp(name, "etc2") == 0) {
+                target = COMPRESS_ETC2;
+            } else {
+                std::cerr << "cook: unknown compression target " << name << " (none, bc7, s3tc, etc2)" << std::endl;
+                return 1;
+            }
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() < 3) {
+        std::cerr << "usage: assetcooker [--flip] [--compress=none|bc7|s3tc|etc2] <output.pack> <source root> <dir>..." << std::endl;
+        return 1;
+    }
+    const fs::path output = args[0];
+    const fs::path root = fs::weakly_canonical(args[1]);
+
+    std::vector<CookedEntry> images;
+    for (size_t i = 2; i < args.size(); ++i) {
+        fs::path dir = root / args[i];
+        if (!fs::is_directory(dir)) {
+            std::cerr << "cook: skipping missing directory " << dir << std::endl;
+            continue;
+        }
+        for (const fs::directory_entry& file : fs::recursive_directory_iterator(dir)) {
+            if (!file.is_regular_file() || !isImage(file.path())) {
+                continue;
+            }
+            CookedEntry entry;
+            entry.name = fs::weakly_canonical(file.path()).lexically_relative(root).generic_string();
+            entry.type = PACK_TEXTURE;
+            images.push_back(std::move(entry));
+        }
+    }
+
+    // images cook independently (decode, mips, compression), one per hardware thread
+    std::vector<char> cooked(images.size(), 0);
+    std::atomic<size_t> nextImage{0};
+    auto cookImages = [&]() {
+        for (size_t i = nextImage++; i < images.size(); i = nextImage++) {
+            cooked[i] = cookTexture(root / images[i].name, flip, target, images[i]);
+        }
+    };
+    std::vector<std::thread> workers;
+    unsigned threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), std::max<size_t>(images.size(), 1));
+    for (unsigned t = 1; t < threadCount; ++t) {
+        workers.emplace_back(cookImages);
+    }
+    cookImages();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    std::vector<CookedEntry> entries;
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (cooked[i]) {
+            entries.push_back(std::move(images[i]));
+        }
+    }
+
+    CookedEntry cube;
+    cube.name = CUBE_MESH_NAME;
+    cube.type = PACK_MESH;
+    cookMesh(cubeVertices, sizeof(cubeVertices) / sizeof(float), 8, cube);
+    entries.push_back(std::move(cube));
+
+    CookedEntry lamp;
+    lamp.name = LAMP_MESH_NAME;
+    lamp.type = PACK_MESH;
+    cookMesh(lampVertices, sizeof(lampVertices) / sizeof(float), 6, lamp);
+    entries.push_back(std::move(lamp));
+
+    std::sort(entries.begin(), entries.end(), [](const CookedEntry& a, const CookedEntry& b) { return a.name < b.name; });
+
+    // header, TOC and strings first, then every record on its own page
+    PackHeader header = {};
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.entryCount = (uint32_t)entries.size();
+    header.tocOffset = sizeof(PackHeader);
+    header.stringsOffset = header.tocOffset + entries.size() * sizeof(PackEntry);
+
+    std::vector<PackEntry> toc(entries.size());
+    std::string strings;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        toc[i].type = entries[i].type;
+        toc[i].nameOffset = (uint32_t)strings.size();
+        strings += entries[i].name;
+        strings += '\0';
+    }
+
+    uint64_t offset = alignUp(header.stringsOffset + strings.size(), PACK_RECORD_ALIGNMENT);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        toc[i].offset = offset;
+        toc[i].size = entries[i].bytes.size();
+        relocate(entries[i], offset);
+        offset = alignUp(offset + toc[i].size, PACK_RECORD_ALIGNMENT);
+    }
+    header.fileSize = offset;
+
+    // write beside the target and rename, so a running engine never maps a half-written pack
+    fs::path temporary = output;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "cook: cannot write " << temporary << std::endl;
+            return 1;
+        }
+        std::vector<char> padding(PACK_RECORD_ALIGNMENT, 0);
+        auto padTo = [&](uint64_t position) {
+            uint64_t current = (uint64_t)file.tellp();
+            file.write(padding.data(), (std::streamsize)(position - current));
+        };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(toc.data()), (std::streamsize)(toc.size() * sizeof(PackEntry)));
+        file.write(strings.data(), (std::streamsize)strings.size());
+        for (size_t i = 0; i < entries.size(); ++i) {
+            padTo(toc[i].offset);
+            file.write(reinterpret_cast<const char*>(entries[i].bytes.data()), (std::streamsize)entries[i].bytes.size());
+        }
+        padTo(header.fileSize);
+        if (!file) {
+            std::cerr << "cook: write to " << temporary << " failed" << std::endl;
+            return 1;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporary, output, error);
+    if (error) {
+        std::cerr << "cook: cannot replace " << output << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    std::cout << "cook: " << entries.size() << " entries, " << header.fileSize / 1024 << " KB -> " << output.string() << std::endl;
+    return 0;
+}
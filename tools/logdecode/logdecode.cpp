@@ -0,0 +1,131 @@
+// Decodes a binary log (built with LOG_BINARY) back into the text the logger would have
+// written, line for line.
+//
+//   logdecode <file.blog> [output.log]
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "utils/logformat.h"
+
+using namespace logging;
+
+struct Site {
+    unsigned tag = 0;
+    unsigned line = 0;
+    std::string file;
+    std::string format;
+    bool defined = false;
+};
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: logdecode <file.blog> [output.log]" << std::endl;
+        return 1;
+    }
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cerr << "logdecode: cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    BinaryLogHeader header;
+    if (bytes.size() < sizeof(header)) {
+        std::cerr << "logdecode: " << argv[1] << " is too short" << std::endl;
+        return 1;
+    }
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.magic != BINARY_LOG_MAGIC || header.version != BINARY_LOG_VERSION) {
+        std::cerr << "logdecode: " << argv[1] << " is not a version " << BINARY_LOG_VERSION << " binary log" << std::endl;
+        return 1;
+    }
+
+    FILE* output = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (!output) {
+        std::cerr << "logdecode: cannot write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    ArgReader in{ bytes.data(), bytes.size(), sizeof(header) };
+    auto readText = [&](std::string& value) {
+        uint64_t length;
+        if (!in.varint(length) || in.size - in.offset < length) {
+            return false;
+        }
+        value.assign(reinterpret_cast<const char*>(in.data + in.offset), (size_t)length);
+        in.offset += (size_t)length;
+        return true;
+    };
+
+    std::vector<Site> sites;
+    uint64_t timestamp = header.startSteadyNanoseconds;
+    size_t records = 0;
+    std::string message;
+    std::string line;
+    char timeText[64];
+
+    uint8_t kind;
+    while (in.byte(kind)) {
+        bool ok = true;
+        line.clear();
+        if (kind == 'F') {
+            uint64_t id, lineNumber;
+            uint8_t tag;
+            Site site;
+            ok = in.varint(id) && in.byte(tag) && in.varint(lineNumber) && readText(site.file) && readText(site.format);
+            if (ok) {
+                site.tag = tag;
+                site.line = (unsigned)lineNumber;
+                site.defined = true;
+                if (id >= sites.size()) {
+                    sites.resize((size_t)id + 1);
+                }
+                sites[(size_t)id] = std::move(site);
+            }
+        } else if (kind == 'R') {
+            uint64_t id, zigzag, argBytes;
+            ok = in.varint(id) && in.varint(zigzag) && in.varint(argBytes) && in.size - in.offset >= argBytes;
+            if (ok) {
+                timestamp += (uint64_t)((zigzag >> 1) ^ (0 - (zigzag & 1)));
+                int64_t wall = header.startWallNanoseconds + (int64_t)(timestamp - header.startSteadyNanoseconds);
+                formatTime(wall, timeText, sizeof(timeText));
+
+                message.clear();
+                if (id < sites.size() && sites[(size_t)id].defined) {
+                    const Site& site = sites[(size_t)id];
+                    formatMessage(site.format.c_str(), in.data + in.offset, (size_t)argBytes, message);
+                    formatLine(timeText, site.tag, site.file.c_str(), site.line, message, line);
+                } else {
+                    formatLine(timeText, 3, "logdecode", 0, "record for undefined format " + std::to_string(id), line);
+                }
+                in.offset += (size_t)argBytes;
+                ++records;
+            }
+        } else if (kind == 'D') {
+            uint64_t dropped;
+            ok = in.varint(dropped);
+            if (ok) {
+                int64_t wall = header.startWallNanoseconds + (int64_t)(timestamp - header.startSteadyNanoseconds);
+                formatTime(wall, timeText, sizeof(timeText));
+                formatDroppedLine(timeText, dropped, line);
+            }
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            std::cerr << "logdecode: corrupt or truncated entry at byte " << in.offset << ", stopping" << std::endl;
+            break;
+        }
+        fwrite(line.data(), 1, line.size(), output);
+    }
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    std::cerr << "logdecode: " << records << " records, " << bytes.size() << " bytes" << std::endl;
+    return 0;
+}